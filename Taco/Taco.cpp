@@ -12,8 +12,21 @@
 
 #include "Arduino.h"
 #include "Taco.h"
-
-
+#include "mbedtls/sha1.h"
+#include "mbedtls/base64.h"
+#include "mbedtls/sha256.h"
+#include <Update.h>
+#include "esp_ota_ops.h"
+#include "mdns.h"
+#include "esp_heap_caps.h"
+
+//big endian, as OSC
+static void writeBE32(uint8_t* p, uint32_t v){
+  p[0] = v >> 24;
+  p[1] = v >> 16;
+  p[2] = v >> 8;
+  p[3] = v;
+}
 
 Taco::Taco(int ledPin, int hardResetPin) {
   _ledPin = ledPin;
@@ -27,8 +40,14 @@ Taco::Taco(int ledPin, int hardResetPin) {
   mode_clean = false;
   mode_test = true;
 
+  for(int i = 0; i < TACO_MAX_PINS; i++){
+    d_values[i] = -1;
+    a_values[i] = -1;
+  }
+
   WebServer _server(80);
 
+  addTacoJobs();
 }
 
 
@@ -44,8 +63,60 @@ Taco::Taco(int ledPin, int hardResetPin, const char *AP_name) {
   mode_clean = false;
   mode_test = false;
 
+  for(int i = 0; i < TACO_MAX_PINS; i++){
+    d_values[i] = -1;
+    a_values[i] = -1;
+  }
+
   WebServer _server(80);
 
+  addTacoJobs();
+}
+
+//what update() does, as jobs
+void Taco::addTacoJobs(){
+  //values of the I2C sensors and blocks of samples
+  addJob("sensors", [this](){
+    updateSensors();
+    updateImu();
+  }, 0, TACO_JOB_STREAM, 200);
+  addJob("streams", [this](){ updateStreams(); }, 0, TACO_JOB_STREAM, 500);
+
+  //ESP-NOW gateway: forward what the nodes sent
+  addJob("espnow", [this](){
+    if(espNowTransport.isGateway()) forwardEspNow();
+  }, 0, TACO_JOB_STREAM, 500);
+
+  //read OSC messages sent to the board, and apply the changes of
+  //configuration between two frames
+  addJob("osc", [this](){
+    poll();
+    applyConfig();
+    updateClients();
+  }, 0, TACO_JOB_CONTROL, 500);
+
+  //clock sync requests and congestion control, they keep their own time
+  addJob("sync", [this](){
+    updateSync();
+    updateRate();
+  }, 0, TACO_JOB_CONTROL, 200);
+
+  //OLED animation and dashboard, drawn a piece at a time
+  addJob("display", [this](){
+    updateStars();
+    updateDashboard();
+  }, 0, TACO_JOB_BACKGROUND, TACO_DASH_BUDGET);
+
+  //hosts found with mDNS, changes asked from the web server, the health of a
+  //new firmware and the mDNS text records
+  addJob("web", [this](){
+    updateDiscovery();
+    updateWeb();
+    updateOta();
+    if(mdnsTxtDirty) mdnsTxt();
+  }, 20, TACO_JOB_BACKGROUND, 500);
+
+  addJob("wifi", [this](){ updateWifi(); }, 4, TACO_JOB_BACKGROUND, 200);
 }
 
 
@@ -65,9 +136,16 @@ bool Taco::begin(int udpPort) {
 
   pinMode(_hardResetPin, INPUT_PULLUP); //hardreset pin
 
+  //the loop, for the memory statistics
+  loopTaskHandle = xTaskGetCurrentTaskHandle();
+  TacoAlloc::setTask(TACO_SUB_OTHER);
+
   ///eeprom init
   EEPROM.begin(EEPROM_SIZE);
 
+  //a new firmware on trial is confirmed or rolled back
+  otaBoot();
+
   //update Access Point name ssid and password if user changed them
   writeStringMem(130, APssid);
   if(new_ssid) {
@@ -110,6 +188,10 @@ bool Taco::begin(int udpPort) {
   //read configuration from eeprom in both AP (access point) or STA (Station network) modes
   confSettings();
 
+  //runtime configuration saved by the hosts (pins, rates...) and OSC routes to change it
+  loadConfig();
+  configRoutes();
+
   //decide how to connect
   if(accesspoint) {
     boolean APconnected = false;
@@ -149,33 +231,55 @@ void Taco::configureWifi(String net, String pass){
 //DIGITAL PIN DEFINITION
 void Taco::def_digital_pins(int digital_pins[], int n_pins){
 
-  nr_d_pins = n_pins;
+  TacoConfig& c = editConfig();
+  c.nDigital = constrain(n_pins, 0, TACO_MAX_PINS);
 
   Serial.print("Digital pins defined: ");
 
-  for(int i=0;i<=n_pins-1;i++){
+  for(int i=0;i<c.nDigital;i++){
     Serial.print(digital_pins[i], DEC);
     Serial.print(" ");
-    d_pins.push_back(digital_pins[i]);
-    d_values.push_back(-1);
+    c.digitalPins[i] = digital_pins[i];
   }
   Serial.println(" ");
+  applyConfig();
 }
 
 //ANALOG PIN DEFINITION
 void Taco::def_analog_pins(int analog_pins[], int n_pins){
 
-  nr_a_pins = n_pins;
+  TacoConfig& c = editConfig();
+  c.nAnalog = constrain(n_pins, 0, TACO_MAX_PINS);
 
   Serial.print("analog pins defined: ");
 
-  for(int i=0;i<=n_pins-1;i++){
+  for(int i=0;i<c.nAnalog;i++){
     Serial.print(analog_pins[i], DEC);
     Serial.print(" ");
-    a_pins.push_back(analog_pins[i]);
-    a_values.push_back(-1);
+    c.analogPins[i] = analog_pins[i];
   }
   Serial.println(" ");
+  applyConfig();
+}
+
+void Taco::setSampleRate(float hz){
+  editConfig().samplePeriod = (hz > 0) ? 1000000.0 / hz : 0;
+  applyConfig();
+}
+
+void Taco::setDeadband(int index, int value){
+  TacoConfig& c = editConfig();
+  for(int i = 0; i < TACO_MAX_PINS; i++){
+    if(index < 0 || index == i) c.deadband[i] = constrain(value, 0, 4095);
+  }
+  applyConfig();
+}
+
+void Taco::setPinMasks(uint32_t digitalMask, uint32_t analogMask){
+  TacoConfig& c = editConfig();
+  c.digitalMask = digitalMask;
+  c.analogMask = analogMask;
+  applyConfig();
 }
 
 
@@ -188,6 +292,7 @@ void Taco::def_analog_pins(int analog_pins[], int n_pins){
 ////////////////////////////////////////////////////////////
 
 void Taco::update(){
+  TACO_TRACE_SCOPE("update");
   //if connected and ALL ok the LED should be ON
   if(ok) {
     digitalWrite(_ledPin, HIGH);
@@ -195,6 +300,10 @@ void Taco::update(){
     digitalWrite(_ledPin, LOW);
   }
 
+  //the jobs that are due: streaming first, then control, then background
+  //work in the time left before the next frame (see addTacoJobs())
+  runJobs();
+
   //after a change of mode we should reboot the board
   if(shouldReboot){
     Serial.println("Rebooting...");
@@ -205,836 +314,4535 @@ void Taco::update(){
 
 }
 
+/////////////////////////////////////////////////////////////
+//   scheduler of update()
+/////////////////////////////////////////////////////////////
+
+int Taco::addJob(const char* name, TacoJobHandler run, float rate, TacoJobPriority priority, uint32_t budget){
+  if(nJobs >= TACO_MAX_JOBS) return -1;
+  TacoJob& j = jobs[nJobs];
+  j.name = name;
+  j.run = run;
+  j.priority = priority;
+  j.budget = budget;
+  j.enabled = true;
+  j.waiting = false;
+  j.runs = j.misses = j.overruns = j.deferred = j.maxTime = j.meanTime = 0;
+  j.lastRun = j.next = micros();
+  setJobRate(nJobs, rate);
+  return nJobs++;
+}
+
+void Taco::setJobRate(int job, float rate){
+  if(job < 0 || job >= nJobs) return;
+  jobs[job].period = rate > 0 ? 1000000.0f / rate : 0;
+  jobs[job].next = micros();
+}
+
+void Taco::enableJob(int job, bool enabled){
+  if(job < 0 || job >= nJobs) return;
+  jobs[job].enabled = enabled;
+  jobs[job].next = micros();
+}
+
+int Taco::findJob(const char* name){
+  for(int i = 0; i < nJobs; i++){
+    if(strcmp(jobs[i].name, name) == 0) return i;
+  }
+  return -1;
+}
+
+int Taco::jobCount(){
+  return nJobs;
+}
+
+const TacoJob* Taco::job(int index){
+  return (index >= 0 && index < nJobs) ? &jobs[index] : NULL;
+}
+
+static bool jobDue(const TacoJob& j, uint32_t now){
+  return j.enabled && (j.period == 0 || (int32_t)(now - j.next) >= 0);
+}
+
+void Taco::runJobs(){
+  uint32_t now = micros();
+
+  //stream jobs, then control jobs: whenever they are due
+  for(int p = TACO_JOB_STREAM; p <= TACO_JOB_CONTROL; p++){
+    for(int i = 0; i < nJobs; i++){
+      if(jobs[i].priority == p && jobDue(jobs[i], now)) now = runJob(jobs[i], now);
+    }
+  }
+
+  //background jobs, if what they usually take fits before the next frame
+  //(the budget until they ran once). One that waited too long runs anyway,
+  //and it counts as a miss
+  for(int i = 0; i < nJobs; i++){
+    TacoJob& j = jobs[i];
+    if(j.priority != TACO_JOB_BACKGROUND || !jobDue(j, now)) continue;
+
+    uint32_t dueSince = j.period ? j.next : j.lastRun;
+    bool starved = now - dueSince >= TACO_JOB_MAX_DEFER * 1000UL;
+    uint32_t cost = j.runs ? j.meanTime : j.budget;
+    if((int32_t)cost > streamSlack(now) && !starved){
+      if(!j.waiting) j.deferred++;
+      j.waiting = true;
+      continue;
+    }
+    if(starved && j.waiting && j.period == 0) j.misses++;   //runJob() counts the periodic ones
+    j.waiting = false;
+    now = runJob(j, now);
+  }
+}
+
+uint32_t Taco::runJob(TacoJob& j, uint32_t now){
+  TACO_TRACE_SCOPE(j.name);
+  j.run();
+  uint32_t end = micros();
+  uint32_t took = end - now;
+
+  j.meanTime = j.runs ? j.meanTime + ((int32_t)took - (int32_t)j.meanTime) / 8 : took;
+  j.runs++;
+  if(took > j.maxTime) j.maxTime = took;
+  if(j.budget && took > j.budget) j.overruns++;
+  j.lastRun = now;
+
+  if(j.period){
+    if(now - j.next >= j.period) j.misses++;        //a whole period late
+    j.next += j.period;
+    if((int32_t)(now - j.next) >= 0) j.next = now + j.period;   //we were late, do not try to catch up
+  }
+  return end;
+}
+
+int32_t Taco::streamSlack(uint32_t now){
+  int32_t slack = INT32_MAX;
+  for(int i = 0; i < nJobs; i++){
+    const TacoJob& j = jobs[i];
+    if(j.priority != TACO_JOB_STREAM || !j.enabled || j.period == 0) continue;
+    int32_t left = j.next - now;
+    if(left < slack) slack = left;
+  }
+  return slack;
+}
+
+//wifi job: reconnect without blocking, waiting twice as long after every attempt
+void Taco::updateWifi(){
+  if(!wifiLost || accesspoint) return;
+  if(millis() - wifiRetryTime < wifiRetryWait) return;
+  wifiRetryTime = millis();
+  wifiRetryWait = min(wifiRetryWait * 2, (unsigned long)TACO_WIFI_RETRY_MAX);
+  Serial.println("Reconnecting to WiFi");
+  WiFi.reconnect();
+}
+
 //Function to read from a list of analog or digital a_pins
-void Taco::readPins(){
-  //Read Values from all inputs
-  //DIGITAL
-  list<int>::iterator it_d;  //iterator to read the list of digital pins
-  d_values.clear();
-  for(it_d=d_pins.begin();it_d!=d_pins.end();it_d++) {
-        d_values.push_back(digitalRead(*it_d));
+bool Taco::readPins(){
+  TACO_TRACE_SCOPE("readPins");
+  TacoAllocScope scope(TACO_SUB_PINS);
+
+  //is it time for a new frame?
+  if(conf.samplePeriod > 0){
+    unsigned long now = micros();
+    if(now - lastSample < conf.samplePeriod) return false;
+    lastSample += conf.samplePeriod;
+    if(now - lastSample >= conf.samplePeriod) lastSample = now;  //we were late, do not try to catch up
   }
 
-  //Below some code to check now if the valuesin d_values are correctly stored
-  /*
-  list<int>::iterator itt;
-  for(itt=d_values.begin();itt!=d_values.end();itt++) {
-        Serial.print("Check pin ");
-        Serial.print(*itt);
-        Serial.println(" values ");
+  bool changed = false;
+
+  //Read Values from all inputs
+  //DIGITAL
+  for(int i = 0; i < conf.nDigital; i++){
+    if(!(conf.digitalMask & (1UL << i))) continue;
+    int value = digitalRead(conf.digitalPins[i]);
+    if(value != d_values[i]){
+      d_values[i] = value;
+      changed = true;
+    }
   }
-  delay(500);
-  */
 
   //ANALOG
-  list<int>::iterator it_a;
-  a_values.clear();
-  for(it_a=a_pins.begin();it_a!=a_pins.end();it_a++) {
-        a_values.push_back(analogRead(*it_a));
+  for(int i = 0; i < conf.nAnalog; i++){
+    if(!(conf.analogMask & (1UL << i))) continue;
+    int value = analogRead(conf.analogPins[i]);
+    if(a_values[i] < 0 || abs(value - a_values[i]) > conf.deadband[i]){
+      a_values[i] = value;
+      changed = true;
+    }
   }
+
+  liveSample();
+  return changed;
+}
+
+int Taco::digitalValue(int index){
+  return (index >= 0 && index < conf.nDigital) ? d_values[index] : -1;
+}
+
+int Taco::analogValue(int index){
+  return (index >= 0 && index < conf.nAnalog) ? a_values[index] : -1;
 }
 
 
 // Funtion sending OSC messages to the network
 void Taco::send(OSCMessage& msg, float value){
+  msg.add(value);
+  sendMessage(msg);
+  msg.empty();
+}
+
+// SEND FOR array OF ARGUMENTS, size is the number of arguments
+void Taco::send(OSCMessage& msg, float *arr, int size){
+  for(int j=0; j<=size-1;j++){ //add array contents
+    msg.add(arr[j]);
+  }
+  sendMessage(msg);
+  msg.empty();
+}
+
+// send a complete message to all the destinations
+void Taco::sendMessage(OSCMessage& msg){
+  TACO_TRACE_SCOPE("send");
+  TacoAllocScope scope(TACO_SUB_SEND);
+
+  //encode it once for all the destinations
+  txPacket.clear();
+  msg.send(txPacket);
+  sendFrame();
+}
+
+void Taco::sendBuffer(const uint8_t* data, int length, int address, uint32_t seq){
+  sendParts(&data, &length, 1, address, seq);
+}
+
+//a packet made of several pieces of memory, written one after the other
+void Taco::sendParts(const uint8_t* const* parts, const int* lengths, int nParts, int address, uint32_t seq){
+
+  //wired transports have a single receiver
+  if(transport->isPointToPoint()){
+    sendPacket(parts, lengths, nParts, IPAddress(), 0);
+    return;
+  }
 
   // OSC data transmission of orientation sensor
-  if(connected || APconnected){ //only send OSC data when connected
+  if(!(connected || APconnected)) return; //only send OSC data when connected
 
-    if(accesspoint){   // ESP32 AS ACCESS POINT: send to all connected clients
+  //a control flag
+  ok = false; //set to false
 
-        //a control flag
-        ok = false; //set to false
+  //one packet for everybody listening to the group or the subnet
+  if(conf.sendMode != TACO_SEND_UNICAST){
+    IPAddress group = (conf.sendMode == TACO_SEND_BROADCAST) ? broadcastAddress() : IPAddress(conf.group);
+    sendPacket(parts, lengths, nParts, group, _udpPort);
+    ok = true;
+  }
 
-        for(int i = 0; i < numClients; i++) {
-          ok = true;
-          msg.add(value);  // some dummy data (milliseconds running this code)
-          udp.beginPacket(clientsAddress[i], _udpPort);
-          msg.send(udp);
-          udp.endPacket();
-          msg.empty();
-        }
+  //one packet per destination, or only to the ones that can not receive the group
+  if(rateControl && nDests > 0) storeFrame(parts, lengths, nParts, address, seq);
+  for(int i = 0; i < nDests; i++) {
+    TacoDest& d = dests[i];
+    if(conf.sendMode != TACO_SEND_UNICAST && !d.fallback) continue;
+    if(rateControl){
+      flushDest(d);
+    } else if(wants(d, address, seq)){
+      //every address has its own rate, so the first ones sent do not starve the rest
+      uint32_t now = (uint32_t)esp_timer_get_time();
+      if(d.maxRate > 0 && now - d.lastSent[address] < (uint32_t)(1000000 / d.maxRate)) continue;
+      d.lastSent[address] = now;
+      sendPacket(parts, lengths, nParts, d.ip, d.port ? d.port : _udpPort);
     }
-    if(!accesspoint){ ///CONNECTED TO STA WIFI
-     ok = false;
+    ok = true;
+  }
+}
 
-      //OSC send
+//one mask check for the filter, and the decimation
+bool Taco::wants(TacoDest& d, int address, uint32_t seq){
+  return (d.mask & (1UL << address)) && (d.decimation <= 1 || seq % d.decimation == 0);
+}
 
-      //Multicast Discovered Hosts
-      for (int i = 0; i < nServices; ++i) {
-        ok = true;
-        //Ip address to transmit udp packages
-        sta_clientAddress = MDNS.IP(i);
+//encode a message of floats straight into the packet, without an OSCMessage
+void Taco::sendFloats(const char* address, const float* values, int n){
+  txPacket.clear();
+  txPacket.addFloats(address, values, n);
+  sendFrame();
+}
 
-        //Debug.printf("input1: %s\n", String(inputVal).c_str()); // Note: if type is String need c_str()
-        msg.add(value);  // some dummy data (milliseconds running this code)
-        udp.beginPacket(sta_clientAddress, _udpPort);
-        msg.send(udp);
-        udp.endPacket();
-        msg.empty();
-      }
+// The message in txPacket leaves with the frame header, if any
+void Taco::sendFrame(){
+  if(txPacket.overflow()) return;
 
-      //Extra hosts added with taco.addHost("host_name");
-      for (int i = 0; i < nExtraHosts; ++i) {
-        ok = true;
-        //Ip address to transmit udp packages
-        sta_clientAddress = extraHostAddress[i];
-
-        msg.add(value);
-        udp.beginPacket(sta_clientAddress, _udpPort);
-        msg.send(udp);
-        udp.endPacket();
-        msg.empty();
-      }
+  //the address starts the message, every address has its sequence numbers
+  int address = addressIndex((const char*)txPacket.data());
+  uint32_t seq = addrCount[address]++;
 
-    }
+  if(conf.frameHeader == TACO_HEADER_ARGS){
+    if(!txPacket.insertTypeTags("ih")) return;
+    txPacket.addInt32(seq);
+    txPacket.addInt64(syncedMicros());
+    if(txPacket.overflow()) return;
+  }
 
+  if(conf.frameHeader == TACO_HEADER_BUNDLE){
+    //#bundle, timetag, /taco/frame ,i seq, then the message, without copying it
+    uint8_t head[48];
+    TacoBundle::header(head, timeTag());
+    writeBE32(head + 16, 20);
+    memcpy(head + 20, "/taco/frame\0,i\0\0", 16);
+    writeBE32(head + 36, seq);
+    writeBE32(head + 40, txPacket.length());
+
+    const uint8_t* parts[2] = {head, txPacket.data()};
+    int lengths[2] = {44, txPacket.length()};
+    sendParts(parts, lengths, 2, address, seq);
+    return;
   }
+
+  sendBuffer(txPacket.data(), txPacket.length(), address, seq);
 }
 
-// SEND FOR array OF ARGUMENTS, size is the number of arguments
-void Taco::send(OSCMessage& msg, float *arr, int size){
+//seconds and fraction of second (1 / 2^32) since the board started, or since 1900
+//(NTP time) when synced with a host, which sends microseconds since 1970
+uint64_t Taco::timeTag(){
+  uint64_t now = syncedMicros();
+  uint64_t seconds = now / 1000000;
+  if(now > 946684800000000ULL) seconds += 2208988800ULL;   //after 2000, unix time
+  uint64_t fraction = ((now % 1000000) << 32) / 1000000;
+  return (seconds << 32) | fraction;
+}
 
-  // OSC data transmission of orientation sensor
-  if(connected || APconnected){ //only send OSC data when connected
+void Taco::setFrameHeader(int header){
+  editConfig().frameHeader = constrain(header, (int)TACO_HEADER_NONE, (int)TACO_HEADER_BUNDLE);
+  applyConfig();
+}
 
-    if(accesspoint){   // ESP32 AS ACCESS POINT: send to all connected clients
+bool Taco::sendPacket(const uint8_t* const* parts, const int* lengths, int nParts, const IPAddress& ip, uint16_t port){
+  transport->beginPacket(ip, port);
+  for(int i = 0; i < nParts; i++) transport->write(parts[i], lengths[i]);
+  bool sent = transport->endPacket();
+  txPackets++;
+  return sent;
+}
 
-      //a control flag
-      ok = false; //set to false
+//answer through the transport the message came from
+void Taco::sendReply(OSCMessage& msg, TacoOSCMessage& to){
+  TacoTransport* t = to._transport ? to._transport : transport;
+  t->beginPacket(to.remoteIP(), to.remotePort());
+  msg.send(*t);
+  t->endPacket();
+}
 
-      for(int i = 0; i < numClients; i++) {
-        ok = true;
-          for(int j=0; j<=size-1;j++){ //add array contents
-            msg.add(arr[j]);  // some dummy data (milliseconds running this code)
-          }
-          udp.beginPacket(clientsAddress[i], _udpPort);
-          msg.send(udp);
-          udp.endPacket();
-          msg.empty();
-     }
-    }
-    if(!accesspoint){ ///CONNECTED TO STA WIFI
-      ok=false;
-      //OSC send
-      for (int i = 0; i < nServices; ++i) {
-        ok = true;
-
-        //Ip address to transmit udp packages
-        sta_clientAddress = MDNS.IP(i);
-
-        //Debug.printf("input1: %s\n", String(inputVal).c_str()); // Note: if type is String need c_str()
-        for(int j=0; j<=size-1;j++){ //add array contents
-          msg.add(arr[j]);  // some dummy data (milliseconds running this code)
-        }
-        udp.beginPacket(sta_clientAddress, _udpPort);
-        msg.send(udp);
-        udp.endPacket();
-        msg.empty();
-      }
+void Taco::sendReply(const uint8_t* data, int length, TacoOSCMessage& to){
+  TacoTransport* t = to._transport ? to._transport : transport;
+  t->beginPacket(to.remoteIP(), to.remotePort());
+  t->write(data, length);
+  t->endPacket();
+}
 
-      //Extra hosts added with taco.addHost("host_name");
-      for (int i = 0; i < nExtraHosts; ++i) {
-        ok = true;
-        //Ip address to transmit udp packages
-        sta_clientAddress = extraHostAddress[i];
+void Taco::beginSerialTransport(HardwareSerial& serial, unsigned long baud){
+  slipTransport.begin(serial, baud);
+  setTransport(TACO_TRANSPORT_SERIAL);
+}
 
-        for(int j=0; j<=size-1;j++){ //add array contents
-          msg.add(arr[j]);  // some dummy data (milliseconds running this code)
-        }
-        udp.beginPacket(sta_clientAddress, _udpPort);
-        msg.send(udp);
-        udp.endPacket();
-        msg.empty();
-      }
+bool Taco::beginEspNowNode(const uint8_t* gatewayMac, int channel){
+  if(!espNowTransport.beginNode(gatewayMac, channel)){
+    Serial.println("ESP-NOW init failed");
+    return false;
+  }
+  setTransport(TACO_TRANSPORT_ESPNOW);
+  return true;
+}
+
+bool Taco::beginEspNowGateway(){
+  if(!espNowTransport.beginGateway()){
+    Serial.println("ESP-NOW init failed");
+    return false;
+  }
+  //the nodes have to send to the mac of the interface we use
+  Serial.print("ESP-NOW gateway mac: ");
+  Serial.println(accesspoint ? WiFi.softAPmacAddress() : WiFi.macAddress());
+  Serial.print("ESP-NOW channel: ");
+  Serial.println(WiFi.channel());
+  return true;
+}
+
+//frames received from the nodes leave as bundles, as big as a packet can be
+void Taco::forwardEspNow(){
+  TACO_TRACE_SCOPE("forwardEspNow");
+  const uint8_t* frame;
+  int length;
+
+  espNowBundle.begin(1);
+  while((length = espNowTransport.receive(frame)) > 0){
+    if(!espNowBundle.add(frame, length)){
+      sendBuffer(espNowBundle.data(), espNowBundle.length());
+      espNowBundle.begin(1);
+      espNowBundle.add(frame, length);
+    }
+  }
+  if(!espNowBundle.isEmpty()){
+    sendBuffer(espNowBundle.data(), espNowBundle.length());
+  }
+}
+
+void Taco::setTransport(int type){
+  editConfig().transport = type;
+  applyConfig();
+}
+
+void Taco::setSendMode(int mode){
+  editConfig().sendMode = constrain(mode, (int)TACO_SEND_UNICAST, (int)TACO_SEND_BROADCAST);
+  applyConfig();
+}
+
+void Taco::setMulticastGroup(IPAddress group){
+  TacoConfig& c = editConfig();
+  c.group = (uint32_t)group;
+  c.sendMode = TACO_SEND_MULTICAST;
+  applyConfig();
+}
+
+//subnet broadcast address of the network we are in
+IPAddress Taco::broadcastAddress(){
+  if(accesspoint){
+    return IPAddress(192, 168, 0, 255);   //see createAccessPoint()
+  }
+  return IPAddress((uint32_t)WiFi.localIP() | ~(uint32_t)WiFi.subnetMask());
+}
 
 
+///////////////////////////////////////////////
+/// Destinations table
+///////////////////////////////////////////////
 
+// All the hosts we transmit to: clients of our access point, hosts found with
+// mDNS and extra hosts. It is rebuilt when any of them change, so sending
+// only has to go through this table
+void Taco::updateDestinations(){
+  //the state of the hosts that stay is kept
+  static TacoDest old[TACO_MAX_DESTS];    //not on the stack of the loop, only the loop rebuilds the table
+  int nOld = nDests;
+  for(int i = 0; i < nOld; i++) old[i] = dests[i];
+  nDests = 0;
+
+  if(accesspoint){
+    for(int i = 0; i < numClients && i < 10; i++) addDestination(clientsAddress[i], TACO_DEST_AP_CLIENT);
+  } else {
+    for(int i = 0; i < nMdnsHosts; i++){
+      TacoDest* d = addDestination(IPAddress(mdnsHosts[i].ip), TACO_DEST_MDNS);
+      if(d && d->sub < 0) d->port = mdnsHosts[i].port;   //where it listens, unless it subscribed
+    }
+  }
+  for(int i = 0; i < conf.nHosts; i++) addDestination(IPAddress(conf.hosts[i]), TACO_DEST_HOST);
 
+  for(int i = 0; i < nDests; i++){
+    for(int j = 0; j < nOld; j++){
+      if(old[j].ip == dests[i].ip) dests[i].rate = old[j].rate;
     }
   }
 }
 
+TacoDest* Taco::addDestination(const IPAddress& ip, uint8_t source){
+  if((uint32_t)ip == 0) return NULL;
+  for(int i = 0; i < nDests; i++){
+    if(dests[i].ip == ip) return NULL;   //already there
+  }
+  if(nDests >= TACO_MAX_DESTS) return NULL;
+
+  TacoDest& d = dests[nDests++];
+  d.ip = ip;
+  d.source = source;
+  d.fallback = false;
+  for(int i = 0; i < conf.nFallback; i++){
+    if(conf.fallback[i] == (uint32_t)ip) d.fallback = true;
+  }
 
-//////////////////////////////////////////////////////////////////////////////
-//
-// NETWORK METHODS
-//
-/////////////////////////////////////////////////////////////////////////////////
+  //what it subscribed to, everything by default
+  d.port = 0;
+  d.sub = -1;
+  d.mask = 0xFFFFFFFF;
+  d.decimation = 1;
+  d.maxRate = 0;
+  memset(d.lastSent, 0, sizeof(d.lastSent));
+  for(int i = 0; i < conf.nSubs; i++){
+    const TacoSubscription& sub = conf.subs[i];
+    if(sub.ip != (uint32_t)ip) continue;
+    d.port = sub.port;
+    d.sub = i;
+    d.mask = filterMask(sub.filter);
+    d.decimation = max((int)sub.decimation, 1);
+    d.maxRate = sub.maxRate;
+  }
+
+  memset(&d.rate, 0, sizeof(d.rate));
+  d.rate.rate = d.maxRate > 0 ? min(rateMax, d.maxRate) : rateMax;
+  d.rate.tokens = TACO_RATE_BURST;
+  d.rate.nextFrame = framesStored;
+  d.rate.lastRefill = esp_timer_get_time();
+  return &d;
+}
 
 
 ///////////////////////////////////////////////
-/// PRIVATE NETWORK FUNCTIONS
+/// Congestion control
 ///////////////////////////////////////////////
 
-// basic Access Point creation
- void Taco::createAccessPoint(){
+void Taco::setRateControl(bool enabled, float maxRate){
+  rateControl = enabled;
+  rateMax = max(maxRate, (float)TACO_RATE_MIN);
+  for(int i = 0; i < nDests; i++){
+    dests[i].rate.rate = rateMax;
+    dests[i].rate.nextFrame = framesStored;
+  }
 
-   //register to wifi event handler to manage wifi events
-   //we try to make it in begin()
+  // the hosts answer /taco/echo h with the same message
+  if(enabled && !echoRoute){
+    echoRoute = route("/taco/echo", [this](TacoOSCMessage& msg){
+      for(int i = 0; i < nDests; i++){
+        TacoDestRate& r = dests[i].rate;
+        if(dests[i].ip != msg.remoteIP() || r.echoSent == 0 || msg.getInt64(0) != r.echoSent) continue;
+        r.rtt = msg.receiveTime() - r.echoSent;
+        r.echoSent = 0;
+        if(r.minRtt == 0 || r.rtt < r.minRtt) r.minRtt = r.rtt;
+        if(r.rtt > 2 * r.minRtt + TACO_RATE_RTT_MARGIN) backOff(r, msg.receiveTime());
+      }
+    });
+  }
+}
 
-    WiFi.mode(WIFI_AP);
-    Serial.print("---- APssid before creating AP: ");
-    Serial.println(APssid);
-    WiFi.softAP(APssid);
-    delay(100);  //"Wait 100 ms for AP_START..."
+float Taco::destinationRate(IPAddress host){
+  for(int i = 0; i < nDests; i++){
+    if(dests[i].ip == host) return dests[i].rate.rate;
+  }
+  return -1;
+}
 
-    Serial.println("Set softAPConfig");
-    IPAddress Ip(192, 168, 0, 1);       //We fix an IP easy to recover without serial monitor
-    IPAddress NMask(255, 255, 255, 0);
-    WiFi.softAPConfig(Ip, Ip, NMask);
+// Keep a copy of the frame as a bundle element, for the destinations that
+// can not get it now. The oldest frames are overwritten.
+void Taco::storeFrame(const uint8_t* const* parts, const int* lengths, int nParts, int address, uint32_t seq){
+  int length = 4;
+  for(int i = 0; i < nParts; i++) length += lengths[i];
+  if(length > TACO_TX_BUFFER_SIZE) return;
+
+  if(historyWrite + length > TACO_FRAME_HISTORY) historyWrite = 0;
+
+  //frames in the space we are going to use are lost
+  while(oldestFrame < framesStored){
+    TacoFrameSlot& old = frameSlots[oldestFrame % TACO_FRAME_SLOTS];
+    bool overlaps = old.offset < historyWrite + length && historyWrite < old.offset + old.length;
+    if(!overlaps && framesStored - oldestFrame < TACO_FRAME_SLOTS) break;
+    oldestFrame++;
+  }
 
-    IPAddress myIP1 = WiFi.softAPIP();
-    Serial.print("AP IP address: ");
-    Serial.println(myIP1);
-    APconnected = true;
+  TacoFrameSlot& slot = frameSlots[framesStored % TACO_FRAME_SLOTS];
+  slot.offset = historyWrite;
+  slot.length = length;
+  slot.address = address;
+  slot.seq = seq;
+  uint8_t* p = frameHistory + historyWrite;
+  writeBE32(p, length - 4);
+  p += 4;
+  for(int i = 0; i < nParts; i++){
+    memcpy(p, parts[i], lengths[i]);
+    p += lengths[i];
+  }
+  historyWrite += length;
+  framesStored++;
 }
 
-///////////////////////////////////////////
-//wifi basic STA connection function
-///////////////////////////////////////////
-int Taco::connectToWiFi(String ssid, String pwd){
+// Send the frames the destination did not get yet if its rate allows it:
+// one frame alone, or the newest ones in a bundle
+void Taco::flushDest(TacoDest& d){
+  TacoDestRate& r = d.rate;
+  int64_t now = esp_timer_get_time();
 
-  IPAddress staIP(192,168,0,129);         //Board static IP
-  IPAddress staGateway(192,168,0,1);      //Gateway IP
-  IPAddress staSubnet(255,255,255,0);     //Subnet range
-  IPAddress primaryDNS(192, 168, 0, 1);   //optional
-  IPAddress secondaryDNS(8, 8, 4, 4);     //optional
+  //tokens at the allowed rate
+  r.tokens = min((float)TACO_RATE_BURST, r.tokens + r.rate * (now - r.lastRefill) / 1000000.0f);
+  r.lastRefill = now;
 
-  //register event handler. This allows receiving messages of connection, disconnections, etc
-/*
-  Serial.println("Registering to Wifi Events");
-  if(!registered){
-    registered = true;
-    WiFi.onEvent(WiFiEvent);
+  if(r.nextFrame < oldestFrame){
+    r.dropped += oldestFrame - r.nextFrame;
+    r.nextFrame = oldestFrame;
+  }
+  if(r.nextFrame >= framesStored || r.tokens < 1) return;
+
+  //as many of the newest frames it wants as fit in a packet
+  uint32_t frames[TACO_RATE_MAX_BUNDLE];
+  int n = 0;
+  int size = 16;
+  uint32_t f = framesStored;
+  while(f > r.nextFrame && n < TACO_RATE_MAX_BUNDLE){
+    TacoFrameSlot& slot = frameSlots[(f - 1) % TACO_FRAME_SLOTS];
+    if(wants(d, slot.address, slot.seq)){
+      if(size + slot.length > TACO_TX_BUFFER_SIZE) break;
+      size += slot.length;
+      frames[n++] = f - 1;
+    }
+    f--;
+  }
+  r.dropped += f - r.nextFrame;
+  r.nextFrame = framesStored;
+  if(n == 0) return;
+
+  const uint8_t* parts[TACO_RATE_MAX_BUNDLE + 1];
+  int lengths[TACO_RATE_MAX_BUNDLE + 1];
+  int nParts = 0;
+  uint8_t head[16];
+  if(n == 1){
+    //a single frame, without its size
+    TacoFrameSlot& slot = frameSlots[frames[0] % TACO_FRAME_SLOTS];
+    parts[nParts] = frameHistory + slot.offset + 4;
+    lengths[nParts++] = slot.length - 4;
+  } else {
+    TacoBundle::header(head, 1);
+    parts[nParts] = head;
+    lengths[nParts++] = 16;
+    for(int i = n - 1; i >= 0; i--){
+      TacoFrameSlot& slot = frameSlots[frames[i] % TACO_FRAME_SLOTS];
+      parts[nParts] = frameHistory + slot.offset;
+      lengths[nParts++] = slot.length;
+    }
   }
-*/
-  // delete old config if already connected
-  WiFi.disconnect(true);
 
-  //we will simply use gateway as DNS address
-  primaryDNS = staGateway;
-  secondaryDNS = staGateway;
+  bool sent = sendPacket(parts, lengths, nParts, d.ip, d.port ? d.port : _udpPort);
+  int64_t after = esp_timer_get_time();
+  r.tokens -= 1;
 
+  //the queue is full or the driver is blocking: back off, else gain rate slowly
+  if(!sent || after - now > TACO_RATE_BLOCK_US){
+    backOff(r, after);
+  } else if(after - r.lastBackOff > 1000000 / 10){
+    float cap = d.maxRate > 0 ? min(rateMax, d.maxRate) : rateMax;
+    r.rate = min(cap, r.rate + TACO_RATE_INCREASE / max(r.rate, 1.0f));   //+TACO_RATE_INCREASE per second
+  }
+}
 
-  Serial.print("connecting to: ");
-  Serial.println(ssid);
+//halve the rate, once per round trip at most
+void Taco::backOff(TacoDestRate& r, int64_t now){
+  int64_t wait = max((int64_t)r.rtt, (int64_t)100000);
+  if(now - r.lastBackOff < wait) return;
+  r.lastBackOff = now;
+  r.rate = max((float)TACO_RATE_MIN, r.rate / 2);
+  r.backOffs++;
+}
 
-  //connect to wifi
-  WiFi.begin(ssid.c_str(), pwd.c_str());  //I use c_str() as we have to convert strings to arrays of characters
-  //Comment below for DHCP
-  WiFi.config(staIP, staGateway, staSubnet, primaryDNS,secondaryDNS);   //fix IP at network
+//update(): frames waiting for slow destinations, and echoes to measure the round trip
+void Taco::updateRate(){
+  TACO_TRACE_SCOPE("updateRate");
+  if(!rateControl || transport->isPointToPoint() || !(connected || APconnected)) return;
 
-  //while (WiFi.status() != WL_CONNECTED) { //wait until connected
-  //      delay(500);
-  //      Serial.print(".");
-  //  }
+  for(int i = 0; i < nDests; i++){
+    if(conf.sendMode != TACO_SEND_UNICAST && !dests[i].fallback) continue;
+    flushDest(dests[i]);
+  }
 
-  delay(1000);
-  //Some info
-  Serial.println("");
-  Serial.println("WiFi connected!");
-  Serial.print("IP address: ");
-  Serial.println(WiFi.localIP());
-  Serial.print("ESP Mac Address: ");
-  Serial.println(WiFi.macAddress());
-  Serial.print("Subnet Mask: ");
-  Serial.println(WiFi.subnetMask());
-  Serial.print("Gateway IP: ");
-  Serial.println(WiFi.gatewayIP());
-  Serial.print("DNS: ");
-  Serial.println(WiFi.dnsIP());
+  if((long)(millis() - nextEcho) < 0) return;
+  nextEcho = millis() + TACO_ECHO_INTERVAL;
+  for(int i = 0; i < nDests; i++){
+    TacoDestRate& r = dests[i].rate;
+    //an echo that never came back is a lost packet
+    if(r.echoSent != 0 && r.minRtt != 0) backOff(r, esp_timer_get_time());
+    r.echoSent = esp_timer_get_time();
+    txPacket.clear();
+    txPacket.addString("/taco/echo");
+    txPacket.addString(",h");
+    txPacket.addInt64(r.echoSent);
+    const uint8_t* part = txPacket.data();
+    int length = txPacket.length();
+    sendPacket(&part, &length, 1, dests[i].ip, dests[i].port ? dests[i].port : _udpPort);
+  }
+}
 
-  //setup mDNS for collecting the IPs of other machines in the network, only in STA Mode
-  discoverMDNShosts();
 
-  //here is the place to find other hosts too
- //addHost(kike); or you make it at Arduino level with taco.addHost("KIKE-ULTRANOISE")
+//////////////////////////////////////////////////////////////////////////////
+//
+// OSC RECEIVE
+//
+/////////////////////////////////////////////////////////////////////////////////
 
+//OSC numbers are big endian
+static uint32_t readBE32(const uint8_t* p){
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
 
-  return nServices;
+static uint64_t readBE64(const uint8_t* p){
+  return ((uint64_t)readBE32(p) << 32) | readBE32(p + 4);
 }
 
-/////////////////////////////////////////////////////////////////////////////////////////
-///
-/// WIFI management functions
-///
-////////////////////////////////////////////////////////////////////////////////////////////
+//length of an OSC string including its padding, or -1 if it is not terminated inside maxLen
+static int oscStringLength(const uint8_t* p, int maxLen){
+  for(int i = 0; i < maxLen; i++){
+    if(p[i] == 0){
+      int padded = (i + 4) & ~3;
+      return (padded <= maxLen) ? padded : -1;
+    }
+  }
+  return -1;
+}
 
+//FNV-1a hash of an address segment
+static uint32_t segmentHash(const char* p, int len){
+  uint32_t h = 2166136261UL;
+  for(int i = 0; i < len; i++){
+    h ^= (uint8_t)p[i];
+    h *= 16777619UL;
+  }
+  return h;
+}
 
 
-/////////////////////////////////////////////////////////////
-// wifi event handler
-// These are all the messages we receive from Wifi Manager
+int Taco::poll(){
+  TACO_TRACE_SCOPE("poll");
+  TacoAllocScope scope(TACO_SUB_OSC);
+  int packets = 0;
+  int packetSize;
 
-void Taco::manageWiFiEvent(WiFiEvent_t event){
+  //drain the socket, parsePacket() returns 0 when there is nothing left
+  while((packetSize = udp.parsePacket()) > 0){
+    rxMsg._rxTime = esp_timer_get_time();
+    packets++;
+    rxPackets++;
 
-    Serial.printf("[WiFi-event] event: %d\n", event);
-    int result;
+    if(packetSize > TACO_RX_BUFFER_SIZE){
+      rxDropped++;
+      udp.flush();   //discard it
+      continue;
+    }
 
-    switch(event) {
-       case SYSTEM_EVENT_STA_GOT_IP:    //WE HAVE GOT AN IP!!
-          //When connected set
-          Serial.print("WiFi connected! IP address: ");
+    int len = udp.read(rxBuffer, TACO_RX_BUFFER_SIZE);
+    rxMsg._remoteIP = udp.remoteIP();
+    rxMsg._remotePort = udp.remotePort();
+    rxMsg._transport = &udpTransport;
+    udp.flush();
+
+    dispatchPacket(rxBuffer, len, 1, 0);
+  }
+
+  //packets coming through the serial port
+  if(slipTransport.isStarted()){
+    const uint8_t* packet;
+    int len;
+    while((len = slipTransport.receive(packet)) > 0){
+      rxMsg._rxTime = esp_timer_get_time();
+      packets++;
+      rxPackets++;
+      rxMsg._remoteIP = IPAddress();
+      rxMsg._remotePort = 0;
+      rxMsg._transport = &slipTransport;
+      dispatchPacket(packet, len, 1, 0);
+    }
+  }
+  return packets;
+}
+
+
+bool Taco::route(const char* pattern, TacoOSCHandler handler){
+  if(nRoutes >= TACO_MAX_ROUTES || pattern[0] != '/' || strlen(pattern) >= TACO_ROUTE_MAX_LEN){
+    Serial.printf("Can not add OSC route %s\n", pattern);
+    return false;
+  }
+
+  TacoRoute& r = routes[nRoutes];
+  strcpy(r.pattern, pattern);
+  r.nSegments = 0;
+  r.wildcards = 0;
+
+  //split the pattern in segments and hash them
+  int i = 1;
+  while(r.pattern[i - 1] != 0 && r.pattern[i] != 0){
+    if(r.nSegments >= TACO_OSC_MAX_SEGMENTS) return false;
+    int start = i;
+    while(r.pattern[i] != 0 && r.pattern[i] != '/') i++;
+    int n = r.nSegments;
+    r.segOffset[n] = start;
+    r.segLength[n] = i - start;
+    r.segHash[n] = segmentHash(r.pattern + start, i - start);
+    if(i - start == 1 && r.pattern[start] == '*') r.wildcards |= (1 << n);
+    r.nSegments++;
+    if(r.pattern[i] == '/') i++;
+  }
+
+  r.handler = handler;
+  nRoutes++;
+  return true;
+}
+
+
+//a packet is a message or a bundle of packets
+void Taco::dispatchPacket(const uint8_t* data, int len, uint64_t timetag, int depth){
+  if(len >= 16 && memcmp(data, "#bundle", 8) == 0){
+    if(depth >= TACO_OSC_MAX_BUNDLE_DEPTH){
+      rxErrors++;
+      return;
+    }
+    timetag = readBE64(data + 8);
+    int pos = 16;
+    while(pos + 4 <= len){
+      uint32_t elementSize = readBE32(data + pos);
+      pos += 4;
+      if(elementSize > (uint32_t)(len - pos)){
+        rxErrors++;
+        return;
+      }
+      dispatchPacket(data + pos, elementSize, timetag, depth + 1);
+      pos += elementSize;
+    }
+    return;
+  }
+
+  if(!rxMsg.parse(data, len)){
+    rxErrors++;
+    return;
+  }
+  rxMsg._timetag = timetag;
+  dispatchMessage(rxMsg);
+}
+
+
+void Taco::dispatchMessage(TacoOSCMessage& msg){
+  //split the address once, every route is then compared with hashes
+  const char* addr = msg.address();
+  uint8_t n = 0;
+  uint8_t offset[TACO_OSC_MAX_SEGMENTS];
+  uint8_t length[TACO_OSC_MAX_SEGMENTS];
+  uint32_t hash[TACO_OSC_MAX_SEGMENTS];
+
+  int i = 1;
+  while(addr[i - 1] != 0 && addr[i] != 0){
+    if(n >= TACO_OSC_MAX_SEGMENTS || i > 255){
+      rxUnhandled++;
+      return;
+    }
+    int start = i;
+    while(addr[i] != 0 && addr[i] != '/') i++;
+    offset[n] = start;
+    length[n] = i - start;
+    hash[n] = segmentHash(addr + start, i - start);
+    n++;
+    if(addr[i] == '/') i++;
+  }
+
+  bool handled = false;
+  for(int r = 0; r < nRoutes; r++){
+    TacoRoute& route = routes[r];
+    if(route.nSegments != n) continue;
+
+    bool match = true;
+    for(int j = 0; j < n && match; j++){
+      if(route.wildcards & (1 << j)) continue;
+      match = route.segHash[j] == hash[j] && route.segLength[j] == length[j]
+              && memcmp(route.pattern + route.segOffset[j], addr + offset[j], length[j]) == 0;
+    }
+
+    if(match){
+      handled = true;
+      route.handler(msg);
+    }
+  }
+
+  if(!handled) rxUnhandled++;
+}
+
+
+///////////////////////////////////////////////
+/// Received OSC messages
+///////////////////////////////////////////////
+
+bool TacoOSCMessage::parse(const uint8_t* data, int len){
+  _nArgs = 0;
+  _types = "";
+  if(len < 4 || data[0] != '/') return false;
+
+  int pos = oscStringLength(data, len);
+  if(pos < 0) return false;
+  _address = (const char*)data;
+  _data = data;
+  if(pos == len) return true;          //old messages can come without type tags
+
+  if(data[pos] != ',') return false;
+  int tagsLength = oscStringLength(data + pos, len - pos);
+  if(tagsLength < 0) return false;
+  const char* tags = (const char*)data + pos + 1;
+  pos += tagsLength;
+
+  //index the arguments
+  for(const char* t = tags; *t != 0; t++){
+    if(_nArgs >= TACO_OSC_MAX_ARGS) return false;
+    int argLength;
+    switch(*t){
+      case 'i': case 'f': case 'c': case 'r': case 'm':
+        argLength = 4;
+        break;
+      case 'h': case 'd': case 't':
+        argLength = 8;
+        break;
+      case 's': case 'S':
+        argLength = oscStringLength(data + pos, len - pos);
+        break;
+      case 'b':
+        if(pos + 4 > len || readBE32(data + pos) > (uint32_t)(len - pos - 4)) return false;
+        argLength = 4 + ((readBE32(data + pos) + 3) & ~3);
+        break;
+      case 'T': case 'F': case 'N': case 'I':
+        argLength = 0;
+        break;
+      default:                          //arrays are not supported
+        return false;
+    }
+    if(argLength < 0 || pos + argLength > len) return false;
+    _argOffset[_nArgs++] = pos;
+    pos += argLength;
+  }
+  _types = tags;
+  return true;
+}
+
+const char* TacoOSCMessage::address(){
+  return _address;
+}
+
+int TacoOSCMessage::size(){
+  return _nArgs;
+}
+
+char TacoOSCMessage::getType(int i){
+  return (i >= 0 && i < _nArgs) ? _types[i] : 0;
+}
+
+bool TacoOSCMessage::isInt(int i){
+  return getType(i) == 'i';
+}
+
+bool TacoOSCMessage::isFloat(int i){
+  return getType(i) == 'f';
+}
+
+bool TacoOSCMessage::isString(int i){
+  return getType(i) == 's' || getType(i) == 'S';
+}
+
+bool TacoOSCMessage::isBlob(int i){
+  return getType(i) == 'b';
+}
+
+int32_t TacoOSCMessage::getInt(int i){
+  switch(getType(i)){
+    case 'i': return (int32_t)readBE32(_data + _argOffset[i]);
+    case 'h': return (int32_t)readBE64(_data + _argOffset[i]);
+    case 'f': case 'd': return (int32_t)getFloat(i);
+    case 'T': return 1;
+    default: return 0;
+  }
+}
+
+float TacoOSCMessage::getFloat(int i){
+  switch(getType(i)){
+    case 'f': {
+      uint32_t bits = readBE32(_data + _argOffset[i]);
+      float f;
+      memcpy(&f, &bits, 4);
+      return f;
+    }
+    case 'd': {
+      uint64_t bits = readBE64(_data + _argOffset[i]);
+      double d;
+      memcpy(&d, &bits, 8);
+      return (float)d;
+    }
+    case 'i': case 'h': case 'T': case 'F':
+      return (float)getInt(i);
+    default:
+      return 0;
+  }
+}
+
+const char* TacoOSCMessage::getString(int i){
+  return isString(i) ? (const char*)_data + _argOffset[i] : "";
+}
+
+const uint8_t* TacoOSCMessage::getBlob(int i, int& len){
+  if(!isBlob(i)){
+    len = 0;
+    return NULL;
+  }
+  len = readBE32(_data + _argOffset[i]);
+  return _data + _argOffset[i] + 4;
+}
+
+int64_t TacoOSCMessage::getInt64(int i){
+  switch(getType(i)){
+    case 'i': return (int32_t)readBE32(_data + _argOffset[i]);
+    case 'h': case 't': return (int64_t)readBE64(_data + _argOffset[i]);
+    default: return 0;
+  }
+}
+
+uint64_t TacoOSCMessage::getTimeTag(){
+  return _timetag;
+}
+
+int64_t TacoOSCMessage::receiveTime(){
+  return _rxTime;
+}
+
+IPAddress TacoOSCMessage::remoteIP(){
+  return _remoteIP;
+}
+
+uint16_t TacoOSCMessage::remotePort(){
+  return _remotePort;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// TRANSPORTS
+//
+/////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////
+/// UDP
+///////////////////////////////////////////////
+
+TacoUdpTransport::TacoUdpTransport(WiFiUDP& udp) : _udp(udp) {
+}
+
+bool TacoUdpTransport::beginPacket(const IPAddress& ip, uint16_t port){
+  return _udp.beginPacket(ip, port) == 1;
+}
+
+bool TacoUdpTransport::endPacket(){
+  return _udp.endPacket() == 1;
+}
+
+size_t TacoUdpTransport::write(uint8_t b){
+  return _udp.write(b);
+}
+
+size_t TacoUdpTransport::write(const uint8_t* buffer, size_t size){
+  return _udp.write(buffer, size);
+}
+
+
+///////////////////////////////////////////////
+/// SLIP serial
+///////////////////////////////////////////////
+
+void TacoSlipTransport::begin(HardwareSerial& serial, unsigned long baud){
+  _serial = &serial;
+  _serial->begin(baud);
+  if(_task == NULL){
+    //core 0 with the wifi stack, the loop runs on core 1
+    xTaskCreatePinnedToCore(writerTask, "taco_slip", 2048, this, 2, &_task, 0);
+  }
+}
+
+bool TacoSlipTransport::isStarted(){
+  return _serial != NULL;
+}
+
+bool TacoSlipTransport::beginPacket(const IPAddress& ip, uint16_t port){
+  _encoder.beginFrame();
+  return true;
+}
+
+size_t TacoSlipTransport::write(uint8_t b){
+  return _encoder.write(b);
+}
+
+bool TacoSlipTransport::endPacket(){
+  if(_serial == NULL){
+    _encoder.dropped++;
+    return false;
+  }
+  if(!_encoder.endFrame()) return false;
+  xTaskNotifyGive(_task);
+  return true;
+}
+
+unsigned long TacoSlipTransport::dropped(){
+  return _encoder.dropped;
+}
+
+//writes the ring to the uart, waiting for it here and not in the loop
+void TacoSlipTransport::writerTask(void* param){
+  TacoSlipTransport* slip = (TacoSlipTransport*)param;
+  for(;;){
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(10));
+    const uint8_t* data;
+    uint32_t n;
+    while((n = slip->_encoder.pending(data)) > 0){
+      slip->_serial->write(data, n);
+      slip->_encoder.consume(n);
+    }
+  }
+}
+
+int TacoSlipTransport::receive(const uint8_t*& packet){
+  while(_serial->available() > 0){
+    int length = _decoder.decode(_serial->read(), packet);
+    if(length > 0) return length;
+  }
+  return 0;
+}
+
+
+///////////////////////////////////////////////
+/// ESP-NOW
+///////////////////////////////////////////////
+
+TacoEspNowTransport* TacoEspNowTransport::gateway = NULL;
+
+static_assert(TACO_ESPNOW_FRAME_SIZE == ESP_NOW_MAX_DATA_LEN, "TacoEspNow.h has another frame size than esp_now.h");
+
+bool TacoEspNowTransport::init(){
+  if(_started) return true;
+  if(esp_now_init() != ESP_OK) return false;
+  _started = true;
+  return true;
+}
+
+bool TacoEspNowTransport::beginNode(const uint8_t* gatewayMac, int channel){
+  //no network, only the radio on the channel of the gateway
+  WiFi.mode(WIFI_STA);
+  WiFi.disconnect();
+  esp_wifi_set_channel(channel, WIFI_SECOND_CHAN_NONE);
+
+  if(!init()) return false;
+
+  static const uint8_t broadcast[ESP_NOW_ETH_ALEN] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+  memcpy(_peer, gatewayMac ? gatewayMac : broadcast, ESP_NOW_ETH_ALEN);
+
+  esp_now_peer_info_t peer;
+  memset(&peer, 0, sizeof(peer));
+  memcpy(peer.peer_addr, _peer, ESP_NOW_ETH_ALEN);
+  peer.channel = channel;
+  peer.ifidx = WIFI_IF_STA;
+  peer.encrypt = false;
+  if(!esp_now_is_peer_exist(_peer) && esp_now_add_peer(&peer) != ESP_OK) return false;
+
+  _gateway = false;
+  return true;
+}
+
+bool TacoEspNowTransport::beginGateway(){
+  if(!init()) return false;
+  gateway = this;
+  _gateway = true;
+  esp_now_register_recv_cb(onReceive);
+  return true;
+}
+
+bool TacoEspNowTransport::isStarted(){
+  return _started;
+}
+
+bool TacoEspNowTransport::isGateway(){
+  return _gateway;
+}
+
+bool TacoEspNowTransport::beginPacket(const IPAddress& ip, uint16_t port){
+  _frame.begin();
+  return true;
+}
+
+size_t TacoEspNowTransport::write(uint8_t b){
+  return _frame.write(b);
+}
+
+bool TacoEspNowTransport::endPacket(){
+  //esp_now_send() only queues the frame, it does not wait for the radio
+  if(!_started || _frame.isOverflow() || esp_now_send(_peer, _frame.data(), _frame.length()) != ESP_OK){
+    dropped++;
+    return false;
+  }
+  return true;
+}
+
+//called by the wifi task: copy the frame and leave
+void TacoEspNowTransport::onReceive(const uint8_t* mac, const uint8_t* data, int len){
+  TacoEspNowTransport* g = gateway;
+  if(g == NULL) return;
+  if(!g->_queue.push(data, len)) g->dropped++;
+}
+
+int TacoEspNowTransport::receive(const uint8_t*& frame){
+  return _queue.receive(frame);
+}
+
+
+TacoJsonWriter::TacoJsonWriter(char* buffer, int size){
+  _buffer = buffer;
+  _size = size;
+  if(size > 0) buffer[0] = 0;
+}
+
+void TacoJsonWriter::put(char c){
+  if(_length + 1 >= _size){
+    _overflow = true;
+    return;
+  }
+  _buffer[_length++] = c;
+  _buffer[_length] = 0;
+}
+
+//a comma if the object or array has a value already
+void TacoJsonWriter::separate(){
+  if(_afterKey){
+    _afterKey = false;
+    return;
+  }
+  if(_depth > 0 && _depth <= 16){
+    if(_hasValues & (1 << (_depth - 1))) put(',');
+    _hasValues |= 1 << (_depth - 1);
+  }
+}
+
+void TacoJsonWriter::beginObject(){
+  separate();
+  put('{');
+  _depth++;
+  if(_depth <= 16) _hasValues &= ~(1 << (_depth - 1));
+}
+
+void TacoJsonWriter::endObject(){
+  _depth--;
+  put('}');
+}
+
+void TacoJsonWriter::beginArray(){
+  separate();
+  put('[');
+  _depth++;
+  if(_depth <= 16) _hasValues &= ~(1 << (_depth - 1));
+}
+
+void TacoJsonWriter::endArray(){
+  _depth--;
+  put(']');
+}
+
+void TacoJsonWriter::key(const char* name){
+  addString(name);
+  put(':');
+  _afterKey = true;
+}
+
+void TacoJsonWriter::addString(const char* str){
+  separate();
+  put('"');
+  for(; *str; str++){
+    if(*str == '"' || *str == '\\'){
+      put('\\');
+      put(*str);
+    } else if((uint8_t)*str < 0x20){
+      char escaped[8];
+      snprintf(escaped, sizeof(escaped), "\\u%04x", *str);
+      for(char* e = escaped; *e; e++) put(*e);
+    } else {
+      put(*str);
+    }
+  }
+  put('"');
+}
+
+void TacoJsonWriter::addNumber(double v){
+  separate();
+  char number[24];
+  if(v == (int64_t)v) snprintf(number, sizeof(number), "%lld", (long long)v);
+  else snprintf(number, sizeof(number), "%g", v);
+  for(char* c = number; *c; c++) put(*c);
+}
+
+void TacoJsonWriter::addBool(bool v){
+  separate();
+  for(const char* c = v ? "true" : "false"; *c; c++) put(*c);
+}
+
+void TacoJsonWriter::addNull(){
+  separate();
+  for(const char* c = "null"; *c; c++) put(*c);
+}
+
+void TacoJsonWriter::addIP(uint32_t ip){
+  char text[16];
+  snprintf(text, sizeof(text), "%u.%u.%u.%u", ip & 0xFF, (ip >> 8) & 0xFF, (ip >> 16) & 0xFF, ip >> 24);
+  addString(text);
+}
+
+int TacoJsonWriter::length(){
+  return _length;
+}
+
+bool TacoJsonWriter::overflow(){
+  return _overflow;
+}
+
+
+TacoJsonReader::TacoJsonReader(const char* text, int length){
+  _text = text;
+  _length = length;
+}
+
+void TacoJsonReader::spaces(){
+  while(_pos < _length && (_text[_pos] == ' ' || _text[_pos] == '\t' || _text[_pos] == '\n' || _text[_pos] == '\r')) _pos++;
+}
+
+bool TacoJsonReader::expect(char c){
+  spaces();
+  if(!_ok || _pos >= _length || _text[_pos] != c) return _ok = false;
+  _pos++;
+  return true;
+}
+
+char TacoJsonReader::peek(){
+  spaces();
+  return (_ok && _pos < _length) ? _text[_pos] : 0;
+}
+
+bool TacoJsonReader::ok(){
+  return _ok;
+}
+
+bool TacoJsonReader::beginObject(){
+  if(!expect('{')) return false;
+  _depth++;
+  if(_depth > 16) return _ok = false;
+  _started &= ~(1 << (_depth - 1));
+  return true;
+}
+
+bool TacoJsonReader::nextKey(char* key, int size){
+  if(peek() == '}'){
+    _pos++;
+    _depth--;
+    return false;
+  }
+  if(_started & (1 << (_depth - 1))){
+    if(!expect(',')) return false;
+  }
+  _started |= 1 << (_depth - 1);
+  return readString(key, size) && expect(':');
+}
+
+bool TacoJsonReader::beginArray(){
+  if(!expect('[')) return false;
+  _depth++;
+  if(_depth > 16) return _ok = false;
+  _started &= ~(1 << (_depth - 1));
+  return true;
+}
+
+bool TacoJsonReader::nextItem(){
+  if(peek() == ']'){
+    _pos++;
+    _depth--;
+    return false;
+  }
+  if(_started & (1 << (_depth - 1))){
+    if(!expect(',')) return false;
+  }
+  _started |= 1 << (_depth - 1);
+  return _ok;
+}
+
+bool TacoJsonReader::readString(char* str, int size){
+  if(!expect('"')) return false;
+  int n = 0;
+  while(_pos < _length && _text[_pos] != '"'){
+    char c = _text[_pos++];
+    if(c == '\\'){
+      if(_pos >= _length) break;
+      c = _text[_pos++];
+      if(c == 'n') c = '\n';
+      else if(c == 't') c = '\t';
+      else if(c == 'r') c = '\r';
+      else if(c == 'u'){
+        //only the first 256 code points
+        int code = 0;
+        for(int i = 0; i < 4 && _pos < _length; i++){
+          char h = _text[_pos++];
+          code = code * 16 + (isdigit(h) ? h - '0' : ((tolower(h) - 'a' + 10) & 15));
+        }
+        c = code < 256 ? code : '?';
+      }
+    }
+    if(n < size - 1) str[n++] = c;
+  }
+  if(size > 0) str[n] = 0;
+  return expect('"');
+}
+
+bool TacoJsonReader::readNumber(double& v){
+  spaces();
+  if(!_ok || _pos >= _length) return _ok = false;
+  char number[32];
+  int n = 0;
+  while(_pos < _length && n < 31 && strchr("+-0123456789.eE", _text[_pos])) number[n++] = _text[_pos++];
+  number[n] = 0;
+  char* end;
+  v = strtod(number, &end);
+  if(n == 0 || *end != 0) return _ok = false;
+  return true;
+}
+
+bool TacoJsonReader::readBool(bool& v){
+  spaces();
+  if(_ok && _pos + 4 <= _length && strncmp(_text + _pos, "true", 4) == 0){
+    _pos += 4;
+    v = true;
+    return true;
+  }
+  if(_ok && _pos + 5 <= _length && strncmp(_text + _pos, "false", 5) == 0){
+    _pos += 5;
+    v = false;
+    return true;
+  }
+  return _ok = false;
+}
+
+bool TacoJsonReader::readIP(uint32_t& ip){
+  char text[16];
+  IPAddress address;
+  if(!readString(text, sizeof(text))) return false;
+  if(!address.fromString(text)) return _ok = false;
+  ip = (uint32_t)address;
+  return true;
+}
+
+bool TacoJsonReader::skip(){
+  char c = peek();
+  if(c == '{'){
+    char key[2];
+    beginObject();
+    while(nextKey(key, sizeof(key))) skip();
+  } else if(c == '['){
+    beginArray();
+    while(nextItem()) skip();
+  } else if(c == '"'){
+    char str[2];
+    readString(str, sizeof(str));
+  } else if(c == 't' || c == 'f'){
+    bool b;
+    readBool(b);
+  } else if(c == 'n' && _pos + 4 <= _length && strncmp(_text + _pos, "null", 4) == 0){
+    _pos += 4;
+  } else {
+    double v;
+    readNumber(v);
+  }
+  return _ok;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// NETWORK METHODS
+//
+/////////////////////////////////////////////////////////////////////////////////
+
+
+///////////////////////////////////////////////
+/// PRIVATE NETWORK FUNCTIONS
+///////////////////////////////////////////////
+
+// basic Access Point creation
+ void Taco::createAccessPoint(){
+
+   //register to wifi event handler to manage wifi events
+   //we try to make it in begin()
+
+    WiFi.mode(WIFI_AP);
+    Serial.print("---- APssid before creating AP: ");
+    Serial.println(APssid);
+    WiFi.softAP(APssid);
+    delay(100);  //"Wait 100 ms for AP_START..."
+
+    Serial.println("Set softAPConfig");
+    IPAddress Ip(192, 168, 0, 1);       //We fix an IP easy to recover without serial monitor
+    IPAddress NMask(255, 255, 255, 0);
+    WiFi.softAPConfig(Ip, Ip, NMask);
+
+    IPAddress myIP1 = WiFi.softAPIP();
+    Serial.print("AP IP address: ");
+    Serial.println(myIP1);
+    APconnected = true;
+
+    advertise();
+}
+
+///////////////////////////////////////////
+//wifi basic STA connection function
+///////////////////////////////////////////
+int Taco::connectToWiFi(String ssid, String pwd){
+
+  IPAddress staIP(192,168,0,129);         //Board static IP
+  IPAddress staGateway(192,168,0,1);      //Gateway IP
+  IPAddress staSubnet(255,255,255,0);     //Subnet range
+  IPAddress primaryDNS(192, 168, 0, 1);   //optional
+  IPAddress secondaryDNS(8, 8, 4, 4);     //optional
+
+  //register event handler. This allows receiving messages of connection, disconnections, etc
+/*
+  Serial.println("Registering to Wifi Events");
+  if(!registered){
+    registered = true;
+    WiFi.onEvent(WiFiEvent);
+  }
+*/
+  // delete old config if already connected
+  WiFi.disconnect(true);
+
+  //we will simply use gateway as DNS address
+  primaryDNS = staGateway;
+  secondaryDNS = staGateway;
+
+
+  Serial.print("connecting to: ");
+  Serial.println(ssid);
+
+  //connect to wifi
+  WiFi.begin(ssid.c_str(), pwd.c_str());  //I use c_str() as we have to convert strings to arrays of characters
+  //Comment below for DHCP
+  WiFi.config(staIP, staGateway, staSubnet, primaryDNS,secondaryDNS);   //fix IP at network
+
+  //while (WiFi.status() != WL_CONNECTED) { //wait until connected
+  //      delay(500);
+  //      Serial.print(".");
+  //  }
+
+  delay(1000);
+  //Some info
+  Serial.println("");
+  Serial.println("WiFi connected!");
+  Serial.print("IP address: ");
+  Serial.println(WiFi.localIP());
+  Serial.print("ESP Mac Address: ");
+  Serial.println(WiFi.macAddress());
+  Serial.print("Subnet Mask: ");
+  Serial.println(WiFi.subnetMask());
+  Serial.print("Gateway IP: ");
+  Serial.println(WiFi.gatewayIP());
+  Serial.print("DNS: ");
+  Serial.println(WiFi.dnsIP());
+
+  //setup mDNS for collecting the IPs of other machines in the network, only in STA Mode
+  discoverMDNShosts();
+
+  //here is the place to find other hosts too
+ //addHost(kike); or you make it at Arduino level with taco.addHost("KIKE-ULTRANOISE")
+
+
+  return nServices;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+///
+/// WIFI management functions
+///
+////////////////////////////////////////////////////////////////////////////////////////////
+
+
+
+/////////////////////////////////////////////////////////////
+// wifi event handler
+// These are all the messages we receive from Wifi Manager
+
+void Taco::manageWiFiEvent(WiFiEvent_t event){
+
+    Serial.printf("[WiFi-event] event: %d\n", event);
+    int result;
+
+    switch(event) {
+       case SYSTEM_EVENT_STA_GOT_IP:    //WE HAVE GOT AN IP!!
+          //When connected set
+          Serial.print("WiFi connected! IP address: ");
           result = 1;
           //resultEvent(1);
              udp.begin(WiFi.localIP(),_udpPort);
              connected = true;
              ok = true;
+             wifiLost = false;
           break;
 
-       case SYSTEM_EVENT_STA_DISCONNECTED:  //try to reconnect if disconnected
-          //Serial.println("WiFi lost connection");
-          Serial.println("Disconnected from WiFi access point");
-          connected = false;
+       case SYSTEM_EVENT_STA_DISCONNECTED:  //try to reconnect if disconnected
+          //Serial.println("WiFi lost connection");
+          Serial.println("Disconnected from WiFi access point");
+          connected = false;
+          ok = false;
+
+          //the wifi job reconnects, without blocking the events or the loop
+          if(!wifiLost){
+            wifiRetryWait = TACO_WIFI_RETRY_MIN;
+            wifiRetryTime = millis();
+            wifiLost = true;
+          }
+          break;
+
+        case SYSTEM_EVENT_WIFI_READY:
+            Serial.println("WiFi interface ready");
+            break;
+        case SYSTEM_EVENT_SCAN_DONE:
+            Serial.println("Completed scan for access points");
+            break;
+        case SYSTEM_EVENT_STA_START:
+            Serial.println("WiFi client started");
+            break;
+        case SYSTEM_EVENT_STA_STOP:
+            Serial.println("WiFi clients stopped");
+            break;
+        case SYSTEM_EVENT_STA_CONNECTED:
+            Serial.println("Connected to STA");
+            break;
+        case SYSTEM_EVENT_STA_AUTHMODE_CHANGE:
+            Serial.println("Authentication mode of access point has changed");
+            break;
+        case SYSTEM_EVENT_STA_LOST_IP:
+            Serial.println("Lost IP address and IP address is reset to 0");
+            break;
+        case SYSTEM_EVENT_STA_WPS_ER_SUCCESS:
+            Serial.println("WiFi Protected Setup (WPS): succeeded in enrollee mode");
+            break;
+        case SYSTEM_EVENT_STA_WPS_ER_FAILED:
+            Serial.println("WiFi Protected Setup (WPS): failed in enrollee mode");
+            break;
+        case SYSTEM_EVENT_STA_WPS_ER_TIMEOUT:
+            Serial.println("WiFi Protected Setup (WPS): timeout in enrollee mode");
+            break;
+        case SYSTEM_EVENT_STA_WPS_ER_PIN:
+            Serial.println("WiFi Protected Setup (WPS): pin code in enrollee mode");
+            break;
+        case SYSTEM_EVENT_AP_START:
+            Serial.println("WiFi access point started");
+            udp.begin(_udpPort);  //listen to the clients too
+            APconnected = true;
+            connected = true;
+            updateStations();
+
+            break;
+        case SYSTEM_EVENT_AP_STOP:
+            Serial.println("WiFi access point  stopped");
+            break;
+        case SYSTEM_EVENT_AP_STACONNECTED:
+            Serial.println("Client connected");
+            connected = true;
+
+            break;
+        case SYSTEM_EVENT_AP_STADISCONNECTED:
+            Serial.println("Client disconnected");
+            updateStations();
+            break;
+        case SYSTEM_EVENT_AP_STAIPASSIGNED:
+            Serial.println("Assigned IP address to client");
+            updateStations();
+            connected = true;
+            break;
+        case SYSTEM_EVENT_AP_PROBEREQRECVED:
+            Serial.println("Received probe request");
+            break;
+        case SYSTEM_EVENT_GOT_IP6:
+            Serial.println("IPv6 is preferred");
+            break;
+        case SYSTEM_EVENT_ETH_START:
+            Serial.println("Ethernet started");
+            break;
+        case SYSTEM_EVENT_ETH_STOP:
+            Serial.println("Ethernet stopped");
+            break;
+        case SYSTEM_EVENT_ETH_CONNECTED:
+            Serial.println("Ethernet connected");
+            break;
+        case SYSTEM_EVENT_ETH_DISCONNECTED:
+            Serial.println("Ethernet disconnected");
+            break;
+        case SYSTEM_EVENT_ETH_GOT_IP:
+            Serial.println("Obtained IP address");
+        break;
+    }
+
+}
+
+
+///////////////////////////////////////////////////////////////////////
+// Handling information about connected clients in access point mode
+// For sending OSC data to clients we need to know their IPs and this
+// function makes the work.
+void Taco::updateStations() {
+
+  wifi_sta_list_t stationList;
+  esp_wifi_ap_get_sta_list(&stationList);
+
+  //the clients go to the loop, which rebuilds the destinations (updateClients())
+  IPAddress stations[10];
+  int nStations = 0;
+
+  Serial.println("-----------------");
+  Serial.print("Number of connected stations: ");
+  Serial.println(stationList.num);
+  Serial.println("-----------------");
+  if(oled) {
+    oledLock();
+    display.fillRect(120, 0, 25, 10, SSD1306_BLACK);
+    oledUnlock();
+    SSD1306_writeInt(120, 0, stationList.num);
+  }
+
+
+  //Now obtain their Mac addresses and IP addresses
+  tcpip_adapter_sta_list_t adapter_sta_list;
+  memset(&adapter_sta_list, 0, sizeof(adapter_sta_list));
+
+  ESP_ERROR_CHECK(tcpip_adapter_get_sta_list(&stationList, &adapter_sta_list));
+
+  //we have to convert station information to IPAdress type of arduino
+  for(int i = 0; i < adapter_sta_list.num; i++) {
+    tcpip_adapter_sta_info_t station = adapter_sta_list.sta[i];
+    printf("%d - mac: %.2x:%.2x:%.2x:%.2x:%.2x:%.2x - IP: %s\n", i + 1,
+    station.mac[0], station.mac[1], station.mac[2],
+    station.mac[3], station.mac[4], station.mac[5],
+    ip4addr_ntoa(&(station.ip)));
+
+    String ipi = ip4addr_ntoa(&(station.ip));
+    String strIP = ipi;
+
+    int Parts[4] = {0,0,0,0};
+    int Part = 0;
+    for ( int i=0; i<strIP.length(); i++ ) {
+      char c = strIP[i];
+      if ( c == '.' ) {
+        Part++;
+        continue;
+      }
+      Parts[Part] *= 10;
+      Parts[Part] += c - '0';
+    }
+
+    //finally this is the array of clients ip addresses
+    IPAddress ipo( Parts[0], Parts[1], Parts[2], Parts[3] );
+    if(nStations < 10) stations[nStations++] = ipo;
+
+  }
+
+  //this runs in the wifi event task, the loop could be sending to dests[]
+  portENTER_CRITICAL(&stationsMux);
+  for(int i = 0; i < nStations; i++) stationsShared[i] = (uint32_t)stations[i];
+  nStationsShared = nStations;
+  stationsChanged = true;
+  portEXIT_CRITICAL(&stationsMux);
+
+}
+
+//update(): the clients of our access point go to the destinations
+void Taco::updateClients(){
+  if(!stationsChanged) return;
+  portENTER_CRITICAL(&stationsMux);
+  for(int i = 0; i < nStationsShared; i++) clientsAddress[i] = IPAddress(stationsShared[i]);
+  numClients = nStationsShared;
+  stationsChanged = false;
+  portEXIT_CRITICAL(&stationsMux);
+
+  updateDestinations();
+}
+
+
+/////////////////////////////////////////////////////////////
+//   //setup mDNS for collecting the IPs of other machines in the network,
+///only in STA Mode
+////////////////////////////////////////////////////////////////////
+
+void Taco::discoverMDNShosts(){
+
+  Serial.println("discovering hosts");
+
+  if(accesspoint == false || user_STA){
+    delay(2000);
+    advertise();
+
+    //the OSC listeners are looked for in the background
+    if(discoveryTaskHandle == NULL){
+      xTaskCreatePinnedToCore(discoveryTask, "taco_mdns", 4096, this, tskIDLE_PRIORITY, &discoveryTaskHandle, 0);
+    }
+  }
+}
+
+bool Taco::addDiscoveryService(const char* service, const char* proto){
+  if(nDiscovery >= TACO_MAX_DISCOVERY) return false;
+  strlcpy(discovery[nDiscovery].service, service, sizeof(discovery[0].service));
+  strlcpy(discovery[nDiscovery].proto, proto, sizeof(discovery[0].proto));
+  nDiscovery++;
+  return true;
+}
+
+//the discovery task asks for the services every TACO_MDNS_INTERVAL ms
+void Taco::discoveryTask(void* param){
+  Taco* taco = (Taco*)param;
+  TacoAlloc::setTask(TACO_SUB_DISCOVERY);
+  for(;;){
+    taco->discover();
+    vTaskDelay(pdMS_TO_TICKS(TACO_MDNS_INTERVAL));
+  }
+}
+
+// One round of discovery: the hosts answering any of the services are merged
+// by IP. Other Taco boards (they advertise a subscribe record) are not hosts.
+// A host is forgotten after TACO_MDNS_MISSES rounds without answering.
+void Taco::discover(){
+  TACO_TRACE_SCOPE("discover");
+  bool changed = false;
+  uint32_t self = (uint32_t)WiFi.localIP();
+  for(int i = 0; i < nFound; i++) found[i].misses++;
+
+  for(int s = 0; s < nDiscovery; s++){
+    int n = MDNS.queryService(discovery[s].service, discovery[s].proto);
+    for(int i = 0; i < n; i++){
+      uint32_t ip = (uint32_t)MDNS.IP(i);
+      if(ip == 0 || ip == self || MDNS.hasTxt(i, "subscribe")) continue;
+
+      int j = 0;
+      while(j < nFound && found[j].ip != ip) j++;
+      if(j == nFound){
+        if(nFound >= TACO_MAX_FOUND) continue;
+        nFound++;
+        found[j].ip = ip;
+        found[j].port = 0;
+        found[j].misses = 0;
+        strlcpy(found[j].name, MDNS.hostname(i).c_str(), sizeof(found[j].name));
+        changed = true;
+        Serial.printf("Found %s (%s:%d)\n", found[j].name, IPAddress(ip).toString().c_str(), MDNS.port(i));
+      }
+      //the port of the OSC service, the first one in the list
+      if(s == 0 && found[j].port != MDNS.port(i)){
+        found[j].port = MDNS.port(i);
+        changed = true;
+      }
+      found[j].misses = 0;
+    }
+  }
+
+  for(int i = 0; i < nFound; i++){
+    if(found[i].misses >= TACO_MDNS_MISSES){
+      found[i--] = found[--nFound];
+      changed = true;
+    }
+  }
+
+  //the loop takes them between two frames
+  if(changed){
+    portENTER_CRITICAL(&foundMux);
+    memcpy(foundShared, found, sizeof(found));
+    nFoundShared = nFound;
+    foundChanged = true;
+    portEXIT_CRITICAL(&foundMux);
+  }
+}
+
+//update(): the hosts of the last round of discovery go to the destinations
+void Taco::updateDiscovery(){
+  TacoAllocScope scope(TACO_SUB_DISCOVERY);
+  if(!foundChanged) return;
+  portENTER_CRITICAL(&foundMux);
+  memcpy(mdnsHosts, foundShared, sizeof(mdnsHosts));
+  nMdnsHosts = nFoundShared;
+  foundChanged = false;
+  portEXIT_CRITICAL(&foundMux);
+
+  nServices = nMdnsHosts;
+  updateDestinations();
+}
+
+void Taco::addHost(String host_name){
+  /// NEW STUFF
+  Serial.println("Browsing for host");
+  IPAddress serverIp = MDNS.queryHost(host_name);
+  while (serverIp.toString() == "0.0.0.0") {
+    Serial.println("Trying again to resolve mDNS");
+    delay(250);
+    serverIp = MDNS.queryHost(host_name);
+  }
+  Serial.print("IP address of server: ");
+  Serial.println(serverIp.toString());
+  Serial.println("Done finding the host...");
+  addHost(serverIp);
+  //return serverIp.toString();
+
+}
+
+void Taco::addHost(IPAddress ip){
+  TacoConfig& c = editConfig();
+  for(int i = 0; i < c.nHosts; i++){
+    if(c.hosts[i] == (uint32_t)ip) return;    //already there
+  }
+  if(c.nHosts < TACO_MAX_HOSTS){
+    c.hosts[c.nHosts] = (uint32_t)ip;
+    c.nHosts = c.nHosts + 1;
+  }
+  applyConfig();
+}
+
+/////////////////////////////////////////////////////////////
+//   advertise this board as an _osc._udp service, with a name of its own
+////////////////////////////////////////////////////////////////////
+
+// <APssid>-<end of the MAC>, so boards with the same APssid are told apart
+void Taco::advertise(){
+  if(mdnsStarted) return;
+
+  uint8_t mac[6];
+  WiFi.macAddress(mac);
+  int n = 0;
+  for(const char* c = APssid ? APssid : "taco"; *c && n < 24; c++){
+    if(isalnum(*c)) mdnsName[n++] = tolower(*c);
+    else if(n > 0 && mdnsName[n - 1] != '-') mdnsName[n++] = '-';
+  }
+  if(n == 0 || mdnsName[n - 1] != '-') mdnsName[n++] = '-';
+  snprintf(mdnsName + n, sizeof(mdnsName) - n, "%02x%02x%02x", mac[3], mac[4], mac[5]);
+
+  if(!MDNS.begin(mdnsName)){
+    Serial.println("Error setting up MDNS responder!");
+    return;
+  }
+  MDNS.setInstanceName(mdnsName);
+  MDNS.addService("osc", "udp", _udpPort);
+  if(webServer || webStarted) MDNS.addService("http", "tcp", 80);
+  mdnsStarted = true;
+  mdnsTxt();
+
+  Serial.printf("Advertised as %s.local, _osc._udp port %d\n", mdnsName, _udpPort);
+}
+
+//add a word to a text record if it fits
+static int appendWord(char* text, int n, const char* word){
+  int length = strlen(word);
+  if(n + length + 2 > TACO_MDNS_TXT_LEN) return n;
+  if(n > 0) text[n++] = ' ';
+  memcpy(text + n, word, length + 1);
+  return n + length;
+}
+
+const char* Taco::boardName(){
+  return mdnsName;
+}
+
+// The text records tell the hosts what the board sends, so they can
+// subscribe without asking. They are kept short: one answer per board.
+void Taco::mdnsTxt(){
+  mdnsTxtDirty = false;
+  if(!mdnsStarted) return;
+
+  char text[TACO_MDNS_TXT_LEN];
+  char number[16];   //"%g" of a double: 13 characters at most
+  int n;
+
+  MDNS.addServiceTxt("osc", "udp", "name", mdnsName);
+
+  n = 0;
+  text[0] = 0;
+  for(int i = 0; i < conf.nAnalog && n < TACO_MDNS_TXT_LEN - 4; i++) n += snprintf(text + n, TACO_MDNS_TXT_LEN - n, i ? ",%d" : "%d", conf.analogPins[i]);
+  MDNS.addServiceTxt("osc", "udp", "analog", text);
+
+  n = 0;
+  text[0] = 0;
+  for(int i = 0; i < conf.nDigital && n < TACO_MDNS_TXT_LEN - 4; i++) n += snprintf(text + n, TACO_MDNS_TXT_LEN - n, i ? ",%d" : "%d", conf.digitalPins[i]);
+  MDNS.addServiceTxt("osc", "udp", "digital", text);
+
+  snprintf(number, sizeof(number), "%g", conf.samplePeriod ? 1000000.0 / conf.samplePeriod : 0.0);
+  MDNS.addServiceTxt("osc", "udp", "rate", number);
+
+  //the addresses of the sensors, IMU and streams
+  n = 0;
+  text[0] = 0;
+  for(int i = 0; i < nSensors; i++) n = appendWord(text, n, sensors[i]->oscAddress);
+  if(imu) n = appendWord(text, n, imu->oscAddress);
+  for(int i = 0; i < nStreams; i++) n = appendWord(text, n, streams[i]->oscAddress);
+  MDNS.addServiceTxt("osc", "udp", "streams", text);
+
+  const char* headers[] = {"none", "args", "bundle"};
+  MDNS.addServiceTxt("osc", "udp", "header", headers[conf.frameHeader % 3]);
+  MDNS.addServiceTxt("osc", "udp", "subscribe", "/taco/config/subscribe");
+}
+
+/////////////////////////////////////////////////////////
+///
+/// EEPROM
+/////////////////////////////////////////////////////////
+
+//Configuration Settings loaded from eeprom
+void Taco::confSettings(){
+  Serial.println();
+  Serial.println("* Reading EEPROM:");
+
+  String d;
+  int address;
+
+  // the first byte is a flag (0 or 1) informing about wifi modes
+  address = 0;
+  d = read_String(address);
+  Serial.print("- AccesPoint flag (0= AP, 1=STA):");
+  Serial.println(d);
+  if(d.toInt()==0){
+    accesspoint = true;
+  } else {
+    accesspoint = false;
+  }
+
+  address = 2; //we know the flag is always 2 bytes long
+  d = read_String(2);
+  //Serial.print("- SSID Length:");
+  //Serial.println(d);
+
+  d = read_String(20);  //reading ssid, address (20) is arbitrary, the following are too.
+  Serial.print("- SSID:");
+  Serial.println(d);
+  network = d;
+
+  d = read_String(86);
+  Serial.print("- Password:");
+  Serial.println(d);
+  password = d;
+
+  d = read_String(130);
+  Serial.print("- Access Point Name: ");
+  Serial.println(d);
+  APssid_read_from_eeprom = d.c_str();
+
+  /*
+  d = read_String(170);
+  Serial.print("- ip at new network:");
+  Serial.println(d);
+  if(!accesspoint ) staIP = string2IP(d);
+  */
+
+  d = read_String(200);
+  Serial.print("- OSC port:");
+  Serial.println(d);
+  if(!accesspoint ) _udpPort = d.toInt();  //cause it can be empty at the beginning
+
+  /*
+  d = read_String(216);
+  Serial.print("- Gateway ip:");
+  Serial.println(d);
+  if(!accesspoint ) staGateway = string2IP(d);
+  */
+
+}
+
+
+
+/////////////////////////////////////////////////////////
+///
+/// RUNTIME CONFIGURATION
+/////////////////////////////////////////////////////////
+
+static uint32_t periodFromRate(float hz){
+  return (hz > 0) ? 1000000.0 / hz : 0;
+}
+
+static void setFallback(TacoConfig& c, uint32_t ip, bool fallback){
+  for(int i = 0; i < c.nFallback; i++){
+    if(c.fallback[i] == ip){
+      if(!fallback) c.fallback[i] = c.fallback[--c.nFallback];
+      return;
+    }
+  }
+  if(fallback && c.nFallback < TACO_MAX_HOSTS) c.fallback[c.nFallback++] = ip;
+}
+
+static void setDeadbands(TacoConfig& c, int index, int value){
+  for(int i = 0; i < TACO_MAX_PINS; i++){
+    if(index < 0 || index == i) c.deadband[i] = constrain(value, 0, 4095);
+  }
+}
+
+//add a host, if it is not there
+static void addHostTo(TacoConfig& c, uint32_t ip){
+  for(int i = 0; i < c.nHosts; i++){
+    if(c.hosts[i] == ip) return;
+  }
+  if(c.nHosts < TACO_MAX_HOSTS) c.hosts[c.nHosts++] = ip;
+}
+
+static bool setSubscription(TacoConfig& c, uint32_t ip, uint16_t port, const char* filter, float maxRate, int decimation){
+  int i = 0;
+  while(i < c.nSubs && c.subs[i].ip != ip) i++;
+  if(i == TACO_MAX_HOSTS) return false;
+  if(i == c.nSubs) c.nSubs++;
+
+  TacoSubscription& sub = c.subs[i];
+  sub.ip = ip;
+  sub.port = port;
+  sub.maxRate = constrain((int)maxRate, 0, 65535);
+  sub.decimation = constrain(decimation, 1, 255);
+  strncpy(sub.filter, filter, TACO_FILTER_LEN - 1);
+  sub.filter[TACO_FILTER_LEN - 1] = 0;
+  return true;
+}
+
+static void removeSubscription(TacoConfig& c, uint32_t ip){
+  for(int i = 0; i < c.nSubs; i++){
+    if(c.subs[i].ip == ip){
+      c.subs[i] = c.subs[--c.nSubs];
+      return;
+    }
+  }
+}
+
+//is the address in the filter? Every word of the filter includes the addresses under it
+static bool filterMatches(const char* filter, const char* address){
+  if(filter[0] == 0) return true;   //no filter: everything
+  while(*filter){
+    while(*filter == ' ') filter++;
+    int len = 0;
+    while(filter[len] && filter[len] != ' ') len++;
+    if(len > 0 && strncmp(address, filter, len) == 0 && (address[len] == 0 || address[len] == '/' || filter[len - 1] == '/')) return true;
+    filter += len;
+  }
+  return false;
+}
+
+// Every address sent gets a bit, so a destination only needs a mask check
+// per message. Addresses after the table is full share TACO_ADDRESS_OTHER,
+// which only the destinations without filter get.
+int Taco::addressIndex(const char* address){
+  uint32_t h = segmentHash(address, strlen(address));
+  for(int i = 0; i < nAddresses; i++){
+    //the hash only to skip the names quickly, two addresses can share it
+    if(addrHashes[i] == h && strncmp(addrNames[i], address, TACO_ROUTE_MAX_LEN - 1) == 0) return i;
+  }
+  if(nAddresses >= TACO_ADDRESS_OTHER) return TACO_ADDRESS_OTHER;
+
+  int i = nAddresses++;
+  addrHashes[i] = h;
+  strncpy(addrNames[i], address, TACO_ROUTE_MAX_LEN - 1);
+  addrNames[i][TACO_ROUTE_MAX_LEN - 1] = 0;
+  addrCount[i] = 0;
+
+  //the destinations that want it
+  for(int j = 0; j < nDests; j++){
+    if(dests[j].sub < 0 || filterMatches(conf.subs[dests[j].sub].filter, addrNames[i])) dests[j].mask |= 1UL << i;
+    else dests[j].mask &= ~(1UL << i);
+  }
+  return i;
+}
+
+uint32_t Taco::filterMask(const char* filter){
+  if(filter[0] == 0) return 0xFFFFFFFF;
+  uint32_t mask = 0;
+  for(int i = 0; i < nAddresses; i++){
+    if(filterMatches(filter, addrNames[i])) mask |= 1UL << i;
+  }
+  return mask;
+}
+
+bool Taco::subscribe(IPAddress host, uint16_t port, const char* filter, float maxRate, int decimation){
+  TacoConfig& c = editConfig();
+  if(!setSubscription(c, (uint32_t)host, port, filter, maxRate, decimation)) return false;
+  addHostTo(c, (uint32_t)host);
+  applyConfig();
+  return true;
+}
+
+void Taco::unsubscribe(IPAddress host){
+  removeSubscription(editConfig(), (uint32_t)host);
+  applyConfig();
+}
+
+//a pin we can read: a GPIO for the digital pins, a pin of an ADC for the analog ones
+static bool pinIsValid(double pin, bool analog){
+  if(pin < 0 || pin >= 256 || pin != (int)pin || !digitalPinIsValid((int)pin)) return false;
+  return !analog || digitalPinToAnalogChannel((int)pin) >= 0;
+}
+
+//copy the int arguments of a message into a list of pins, returns the number of
+//pins, or -1 without copying anything if one of them can not be read
+static int pinsFromMessage(uint8_t* pins, TacoOSCMessage& msg, bool analog){
+  int n = min(msg.size(), TACO_MAX_PINS);
+  for(int i = 0; i < n; i++){
+    if(!pinIsValid(msg.getInt(i), analog)) return -1;
+  }
+  for(int i = 0; i < n; i++){
+    pins[i] = msg.getInt(i);
+  }
+  return n;
+}
+
+
+//changes are made on a copy of the configuration that is applied between frames
+TacoConfig& Taco::editConfig(){
+  if(!confChanged){
+    pendingConf = conf;
+    confChanged = true;
+  }
+  return pendingConf;
+}
+
+void Taco::applyConfig(){
+  TACO_TRACE_SCOPE("applyConfig");
+  TacoAllocScope scope(TACO_SUB_CONFIG);
+  if(!confChanged) return;
+  confChanged = false;
+
+  //forget the values of pins that changed, so the next frame reads them as new
+  for(int i = 0; i < TACO_MAX_PINS; i++){
+    if(i >= pendingConf.nDigital || pendingConf.digitalPins[i] != conf.digitalPins[i]) d_values[i] = -1;
+    if(i >= pendingConf.nAnalog || pendingConf.analogPins[i] != conf.analogPins[i]) a_values[i] = -1;
+  }
+
+  bool newPort = pendingConf.udpPort != 0 && pendingConf.udpPort != _udpPort;
+  conf = pendingConf;
+
+  //the serial and ESP-NOW transports need to be started first
+  if(conf.transport == TACO_TRANSPORT_SERIAL && slipTransport.isStarted()){
+    transport = &slipTransport;
+  } else if(conf.transport == TACO_TRANSPORT_ESPNOW && espNowTransport.isStarted() && !espNowTransport.isGateway()){
+    transport = &espNowTransport;
+  } else {
+    transport = &udpTransport;
+  }
+
+  updateDestinations();   //hosts or fallbacks could have changed
+  mdnsTxtDirty = true;    //pins or rate could have changed
+
+  if(newPort){
+    _udpPort = conf.udpPort;
+    Serial.printf("OSC port changed to %d\n", _udpPort);
+    if(mdnsStarted) mdns_service_port_set("_osc", "_udp", _udpPort);
+    if(connected || APconnected){
+      udp.stop();
+      if(accesspoint){
+        udp.begin(_udpPort);
+      } else {
+        udp.begin(WiFi.localIP(), _udpPort);
+      }
+    }
+  }
+
+  if(confSaveRequested){
+    confSaveRequested = false;
+    saveConfig();
+  }
+}
+
+//Runtime configuration saved in eeprom, after the network settings
+void Taco::loadConfig(){
+  TacoConfig saved;
+  EEPROM.get(EEPROM_CONF_ADDRESS, saved);
+
+  if(saved.magic == TACO_CONF_MAGIC){
+    Serial.println("- Saved runtime configuration loaded");
+    saved.nDigital = min((int)saved.nDigital, TACO_MAX_PINS);
+    saved.nAnalog = min((int)saved.nAnalog, TACO_MAX_PINS);
+    saved.nHosts = min((int)saved.nHosts, TACO_MAX_HOSTS);
+    saved.nFallback = min((int)saved.nFallback, TACO_MAX_HOSTS);
+    saved.nSubs = min((int)saved.nSubs, TACO_MAX_HOSTS);
+    if(saved.udpPort != 0) _udpPort = saved.udpPort;
+    editConfig() = saved;
+  } else {
+    Serial.println("- No saved runtime configuration");
+  }
+
+  editConfig().udpPort = _udpPort;
+  applyConfig();
+}
+
+void Taco::saveConfig(){
+  EEPROM.put(EEPROM_CONF_ADDRESS, confChanged ? pendingConf : conf);
+  EEPROM.commit();
+  Serial.println("Runtime configuration saved");
+}
+
+void Taco::resetConfig(){
+  EEPROM.put(EEPROM_CONF_ADDRESS, (uint32_t)0);   //no magic, no configuration
+  EEPROM.commit();
+  Serial.println("Saved runtime configuration cleared");
+}
+
+void Taco::setUnicastFallback(IPAddress ip, bool fallback){
+  TacoConfig& c = editConfig();
+  setFallback(c, (uint32_t)ip, fallback);
+  applyConfig();
+}
+
+//The hosts change the configuration with /taco/config/... messages
+void Taco::configRoutes(){
+
+  route("/taco/config/rate", [this](TacoOSCMessage& msg){
+    editConfig().samplePeriod = periodFromRate(msg.getFloat(0));
+  });
+
+  route("/taco/config/deadband", [this](TacoOSCMessage& msg){
+    if(msg.size() > 1){
+      setDeadbands(editConfig(), msg.getInt(0), msg.getInt(1));
+    } else {
+      setDeadbands(editConfig(), -1, msg.getInt(0));
+    }
+  });
+
+  route("/taco/config/digital_mask", [this](TacoOSCMessage& msg){
+    editConfig().digitalMask = msg.getInt(0);
+  });
+
+  route("/taco/config/analog_mask", [this](TacoOSCMessage& msg){
+    editConfig().analogMask = msg.getInt(0);
+  });
+
+  route("/taco/config/digital_pins", [this](TacoOSCMessage& msg){
+    uint8_t pins[TACO_MAX_PINS];
+    int n = pinsFromMessage(pins, msg, false);
+    if(n < 0) return;     //nothing changes
+    TacoConfig& c = editConfig();
+    memcpy(c.digitalPins, pins, n);
+    c.nDigital = n;
+  });
+
+  route("/taco/config/analog_pins", [this](TacoOSCMessage& msg){
+    uint8_t pins[TACO_MAX_PINS];
+    int n = pinsFromMessage(pins, msg, true);
+    if(n < 0) return;
+    TacoConfig& c = editConfig();
+    memcpy(c.analogPins, pins, n);
+    c.nAnalog = n;
+  });
+
+  route("/taco/config/port", [this](TacoOSCMessage& msg){
+    int port = msg.getInt(0);
+    if(port > 0 && port < 65536) editConfig().udpPort = port;
+  });
+
+  route("/taco/config/host/add", [this](TacoOSCMessage& msg){
+    IPAddress ip;
+    if(!ip.fromString(msg.getString(0))) return;
+    TacoConfig& c = editConfig();
+    for(int i = 0; i < c.nHosts; i++){
+      if(c.hosts[i] == (uint32_t)ip) return;    //already there
+    }
+    if(c.nHosts < TACO_MAX_HOSTS) c.hosts[c.nHosts++] = (uint32_t)ip;
+  });
+
+  route("/taco/config/host/remove", [this](TacoOSCMessage& msg){
+    IPAddress ip;
+    if(!ip.fromString(msg.getString(0))) return;
+    TacoConfig& c = editConfig();
+    for(int i = 0; i < c.nHosts; i++){
+      if(c.hosts[i] == (uint32_t)ip){
+        c.hosts[i] = c.hosts[--c.nHosts];
+        return;
+      }
+    }
+  });
+
+  route("/taco/config/host/clear", [this](TacoOSCMessage& msg){
+    editConfig().nHosts = 0;
+  });
+
+  route("/taco/config/send_mode", [this](TacoOSCMessage& msg){
+    const char* mode = msg.getString(0);
+    TacoConfig& c = editConfig();
+    if(strcmp(mode, "unicast") == 0){
+      c.sendMode = TACO_SEND_UNICAST;
+    } else if(strcmp(mode, "broadcast") == 0){
+      c.sendMode = TACO_SEND_BROADCAST;
+    } else if(strcmp(mode, "multicast") == 0){
+      IPAddress group;
+      if(msg.size() > 1 && group.fromString(msg.getString(1))) c.group = (uint32_t)group;
+      if(c.group != 0) c.sendMode = TACO_SEND_MULTICAST;
+    }
+  });
+
+  route("/taco/config/header", [this](TacoOSCMessage& msg){
+    const char* header = msg.getString(0);
+    if(strcmp(header, "none") == 0) editConfig().frameHeader = TACO_HEADER_NONE;
+    if(strcmp(header, "args") == 0) editConfig().frameHeader = TACO_HEADER_ARGS;
+    if(strcmp(header, "bundle") == 0) editConfig().frameHeader = TACO_HEADER_BUNDLE;
+  });
+
+  route("/taco/config/transport", [this](TacoOSCMessage& msg){
+    const char* type = msg.getString(0);
+    if(strcmp(type, "udp") == 0) editConfig().transport = TACO_TRANSPORT_UDP;
+    if(strcmp(type, "serial") == 0) editConfig().transport = TACO_TRANSPORT_SERIAL;
+    if(strcmp(type, "espnow") == 0) editConfig().transport = TACO_TRANSPORT_ESPNOW;
+  });
+
+  //a host asks for its port, filter, rate and decimation
+  route("/taco/config/subscribe", [this](TacoOSCMessage& msg){
+    uint32_t ip = (uint32_t)msg.remoteIP();
+    if(ip == 0) return;
+    TacoConfig& c = editConfig();
+    if(setSubscription(c, ip, msg.getInt(0), msg.getString(1), msg.getFloat(2), msg.size() > 3 ? msg.getInt(3) : 1)){
+      addHostTo(c, ip);
+    }
+  });
+
+  route("/taco/config/unsubscribe", [this](TacoOSCMessage& msg){
+    removeSubscription(editConfig(), (uint32_t)msg.remoteIP());
+  });
+
+  //a host that can not join the group asks for its own copy of the packets
+  route("/taco/config/fallback", [this](TacoOSCMessage& msg){
+    setFallback(editConfig(), (uint32_t)msg.remoteIP(), msg.getInt(0) != 0);
+  });
+
+  route("/taco/config/save", [this](TacoOSCMessage& msg){
+    editConfig();
+    confSaveRequested = true;   //saved after being applied
+  });
+
+  route("/taco/config/reset", [this](TacoOSCMessage& msg){
+    resetConfig();
+  });
+
+  route("/taco/stats/get", [this](TacoOSCMessage& msg){
+    TacoMemoryStats mem;
+    memoryStats(mem);
+    OSCMessage reply("/taco/stats/state");
+    reply.add((int32_t)mem.freeHeap);
+    reply.add((int32_t)mem.largestBlock);
+    reply.add((int32_t)mem.minFreeHeap);
+    reply.add((int32_t)mem.freeBlocks);
+    reply.add((int32_t)mem.frames);
+    sendReply(reply, msg);
+  });
+
+  route("/taco/config/get", [this](TacoOSCMessage& msg){
+    OSCMessage reply("/taco/config/state");
+    reply.add(conf.samplePeriod ? 1000000.0f / conf.samplePeriod : 0.0f);
+    reply.add((int32_t)_udpPort);
+    reply.add((int32_t)conf.nDigital);
+    reply.add((int32_t)conf.nAnalog);
+    reply.add((int32_t)conf.nHosts);
+    sendReply(reply, msg);
+  });
+}
+
+static const char* sendModeNames[] = {"unicast", "broadcast", "multicast"};
+static const char* transportNames[] = {"udp", "serial", "espnow"};
+static const char* headerNames[] = {"none", "args", "bundle"};
+
+static int nameIndex(const char* const* names, int n, const char* name){
+  for(int i = 0; i < n; i++){
+    if(strcmp(names[i], name) == 0) return i;
+  }
+  return -1;
+}
+
+static void pinsToJson(TacoJsonWriter& j, const uint8_t* pins, int n){
+  j.beginArray();
+  for(int i = 0; i < n; i++) j.addNumber(pins[i]);
+  j.endArray();
+}
+
+static void ipsToJson(TacoJsonWriter& j, const uint32_t* ips, int n){
+  j.beginArray();
+  for(int i = 0; i < n; i++) j.addIP(ips[i]);
+  j.endArray();
+}
+
+//false if the array is wrong or has a pin that can not be read
+static bool pinsFromJson(TacoJsonReader& j, uint8_t* pins, uint8_t& n, bool analog){
+  n = 0;
+  if(!j.beginArray()) return false;
+  double v;
+  bool valid = true;
+  while(j.nextItem() && j.readNumber(v)){
+    if(!pinIsValid(v, analog)) valid = false;
+    else if(n < TACO_MAX_PINS) pins[n++] = v;
+  }
+  return j.ok() && valid;
+}
+
+static bool ipsFromJson(TacoJsonReader& j, uint32_t* ips, uint8_t& n){
+  n = 0;
+  if(!j.beginArray()) return false;
+  uint32_t ip;
+  while(j.nextItem() && j.readIP(ip)){
+    if(n < TACO_MAX_HOSTS) ips[n++] = ip;
+  }
+  return j.ok();
+}
+
+// The whole configuration as the JSON of /api/config
+int Taco::configToJson(char* buffer, int size){
+  TacoConfig c = conf;    //the loop could apply a new one meanwhile
+  TacoJsonWriter j(buffer, size);
+  j.beginObject();
+
+  j.key("network");
+  j.beginObject();
+  j.key("mode");
+  j.addString(accesspoint ? "ap" : "sta");
+  j.key("name");
+  j.addString(APssid ? APssid : "");
+  j.key("ssid");
+  j.addString(accesspoint ? "" : network.c_str());
+  j.key("ip");
+  j.addIP(accesspoint ? (uint32_t)WiFi.softAPIP() : (uint32_t)WiFi.localIP());
+  j.endObject();
+
+  j.key("port");
+  j.addNumber(_udpPort);
+  j.key("sample_rate");
+  j.addNumber(c.samplePeriod ? 1000000.0 / c.samplePeriod : 0);
+  j.key("digital_pins");
+  pinsToJson(j, c.digitalPins, c.nDigital);
+  j.key("analog_pins");
+  pinsToJson(j, c.analogPins, c.nAnalog);
+  j.key("digital_mask");
+  j.addNumber(c.digitalMask);
+  j.key("analog_mask");
+  j.addNumber(c.analogMask);
+  j.key("deadband");
+  j.beginArray();
+  for(int i = 0; i < c.nAnalog; i++) j.addNumber(c.deadband[i]);
+  j.endArray();
+
+  j.key("hosts");
+  ipsToJson(j, c.hosts, c.nHosts);
+  j.key("send_mode");
+  j.addString(sendModeNames[c.sendMode % 3]);
+  j.key("group");
+  j.addIP(c.group);
+  j.key("fallback");
+  ipsToJson(j, c.fallback, c.nFallback);
+  j.key("transport");
+  j.addString(transportNames[c.transport % 3]);
+  j.key("header");
+  j.addString(headerNames[c.frameHeader % 3]);
+
+  j.key("subscriptions");
+  j.beginArray();
+  for(int i = 0; i < c.nSubs; i++){
+    j.beginObject();
+    j.key("ip");
+    j.addIP(c.subs[i].ip);
+    j.key("port");
+    j.addNumber(c.subs[i].port);
+    j.key("filter");
+    j.addString(c.subs[i].filter);
+    j.key("max_rate");
+    j.addNumber(c.subs[i].maxRate);
+    j.key("decimation");
+    j.addNumber(c.subs[i].decimation);
+    j.endObject();
+  }
+  j.endArray();
+
+  j.key("rate_control");
+  j.addBool(rateControl);
+  j.key("rate_max");
+  j.addNumber(rateMax);
+
+  //what is running, to tell an update from a rollback (not read by POST)
+  j.key("firmware");
+  j.beginObject();
+  j.key("sha256");
+  j.addString(firmwareHash());
+  j.key("trial");
+  j.addBool(otaTrial);
+  j.endObject();
+
+  j.endObject();
+  return j.overflow() ? -1 : j.length();
+}
+
+static const char* subsystemNames[TACO_SUB_COUNT] = {"other", "pins", "send", "osc", "config", "sensors", "web", "live", "discovery"};
+
+const char* Taco::subsystemName(int subsystem){
+  return (subsystem >= 0 && subsystem < TACO_SUB_COUNT) ? subsystemNames[subsystem] : "";
+}
+
+static void addTaskStats(TacoMemoryStats& stats, const char* name, TaskHandle_t task){
+  if(task == NULL || stats.nTasks >= TACO_MAX_TASK_STATS) return;
+  stats.tasks[stats.nTasks].name = name;
+  stats.tasks[stats.nTasks].stackFree = uxTaskGetStackHighWaterMark(task);   //bytes in ESP-IDF
+  stats.nTasks++;
+}
+
+void Taco::memoryStats(TacoMemoryStats& stats){
+  stats.freeHeap = ESP.getFreeHeap();
+  stats.minFreeHeap = ESP.getMinFreeHeap();
+  stats.largestBlock = ESP.getMaxAllocHeap();
+
+  //walks the heap, it is not for every frame
+  multi_heap_info_t info;
+  heap_caps_get_info(&info, MALLOC_CAP_INTERNAL);
+  stats.freeBlocks = info.free_blocks;
+  stats.fragmentation = stats.freeHeap ? 100.0f - stats.largestBlock * 100.0f / stats.freeHeap : 0;
+  stats.frames = txPackets;
+
+  stats.nTasks = 0;
+  addTaskStats(stats, "loop", loopTaskHandle);
+  addTaskStats(stats, "taco_web", webTaskHandle);
+  addTaskStats(stats, "taco_live", liveTaskHandle);
+  addTaskStats(stats, "taco_mdns", discoveryTaskHandle);
+  addTaskStats(stats, "taco_i2c", i2cTaskHandle);
+  addTaskStats(stats, "taco_slip", slipTransport.task());
+
+  TacoAlloc::counts(stats.allocs, stats.frees);
+}
+
+int Taco::statsToJson(char* buffer, int size){
+  TacoMemoryStats mem;
+  memoryStats(mem);
+  TacoJsonWriter j(buffer, size);
+  j.beginObject();
+
+  j.key("heap");
+  j.beginObject();
+  j.key("free");
+  j.addNumber(mem.freeHeap);
+  j.key("min_free");
+  j.addNumber(mem.minFreeHeap);
+  j.key("largest_block");
+  j.addNumber(mem.largestBlock);
+  j.key("free_blocks");
+  j.addNumber(mem.freeBlocks);
+  j.key("fragmentation");
+  j.addNumber(mem.fragmentation);
+  j.endObject();
+
+  j.key("uptime");
+  j.addNumber(millis());
+  j.key("frames");
+  j.addNumber(mem.frames);
+
+  j.key("stack_free");
+  j.beginObject();
+  for(int i = 0; i < mem.nTasks; i++){
+    j.key(mem.tasks[i].name);
+    j.addNumber(mem.tasks[i].stackFree);
+  }
+  j.endObject();
+
+  j.key("jobs");
+  j.beginArray();
+  for(int i = 0; i < nJobs; i++){
+    const TacoJob& job = jobs[i];
+    j.beginObject();
+    j.key("name");
+    j.addString(job.name);
+    j.key("runs");
+    j.addNumber(job.runs);
+    j.key("misses");
+    j.addNumber(job.misses);
+    j.key("overruns");
+    j.addNumber(job.overruns);
+    j.key("deferred");
+    j.addNumber(job.deferred);
+    j.key("mean_us");
+    j.addNumber(job.meanTime);
+    j.key("max_us");
+    j.addNumber(job.maxTime);
+    j.endObject();
+  }
+  j.endArray();
+
+  //null when they are not counted
+  j.key("allocs");
+  if(TACO_ALLOC_STATS){
+    j.beginObject();
+    for(int i = 0; i < TACO_SUB_COUNT; i++){
+      j.key(subsystemNames[i]);
+      j.beginObject();
+      j.key("new");
+      j.addNumber(mem.allocs[i]);
+      j.key("delete");
+      j.addNumber(mem.frees[i]);
+      j.endObject();
+    }
+    j.endObject();
+  } else {
+    j.addNull();
+  }
+
+  j.endObject();
+  return j.overflow() ? -1 : j.length();
+}
+
+// Read the settings of a JSON object into c, the ones missing do not change.
+// With apply = false it only checks the document; with apply = true it also
+// changes the network, the rate control and saves if asked to. error tells why
+// it failed.
+bool Taco::configFromJson(const char* text, int length, TacoConfig& c, bool apply, const char** error){
+  TacoJsonReader j(text, length);
+  char key[24];
+  char name[TACO_FILTER_LEN];
+  double v;
+  bool b;
+  bool save = false;
+  bool apMode = false;
+  bool newNetwork = false;
+  bool newRateControl = false;
+  bool badPins = false;
+  bool rateEnabled = rateControl;
+  float rateLimit = rateMax;
+
+  if(!j.beginObject()) return false;
+  while(j.nextKey(key, sizeof(key))){
+    if(strcmp(key, "sample_rate") == 0){
+      if(j.readNumber(v)) c.samplePeriod = periodFromRate(v);
+    } else if(strcmp(key, "port") == 0){
+      if(j.readNumber(v) && v > 0 && v < 65536) c.udpPort = v;
+    } else if(strcmp(key, "digital_pins") == 0){
+      if(!pinsFromJson(j, c.digitalPins, c.nDigital, false) && j.ok()) badPins = true;
+    } else if(strcmp(key, "analog_pins") == 0){
+      if(!pinsFromJson(j, c.analogPins, c.nAnalog, true) && j.ok()) badPins = true;
+    } else if(strcmp(key, "digital_mask") == 0){
+      if(j.readNumber(v)) c.digitalMask = (uint32_t)v;
+    } else if(strcmp(key, "analog_mask") == 0){
+      if(j.readNumber(v)) c.analogMask = (uint32_t)v;
+    } else if(strcmp(key, "deadband") == 0){
+      //one for all the pins, or one per pin
+      if(j.peek() != '['){
+        if(j.readNumber(v)) setDeadbands(c, -1, v);
+      } else if(j.beginArray()){
+        for(int i = 0; j.nextItem() && j.readNumber(v); i++) setDeadbands(c, i, v);
+      }
+    } else if(strcmp(key, "hosts") == 0){
+      ipsFromJson(j, c.hosts, c.nHosts);
+    } else if(strcmp(key, "send_mode") == 0){
+      if(j.readString(name, sizeof(name)) && nameIndex(sendModeNames, 3, name) >= 0) c.sendMode = nameIndex(sendModeNames, 3, name);
+    } else if(strcmp(key, "group") == 0){
+      j.readIP(c.group);
+    } else if(strcmp(key, "fallback") == 0){
+      ipsFromJson(j, c.fallback, c.nFallback);
+    } else if(strcmp(key, "transport") == 0){
+      if(j.readString(name, sizeof(name)) && nameIndex(transportNames, 3, name) >= 0) c.transport = nameIndex(transportNames, 3, name);
+    } else if(strcmp(key, "header") == 0){
+      if(j.readString(name, sizeof(name)) && nameIndex(headerNames, 3, name) >= 0) c.frameHeader = nameIndex(headerNames, 3, name);
+    } else if(strcmp(key, "subscriptions") == 0){
+      //all of them, as a list of {"ip", "port", "filter", "max_rate", "decimation"}
+      c.nSubs = 0;
+      if(!j.beginArray()) break;
+      while(j.nextItem() && j.beginObject()){
+        uint32_t ip = 0;
+        uint16_t port = 0;
+        float maxRate = 0;
+        int decimation = 1;
+        name[0] = 0;
+        while(j.nextKey(key, sizeof(key))){
+          if(strcmp(key, "ip") == 0) j.readIP(ip);
+          else if(strcmp(key, "port") == 0 && j.readNumber(v)) port = v;
+          else if(strcmp(key, "filter") == 0) j.readString(name, sizeof(name));
+          else if(strcmp(key, "max_rate") == 0 && j.readNumber(v)) maxRate = v;
+          else if(strcmp(key, "decimation") == 0 && j.readNumber(v)) decimation = v;
+          else j.skip();
+        }
+        if(ip != 0 && setSubscription(c, ip, port, name, maxRate, decimation)) addHostTo(c, ip);
+      }
+    } else if(strcmp(key, "rate_control") == 0){
+      if(j.readBool(b)){
+        rateEnabled = b;
+        newRateControl = true;
+      }
+    } else if(strcmp(key, "rate_max") == 0){
+      if(j.readNumber(v)){
+        rateLimit = v;
+        newRateControl = true;
+      }
+    } else if(strcmp(key, "network") == 0){
+      //{"mode": "ap"} or {"ssid", "password", "host"}, the board reboots
+      if(!j.beginObject()) break;
+      if(apply){
+        web_passw[0] = 0;
+        web_host_ip[0] = 0;
+      }
+      while(j.nextKey(key, sizeof(key))){
+        if(strcmp(key, "mode") == 0){
+          if(j.readString(name, sizeof(name))) apMode = strcmp(name, "ap") == 0;
+        } else if(strcmp(key, "ssid") == 0){
+          if(apply) newNetwork = j.readString(web_ssid, sizeof(web_ssid));
+          else j.skip();
+        } else if(strcmp(key, "password") == 0){
+          if(apply) j.readString(web_passw, sizeof(web_passw));
+          else j.skip();
+        } else if(strcmp(key, "host") == 0){
+          if(apply) j.readString(web_host_ip, sizeof(web_host_ip));
+          else j.skip();
+        } else {
+          j.skip();
+        }
+      }
+    } else if(strcmp(key, "save") == 0){
+      j.readBool(save);
+    } else {
+      j.skip();   //unknown keys are ignored
+    }
+    if(!j.ok()) break;
+  }
+
+  if(error) *error = !j.ok() ? "bad json" : badPins ? "bad pin" : NULL;
+  if(!j.ok() || badPins) return false;
+  if(!apply) return true;
+
+  if(newRateControl) setRateControl(rateEnabled, rateLimit);
+  if(save) confSaveRequested = true;    //saved after being applied
+  if(apMode){
+    handle_APchange();
+  } else if(newNetwork){
+    snprintf(web_host_port, sizeof(web_host_port), "%u", c.udpPort ? c.udpPort : _udpPort);
+    saveSsid();
+  }
+  return true;
+}
+
+
+// reset board to Access Point mode and clear eeprom
+void Taco::resetBoard(){
+  Serial.println();
+  Serial.println("I will reset this ESP32");
+
+  //LOAD INFORMATION IN EEPROM
+  Serial.println();
+  Serial.println("writing original data in eeprom memory");
+
+    //clear eeprom
+    for (int i = 0 ; i < EEPROM_SIZE ; i++) {
+      EEPROM.write(i, 0);
+    }
 
-            WiFi.disconnect(true);
-            ok = false;
-            //Initiate connection
-            connectToWiFi(network, password);
-            delay(1000);
-          break;
+    int address = 0;
+    writeStringMem(0, "0");                   //flag for setting access point OR NOT (0=AP, 1=STA)
 
-        case SYSTEM_EVENT_WIFI_READY:
-            Serial.println("WiFi interface ready");
-            break;
-        case SYSTEM_EVENT_SCAN_DONE:
-            Serial.println("Completed scan for access points");
-            break;
-        case SYSTEM_EVENT_STA_START:
-            Serial.println("WiFi client started");
-            break;
-        case SYSTEM_EVENT_STA_STOP:
-            Serial.println("WiFi clients stopped");
-            break;
-        case SYSTEM_EVENT_STA_CONNECTED:
-            Serial.println("Connected to STA");
-            break;
-        case SYSTEM_EVENT_STA_AUTHMODE_CHANGE:
-            Serial.println("Authentication mode of access point has changed");
-            break;
-        case SYSTEM_EVENT_STA_LOST_IP:
-            Serial.println("Lost IP address and IP address is reset to 0");
-            break;
-        case SYSTEM_EVENT_STA_WPS_ER_SUCCESS:
-            Serial.println("WiFi Protected Setup (WPS): succeeded in enrollee mode");
-            break;
-        case SYSTEM_EVENT_STA_WPS_ER_FAILED:
-            Serial.println("WiFi Protected Setup (WPS): failed in enrollee mode");
-            break;
-        case SYSTEM_EVENT_STA_WPS_ER_TIMEOUT:
-            Serial.println("WiFi Protected Setup (WPS): timeout in enrollee mode");
-            break;
-        case SYSTEM_EVENT_STA_WPS_ER_PIN:
-            Serial.println("WiFi Protected Setup (WPS): pin code in enrollee mode");
-            break;
-        case SYSTEM_EVENT_AP_START:
-            Serial.println("WiFi access point started");
-            APconnected = true;
-            connected = true;
-            updateStations();
+    Serial.println("ESP32 should be in AP mode, rebooting...");
+    delay(300);
+    //shouldReboot = true;
+
+}
+
+
+// eeprom basic read/write functions
+void Taco::writeStringMem(char add,String data){
+  int _size = data.length();
+  int i;
+  for(i=0;i<_size;i++)
+  {
+    EEPROM.write(add+i,data[i]);
+  }
+  EEPROM.write(add+_size,'\0');   //Add termination null character for String Data
+  EEPROM.commit();
+}
+
+
+// eeprom functions
+String Taco::read_String(char add){
+  int i;
+  char data[100]; //Max 100 Bytes
+  int len=0;
+  unsigned char k;
+  k=EEPROM.read(add);
+  while(k != '\0' && len<500)   //Read until null character
+  {
+    k=EEPROM.read(add+len);
+    data[len]=k;
+    len++;
+  }
+  data[len]='\0';
+  return String(data);
+}
+
+
+/////////////////////////////////////////////////
+//
+// SSDD1306 display functions
+//
+//////////////////////////////////////////////////
+
+struct my_monitor
+{
+   Adafruit_SSD1306 d;
+   int pin;
+};
+
+void Taco::createSSD1306(Adafruit_SSD1306& ssd1306){
+
+  display = ssd1306;
+  //ssd1306.begin();
+
+  Serial.println("INIT OLED");
+
+  //the screen is refreshed by a task, only where it changed
+  if(oledMutex == NULL) oledMutex = xSemaphoreCreateMutex();
+  startI2C();
+  oledCreated = true;
+
+  //a missing or loose display must not stop the board: the I2C task
+  //keeps looking for it and initialises it when it answers
+  lockI2C(portMAX_DELAY);
+  bool found = oledInit();
+  unlockI2C();
+  if(found) {
+    Serial.println("OLED ok");
+  } else {
+    Serial.println(F("SSD1306 not found, waiting for it"));
+  }
+
+  //print a few things, update() clears it later
+  SSD1306_write(20, 10, "hola, I'm taco");
+  splashUntil = millis() + TACO_OLED_SPLASH_TIME;
+  splash = true;
+
+}
+
+//returns if there is oled
+bool Taco::hasOled(){
+  return oled;
+}
+
+void Taco::SSD1306_clear(){
+  if(!oled) return;
+  // Clear the buffer
+  oledLock();
+  display.clearDisplay();
+  oledUnlock();
+}
+
+void Taco::SSD1306_write(int x, int y, const char* text){
+  if(!oled) return;
+  oledLock();
+  display.setTextSize(1);
+  display.setCursor(x,y);             // Start at top-left corner
+  display.println(F(text));
+  oledUnlock();
+}
+
+void Taco::SSD1306_writeInt(int x, int y, int value){
+  if(!oled) return;
+  oledLock();
+  display.setTextSize(1);
+  display.setCursor(x,y);             // Start at top-left corner
+  display.println(value);
+  oledUnlock();
+}
+
+void Taco::SSD1306_analog_monitor(int pin){
+  if(!oled) return;
+
+  if(millis() >= time_1 + INTERVAL_UPDATE_OLED){
+          time_1 +=INTERVAL_UPDATE_OLED;
+
+          oledLock();
+          display.setCursor(0,10);
+          display.println("pin");
+          display.setCursor(25,10);
+          display.println(pin);
+          display.setCursor(45,10);
+          display.println(":");
+
+          //clear lines of the value
+          display.fillRect(65, 10, 25, 10, SSD1306_BLACK);
+
+          display.setCursor(65,10);
+          display.println(sampledValue(pin, true));
+          oledUnlock();
+  }
+
+}
+
+void Taco::SSD1306_digital_monitor(int pin){
+  if(!oled) return;
+  if(millis() >= time_2 + INTERVAL_UPDATE_OLED){
+          time_2 +=INTERVAL_UPDATE_OLED;
+
+          oledLock();
+          display.setCursor(0,10);
+          display.println("pin");
+          display.setCursor(25,10);
+          display.println(pin);
+          display.setCursor(45,10);
+          display.println(":");
+
+          //clear lines of the value
+          display.fillRect(65, 10, 25, 10, SSD1306_BLACK);
+
+          display.setCursor(65,10);
+          display.println(sampledValue(pin, false));
+          oledUnlock();
+  }
+}
+
+void Taco::hSlider(int x, int y, int w, int h, int value){
+  if(!oled) return;
+  oledLock();
+  //altura slider es h
+  //border
+  display.drawFastHLine(x,y, w, SSD1306_WHITE);
+  display.drawFastHLine(x,y+h, w, SSD1306_WHITE);
+  display.drawFastVLine(x,y, h, SSD1306_WHITE);
+  display.drawFastVLine(x+w,y, h, SSD1306_WHITE);
+
+  //value
+  for(int i=0; i<value; i+=1) {
+    display.drawFastVLine(x+i,y, h, SSD1306_WHITE);
+
+  }
+  oledUnlock();
+}
+
+
+//50 stars, one every 50 ms, drawn by update()
+void Taco::SSD1306_stars(){
+  starsLeft = 50;
+  nextStar = millis();
+}
+
+void Taco::updateStars(){
+  if(!oled) return;
+
+  //end of the splash of createSSD1306()
+  if(splash && (long)(millis() - splashUntil) >= 0){
+    splash = false;
+    oledLock();
+    display.fillRect(20, 10, 84, 8, SSD1306_BLACK);   //only the text, the rest may be in use
+    oledUnlock();
+  }
+
+  if(starsLeft > 0 && millis() >= nextStar){
+    nextStar += 50;
+    starsLeft--;
+    // Draw a single pixel in white
+    oledLock();
+    display.drawPixel(random(127), random(32), SSD1306_WHITE);
+    oledUnlock();
+  }
+}
+
+//the value read by readPins() if the pin is in the lists, so it is not read twice
+int Taco::sampledValue(int pin, bool analog){
+  if(analog){
+    for(int i = 0; i < conf.nAnalog; i++){
+      if(conf.analogPins[i] == pin && (conf.analogMask & (1UL << i)) && a_values[i] >= 0) return a_values[i];
+    }
+    return analogRead(pin);
+  }
+  for(int i = 0; i < conf.nDigital; i++){
+    if(conf.digitalPins[i] == pin && (conf.digitalMask & (1UL << i)) && d_values[i] >= 0) return d_values[i];
+  }
+  return digitalRead(pin);
+}
+
+
+///////////////////////////////////////////////
+/// I2C sensors
+///////////////////////////////////////////////
+
+TacoI2CSensor::TacoI2CSensor(uint8_t address, uint8_t firstRegister, uint8_t length, const char* oscAddress, float rate)
+  : address(address), firstRegister(firstRegister), length(min((int)length, TACO_I2C_MAX_READ)), oscAddress(oscAddress){
+  setRate(rate);
+}
+
+bool TacoI2CSensor::addInitRegister(uint8_t reg, uint8_t value){
+  if(nInitRegs >= TACO_I2C_MAX_INIT) return false;
+  initRegs[nInitRegs][0] = reg;
+  initRegs[nInitRegs][1] = value;
+  nInitRegs++;
+  return true;
+}
+
+bool TacoI2CSensor::init(TwoWire& wire){
+  //is it there?
+  wire.beginTransmission(address);
+  if(wire.endTransmission() != 0) return false;
+
+  for(int i = 0; i < nInitRegs; i++){
+    wire.beginTransmission(address);
+    wire.write(initRegs[i][0]);
+    wire.write(initRegs[i][1]);
+    if(wire.endTransmission() != 0) return false;
+  }
+  return true;
+}
+
+//big endian signed 16 bit words
+int TacoI2CSensor::decode(const uint8_t* data, int length, float* values){
+  int n = min(length / 2, TACO_I2C_MAX_VALUES);
+  for(int i = 0; i < n; i++){
+    values[i] = (int16_t)((data[2 * i] << 8) | data[2 * i + 1]);
+  }
+  return n;
+}
+
+float TacoI2CSensor::value(int index){
+  return (index >= 0 && index < nValues) ? values[index] : 0;
+}
+
+int TacoI2CSensor::valueCount(){
+  return nValues;
+}
+
+void TacoI2CSensor::setRate(float hz){
+  period = hz > 0 ? max(1UL, (unsigned long)(1000.0 / hz)) : 1000;
+}
+
+void TacoI2CSensor::setSendOSC(bool send){
+  sendOSC = send;
+}
+
+bool Taco::addSensor(TacoI2CSensor& sensor){
+  if(nSensors >= TACO_MAX_SENSORS) return false;
+  sensor.ready = false;
+  sensor.fresh = false;
+  sensor.nextRead = millis();
+  sensors[nSensors++] = &sensor;
+  startI2C();
+  mdnsTxtDirty = true;
+  return true;
+}
+
+// I2C task: one transaction per sensor due, writing the register and reading
+// all the bytes with a repeated start. The bytes wait in rx until update()
+// takes them, a frame is lost if update() did not take the last one.
+void Taco::readSensors(){
+  for(int i = 0; i < nSensors; i++){
+    TacoI2CSensor* s = sensors[i];
+    unsigned long now = millis();
+    if((long)(now - s->nextRead) < 0) continue;
+
+    if(!lockI2C(pdMS_TO_TICKS(TACO_OLED_I2C_TIMEOUT))) return;
+
+    if(!s->ready){
+      //start it, or try again in a second
+      s->ready = s->init(Wire);
+      s->nextRead = now + (s->ready ? 0 : TACO_OLED_PROBE_INTERVAL);
+      unlockI2C();
+      continue;
+    }
+
+    s->nextRead += s->period;
+    if((long)(now - s->nextRead) >= 0) s->nextRead = now + s->period;  //we were late, do not try to catch up
+
+    if(s->fresh){
+      s->overruns++;
+      unlockI2C();
+      continue;
+    }
+
+    bool ok = false;
+    Wire.beginTransmission(s->address);
+    Wire.write(s->firstRegister);
+    if(Wire.endTransmission(false) == 0 && Wire.requestFrom(s->address, s->length) == s->length){
+      for(int j = 0; j < s->length; j++) s->rx[j] = Wire.read();
+      ok = true;
+    }
+    unlockI2C();
+
+    if(ok){
+      s->fresh = true;
+    } else {
+      s->errors++;
+      s->ready = false;     //unplugged? start it again
+    }
+  }
+}
+
+//update(): decode and send the frames read by the I2C task
+void Taco::updateSensors(){
+  TACO_TRACE_SCOPE("updateSensors");
+  TacoAllocScope scope(TACO_SUB_SENSORS);
+  for(int i = 0; i < nSensors; i++){
+    TacoI2CSensor* s = sensors[i];
+    if(!s->fresh) continue;
+    s->nValues = s->decode(s->rx, s->length, s->values);
+    s->fresh = false;
+    if(s->sendOSC && s->nValues > 0) sendFloats(s->oscAddress, s->values, s->nValues);
+  }
+}
+
+
+///////////////////////////////////////////////
+/// IMU
+///////////////////////////////////////////////
+
+//MPU-6050/6500/9250 registers
+#define MPU_SMPLRT_DIV    0x19
+#define MPU_CONFIG        0x1A
+#define MPU_GYRO_CONFIG   0x1B
+#define MPU_ACCEL_CONFIG  0x1C
+#define MPU_FIFO_EN       0x23
+#define MPU_USER_CTRL     0x6A
+#define MPU_PWR_MGMT_1    0x6B
+#define MPU_FIFO_COUNT_H  0x72
+#define MPU_FIFO_R_W      0x74
+#define MPU_FIFO_SIZE     1024
+#define MPU_SAMPLE_SIZE   12        //accel and gyro
+#define MPU_ACCEL_SCALE   4096.0    //LSB per g at +-8 g
+#define MPU_GYRO_SCALE    16.4      //LSB per degree/s at +-2000 degrees/s
+
+TacoImu::TacoImu(uint8_t address, float rate, const char* oscAddress)
+  : address(address), rate(constrain(rate, 4.0f, 1000.0f)), oscAddress(oscAddress){
+}
+
+void TacoImu::setFusion(bool enabled, float beta){
+  fusion = enabled;
+  madgwick.beta = beta;
+}
+
+void TacoImu::setPacking(int packing, int samplesPerPacket){
+  this->packing = packing;
+  perPacket = constrain(samplesPerPacket, 1, TACO_IMU_MAX_PER_PACKET);
+}
 
-            break;
-        case SYSTEM_EVENT_AP_STOP:
-            Serial.println("WiFi access point  stopped");
-            break;
-        case SYSTEM_EVENT_AP_STACONNECTED:
-            Serial.println("Client connected");
-            connected = true;
+float TacoImu::quaternion(int index){
+  return (index >= 0 && index < 4) ? madgwick.q[index] : 0;
+}
 
-            break;
-        case SYSTEM_EVENT_AP_STADISCONNECTED:
-            Serial.println("Client disconnected");
-            updateStations();
-            break;
-        case SYSTEM_EVENT_AP_STAIPASSIGNED:
-            Serial.println("Assigned IP address to client");
-            updateStations();
-            connected = true;
-            break;
-        case SYSTEM_EVENT_AP_PROBEREQRECVED:
-            Serial.println("Received probe request");
-            break;
-        case SYSTEM_EVENT_GOT_IP6:
-            Serial.println("IPv6 is preferred");
-            break;
-        case SYSTEM_EVENT_ETH_START:
-            Serial.println("Ethernet started");
-            break;
-        case SYSTEM_EVENT_ETH_STOP:
-            Serial.println("Ethernet stopped");
-            break;
-        case SYSTEM_EVENT_ETH_CONNECTED:
-            Serial.println("Ethernet connected");
-            break;
-        case SYSTEM_EVENT_ETH_DISCONNECTED:
-            Serial.println("Ethernet disconnected");
-            break;
-        case SYSTEM_EVENT_ETH_GOT_IP:
-            Serial.println("Obtained IP address");
-        break;
+unsigned long TacoImu::lostSamples(){
+  return samples.lost;
+}
+
+bool TacoImu::writeRegister(TwoWire& wire, uint8_t reg, uint8_t value){
+  wire.beginTransmission(address);
+  wire.write(reg);
+  wire.write(value);
+  return wire.endTransmission() == 0;
+}
+
+//1 kHz internal rate divided down to `rate`, accel and gyro into the FIFO
+bool TacoImu::init(TwoWire& wire){
+  //the MPU samples at 1000 / (divider + 1) Hz (300 becomes 333): the fusion
+  //and the blobs use the rate it really has
+  int divider = constrain((int)(1000 / rate + 0.5f) - 1, 0, 255);
+  rate = 1000.0f / (divider + 1);
+
+  return writeRegister(wire, MPU_PWR_MGMT_1, 0x01)                             //wake up, gyro clock
+      && writeRegister(wire, MPU_CONFIG, 0x01)                                 //low pass, 1 kHz
+      && writeRegister(wire, MPU_SMPLRT_DIV, (uint8_t)divider)
+      && writeRegister(wire, MPU_GYRO_CONFIG, 0x18)                            //+-2000 degrees/s
+      && writeRegister(wire, MPU_ACCEL_CONFIG, 0x10)                           //+-8 g
+      && writeRegister(wire, MPU_FIFO_EN, 0x78)                                //accel and gyro
+      && writeRegister(wire, MPU_USER_CTRL, 0x04)                              //reset the FIFO
+      && writeRegister(wire, MPU_USER_CTRL, 0x40);                             //enable it
+}
+
+// Read all the complete samples in the FIFO, in bursts that fit the Wire
+// buffer. Called by the I2C task with the bus locked.
+void TacoImu::drain(TwoWire& wire){
+  wire.beginTransmission(address);
+  wire.write(MPU_FIFO_COUNT_H);
+  if(wire.endTransmission(false) != 0 || wire.requestFrom(address, (uint8_t)2) != 2){
+    ready = false;      //unplugged? start it again
+    return;
+  }
+  int count = (wire.read() << 8) | wire.read();
+
+  //full: the oldest samples were overwritten, start again
+  if(count >= MPU_FIFO_SIZE - MPU_SAMPLE_SIZE){
+    samples.skip(count / MPU_SAMPLE_SIZE);
+    writeRegister(wire, MPU_USER_CTRL, 0x44);
+    return;
+  }
+
+  int waiting = count / MPU_SAMPLE_SIZE;
+  const int burst = 120 / MPU_SAMPLE_SIZE;  //the Wire buffer has 128 bytes
+  while(waiting > 0){
+    int n = min(waiting, burst);
+    wire.beginTransmission(address);
+    wire.write(MPU_FIFO_R_W);
+    if(wire.endTransmission(false) != 0 || wire.requestFrom(address, (uint8_t)(n * MPU_SAMPLE_SIZE)) != n * MPU_SAMPLE_SIZE){
+      ready = false;
+      return;
     }
+    for(int i = 0; i < n; i++){
+      int16_t raw[6];
+      for(int j = 0; j < 6; j++){
+        int hi = wire.read();
+        raw[j] = (int16_t)((hi << 8) | wire.read());
+      }
 
+      if(fusion){
+        const float rad = PI / 180.0 / MPU_GYRO_SCALE;
+        madgwick.update(raw[3] * rad, raw[4] * rad, raw[5] * rad, raw[0], raw[1], raw[2], 1.0 / rate);
+      }
+      samples.push(raw, madgwick.q);
+    }
+    waiting -= n;
+  }
 }
 
+void Taco::addImu(TacoImu& sensor){
+  sensor.ready = false;
+  sensor.samples.clear();
+  sensor.nextRead = millis();
+  imu = &sensor;
+  startI2C();
+  mdnsTxtDirty = true;
+}
 
-///////////////////////////////////////////////////////////////////////
-// Handling information about connected clients in access point mode
-// For sending OSC data to clients we need to know their IPs and this
-// function makes the work.
-void Taco::updateStations() {
+//I2C task: start the IMU (again if it was unplugged) and drain its FIFO
+void Taco::readImu(){
+  if(imu == NULL) return;
+  unsigned long now = millis();
+  if((long)(now - imu->nextRead) < 0) return;
+  if(!lockI2C(pdMS_TO_TICKS(TACO_OLED_I2C_TIMEOUT))) return;
 
-  wifi_sta_list_t stationList;
-  esp_wifi_ap_get_sta_list(&stationList);
+  if(!imu->ready){
+    imu->ready = imu->init(Wire);
+    imu->nextRead = now + (imu->ready ? TACO_IMU_POLL : TACO_OLED_PROBE_INTERVAL);
+  } else {
+    imu->drain(Wire);
+    imu->nextRead = now + TACO_IMU_POLL;
+  }
+  unlockI2C();
+}
 
-  //update number of clients (stations connected)
-  numClients = stationList.num;
+//update(): every N samples leave in one packet
+void Taco::updateImu(){
+  TACO_TRACE_SCOPE("updateImu");
+  TacoAllocScope scope(TACO_SUB_SENSORS);
+  if(imu == NULL) return;
+
+  while(true){
+    int n = imu->perPacket;
+    if(imu->samples.available() < n) return;
+
+    if(imu->packing == TACO_IMU_BLOB){
+      //oscAddress/blob
+      txPacket.clear();
+      txPacket.write((const uint8_t*)imu->oscAddress, strlen(imu->oscAddress));
+      txPacket.addString("/blob");
+      txPacket.addString(",b");
+      uint8_t be[20];
+      n = imu->samples.blobHeader(be, n, (uint16_t)imu->rate);   //less than N before a gap
+      txPacket.addInt32(8 + n * 20);
+      txPacket.write(be, 8);
+      for(int i = 0; i < n; i++){
+        imu->samples.blobSample(i, be);
+        txPacket.write(be, 20);
+      }
+      txPacket.pad();
+      int address = addressIndex((const char*)txPacket.data());
+      if(!txPacket.overflow()) sendBuffer(txPacket.data(), txPacket.length(), address, addrCount[address]++);
+    } else {
+      //a bundle of messages of floats
+      int address = addressIndex(imu->oscAddress);
+      imuBundle.begin(1);
+      for(int i = 0; i < n; i++){
+        const TacoImuSample& s = imu->samples.peek(i);
+        float values[10];
+        for(int j = 0; j < 3; j++){
+          values[j] = s.raw[j] / MPU_ACCEL_SCALE;
+          values[3 + j] = s.raw[3 + j] / MPU_GYRO_SCALE;
+        }
+        memcpy(values + 6, s.q, sizeof(s.q));
+        txPacket.clear();
+        txPacket.addFloats(imu->oscAddress, values, 10);
+        if(!imuBundle.add(txPacket.data(), txPacket.length())){
+          sendBuffer(imuBundle.data(), imuBundle.length(), address, addrCount[address]++);
+          imuBundle.begin(1);
+          imuBundle.add(txPacket.data(), txPacket.length());
+        }
+      }
+      sendBuffer(imuBundle.data(), imuBundle.length(), address, addrCount[address]++);
+    }
 
-  Serial.println("-----------------");
-  Serial.print("Number of connected stations: ");
-  Serial.println(stationList.num);
-  Serial.println("-----------------");
-  if(oled) {
-    display.fillRect(120, 0, 25, 10, SSD1306_BLACK);
-    SSD1306_writeInt(120, 0, stationList.num);
+    imu->samples.pop(n);
   }
+}
 
 
-  //Now obtain their Mac addresses and IP addresses
-  tcpip_adapter_sta_list_t adapter_sta_list;
-  memset(&adapter_sta_list, 0, sizeof(adapter_sta_list));
+///////////////////////////////////////////////
+/// Sample blocks
+///////////////////////////////////////////////
 
-  ESP_ERROR_CHECK(tcpip_adapter_get_sta_list(&stationList, &adapter_sta_list));
+TacoBlockStream::TacoBlockStream(const char* oscAddress, int blockSize, float sampleRate, int format)
+  : oscAddress(oscAddress), sampleRate(sampleRate), format(format){
+  //an even number of int16 keeps the blob a multiple of 4 bytes
+  this->blockSize = constrain(blockSize + (blockSize & 1), 2, TACO_BLOCK_MAX_SIZE);
+  sampleBytes = (format == TACO_BLOCK_FLOAT32) ? 4 : 2;
+  buffer = (uint8_t*)malloc(TACO_BLOCK_RING * this->blockSize * sampleBytes);
+}
 
-  //we have to convert station information to IPAdress type of arduino
-  for(int i = 0; i < adapter_sta_list.num; i++) {
-    tcpip_adapter_sta_info_t station = adapter_sta_list.sta[i];
-    printf("%d - mac: %.2x:%.2x:%.2x:%.2x:%.2x:%.2x - IP: %s\n", i + 1,
-    station.mac[0], station.mac[1], station.mac[2],
-    station.mac[3], station.mac[4], station.mac[5],
-    ip4addr_ntoa(&(station.ip)));
+TacoBlockStream::~TacoBlockStream(){
+  free(buffer);
+}
 
-    String ipi = ip4addr_ntoa(&(station.ip));
-    String strIP = ipi;
+// Samples go straight into the block being filled. A full block is handed to
+// update(), or lost if update() has not sent the oldest one yet.
+void TacoBlockStream::push(float sample){
+  if(buffer == NULL) return;
+  uint8_t* block = buffer + writeBlock * blockSize * sampleBytes;
+  if(format == TACO_BLOCK_FLOAT32){
+    ((float*)block)[writePos] = sample;
+  } else {
+    ((int16_t*)block)[writePos] = (int16_t)constrain((int)sample, -32768, 32767);
+  }
 
-    int Parts[4] = {0,0,0,0};
-    int Part = 0;
-    for ( int i=0; i<strIP.length(); i++ ) {
-      char c = strIP[i];
-      if ( c == '.' ) {
-        Part++;
-        continue;
-      }
-      Parts[Part] *= 10;
-      Parts[Part] += c - '0';
+  if(++writePos < blockSize) return;
+  writePos = 0;
+  blockSeq[writeBlock] = produced++;
+
+  int next = (writeBlock + 1) % TACO_BLOCK_RING;
+  if(next == readBlock){
+    overruns++;           //the receiver sees the hole in the sequence numbers
+    return;               //fill the same block again
+  }
+  writeBlock = next;
+}
+
+unsigned long TacoBlockStream::lostBlocks(){
+  return overruns;
+}
+
+bool Taco::addBlockStream(TacoBlockStream& stream){
+  if(nStreams >= TACO_MAX_STREAMS) return false;
+  streams[nStreams++] = &stream;
+  mdnsTxtDirty = true;
+  return true;
+}
+
+// update(): every full block leaves in one message. The header is encoded
+// apart and the samples are written from the ring by the transport, so they
+// are never copied.
+void Taco::updateStreams(){
+  TACO_TRACE_SCOPE("updateStreams");
+  TacoAllocScope scope(TACO_SUB_SEND);
+  for(int i = 0; i < nStreams; i++){
+    TacoBlockStream* s = streams[i];
+    while(s->readBlock != s->writeBlock){
+      int bytes = s->blockSize * s->sampleBytes;
+
+      //oscAddress ,b size seq rate format count
+      txPacket.clear();
+      txPacket.addString(s->oscAddress);
+      txPacket.addString(",b");
+      txPacket.addInt32(12 + bytes);
+      txPacket.addInt32(s->blockSeq[s->readBlock]);
+      txPacket.addFloat(s->sampleRate);
+      txPacket.addInt32(((uint32_t)s->format << 16) | s->blockSize);
+
+      const uint8_t* parts[2] = {txPacket.data(), s->buffer + s->readBlock * bytes};
+      int lengths[2] = {txPacket.length(), bytes};
+      int address = addressIndex(s->oscAddress);
+      if(!txPacket.overflow()) sendParts(parts, lengths, 2, address, addrCount[address]++);
+
+      s->readBlock = (s->readBlock + 1) % TACO_BLOCK_RING;
     }
+  }
+}
 
-    //finally this is the array of clients ip addresses
-    IPAddress ipo( Parts[0], Parts[1], Parts[2], Parts[3] );
-    clientsAddress[i]= ipo;
+// Receiving side: read a block and count the ones lost on the way
+const uint8_t* TacoBlockReceiver::receive(TacoOSCMessage& msg){
+  int len;
+  const uint8_t* blob = msg.getBlob(0, len);
+  if(blob == NULL || len < 12){
+    _errors++;
+    return NULL;
+  }
 
+  uint32_t seq = ((uint32_t)blob[0] << 24) | ((uint32_t)blob[1] << 16) | ((uint32_t)blob[2] << 8) | blob[3];
+  uint32_t rate = ((uint32_t)blob[4] << 24) | ((uint32_t)blob[5] << 16) | ((uint32_t)blob[6] << 8) | blob[7];
+  memcpy(&_sampleRate, &rate, 4);
+  _format = (blob[8] << 8) | blob[9];
+  _count = (blob[10] << 8) | blob[11];
+  int bytes = _count * (_format == TACO_BLOCK_FLOAT32 ? 4 : 2);
+  if(12 + bytes > len){
+    _errors++;
+    return NULL;
   }
 
+  //a jump forward is lost blocks, a jump back is a restarted sender
+  if(_received > 0 && seq > _expected) _lost += seq - _expected;
+  _expected = seq + 1;
+  _received++;
+  return blob + 12;
 }
 
+int TacoBlockReceiver::count(){
+  return _count;
+}
 
-/////////////////////////////////////////////////////////////
-//   //setup mDNS for collecting the IPs of other machines in the network,
-///only in STA Mode
-////////////////////////////////////////////////////////////////////
+int TacoBlockReceiver::format(){
+  return _format;
+}
 
-void Taco::discoverMDNShosts(){
+float TacoBlockReceiver::sampleRate(){
+  return _sampleRate;
+}
 
-  Serial.println("discovering hosts");
+unsigned long TacoBlockReceiver::received(){
+  return _received;
+}
 
-  if(accesspoint == false || user_STA){
-    delay(2000);
-    if (!MDNS.begin("taco")) {  //dummy name
-          Serial.println("Error setting up MDNS responder!");
-         while(1){
-              delay(1000);
-          }
-      }
+unsigned long TacoBlockReceiver::lost(){
+  return _lost;
+}
 
+unsigned long TacoBlockReceiver::errors(){
+  return _errors;
+}
 
-    //browse samba services to discover available devices
-    browseService("smb", "tcp");
-    delay(100);
-    browseService("http", "tcp");
-    delay(100);
-    browseService("workstation", "tcp");
-    delay(100);
-    browseService("upnp", "tcp");
-    delay(100);
-    browseService("ssdp", "tcp");
-    delay(100);
-    browseService("ftp", "tcp");
-    delay(100);
-    browseService("uuid", "tcp");
-    delay(100);
-    browseService("printer", "tcp");
 
+///////////////////////////////////////////////
+/// Clock sync (TacoClock.cpp)
+///////////////////////////////////////////////
+
+void Taco::beginSync(IPAddress server, uint16_t port, float interval){
+  syncServer = server;
+  syncPort = port;
+  syncInterval = max(10UL, (unsigned long)(interval * 1000));
+  nextSync = millis();
+  clock.reset();
+
+  // /taco/sync/reply h h h: our t1, t2 and t3 of the server
+  if(!syncReplyRoute){
+    syncReplyRoute = route("/taco/sync/reply", [this](TacoOSCMessage& msg){
+      if(msg.size() < 3) return;
+      clock.sample(msg.getInt64(0), msg.getInt64(1), msg.getInt64(2), msg.receiveTime());
+    });
   }
 }
 
-void Taco::addHost(String host_name){
-  /// NEW STUFF
-  Serial.println("Browsing for host");
-  IPAddress serverIp = MDNS.queryHost(host_name);
-  while (serverIp.toString() == "0.0.0.0") {
-    Serial.println("Trying again to resolve mDNS");
-    delay(250);
-    serverIp = MDNS.queryHost(host_name);
-  }
-  Serial.print("IP address of server: ");
-  Serial.println(serverIp.toString());
-  Serial.println("Done finding the host...");
-  extraHostAddress[nExtraHosts] = serverIp;
-  nExtraHosts = nExtraHosts + 1;
-  //return serverIp.toString();
+// A master answers /taco/sync/req h (t1 of the client) with
+// /taco/sync/reply h h h (t1, t2 and t3) in its own time
+void Taco::beginSyncMaster(){
+  route("/taco/sync/req", [this](TacoOSCMessage& msg){
+    int64_t t2 = clock.toServer(msg.receiveTime());
+    txPacket.clear();
+    txPacket.addString("/taco/sync/reply");
+    txPacket.addString(",hhh");
+    txPacket.addInt64(msg.getInt64(0));
+    txPacket.addInt64(t2);
+    txPacket.addInt64(syncedMicros());
+    sendReply(txPacket.data(), txPacket.length(), msg);
+  });
+}
 
+//update(): ask for the time of the server
+void Taco::updateSync(){
+  TACO_TRACE_SCOPE("updateSync");
+  if(syncInterval == 0 || (long)(millis() - nextSync) < 0) return;
+  nextSync += syncInterval;
+  if((long)(millis() - nextSync) >= 0) nextSync = millis() + syncInterval;
+
+  txPacket.clear();
+  txPacket.addString("/taco/sync/req");
+  txPacket.addString(",h");
+  txPacket.addInt64(esp_timer_get_time());
+  transport->beginPacket(syncServer, syncPort);
+  transport->write(txPacket.data(), txPacket.length());
+  transport->endPacket();
 }
 
-/////////////////////////////////////////////////////////////
-//   browse computer services to discover devices
-////////////////////////////////////////////////////////////////////
-void Taco::browseService(const char * service, const char * proto){
-    Serial.println(" ");
-    Serial.printf("Browsing for service _%s._%s.local. ... ", service, proto);
-    nServices = MDNS.queryService(service, proto);
-    if (nServices == 0) {
-        Serial.println("no services found");
-    } else {
-        Serial.print(nServices);
-        Serial.println(" service(s) found");
-        for (int i = 0; i < nServices; ++i) {
-            // Print details for each service found
-            Serial.print("  ");
-            Serial.print(i + 1);
-            Serial.print(": ");
-            Serial.print(MDNS.hostname(i));
-            Serial.print(" (");
-            Serial.print(MDNS.IP(i));
-            Serial.print(":");
-            Serial.print(MDNS.port(i));
-            Serial.println(")");
-        }
-    }
-    Serial.println();
+int64_t Taco::syncedMicros(){
+  return clock.toServer(esp_timer_get_time());
+}
 
+bool Taco::isSynced(){
+  return clock.isSynced();
 }
 
-/////////////////////////////////////////////////////////
-///
-/// EEPROM
-/////////////////////////////////////////////////////////
+uint32_t Taco::syncError(){
+  return clock.error();
+}
 
-//Configuration Settings loaded from eeprom
-void Taco::confSettings(){
-  Serial.println();
-  Serial.println("* Reading EEPROM:");
+float Taco::clockDrift(){
+  return clock.drift();
+}
 
-  String d;
-  int address;
 
-  // the first byte is a flag (0 or 1) informing about wifi modes
-  address = 0;
-  d = read_String(address);
-  Serial.print("- AccesPoint flag (0= AP, 1=STA):");
-  Serial.println(d);
-  if(d.toInt()==0){
-    accesspoint = true;
+///////////////////////////////////////////////
+/// OLED dashboard
+///////////////////////////////////////////////
+
+void Taco::SSD1306_dashboard(int style, unsigned long budgetUs){
+  dashStyle = style;
+  dashBudget = budgetUs;
+  dashStep = -1;
+  dashNext = millis();
+  dashRateCount = txPackets;
+  dashRateTime = millis();
+  memset(dashHistory, 0, sizeof(dashHistory));
+  if(oled) SSD1306_clear();
+}
+
+// A frame is drawn in parts (the header, then one pin each), as many as fit
+// in dashBudget microseconds. The rest are drawn in the next calls.
+void Taco::updateDashboard(){
+  TACO_TRACE_SCOPE("updateDashboard");
+  if(!oled || dashStyle == TACO_DASH_OFF) return;
+
+  unsigned long start = micros();
+
+  //is it time for a new frame?
+  if(dashStep < 0){
+    if((long)(millis() - dashNext) < 0) return;
+    dashNext += 1000 / TACO_OLED_MAX_FPS;
+    if((long)(millis() - dashNext) >= 0) dashNext = millis();  //we were late, do not try to catch up
+
+    //the enabled pins, analog first
+    dashChannels = 0;
+    for(int i = 0; i < conf.nAnalog; i++){
+      if(conf.analogMask & (1UL << i)) dashPins[dashChannels++] = i;
+    }
+    for(int i = 0; i < conf.nDigital; i++){
+      if(conf.digitalMask & (1UL << i)) dashPins[dashChannels++] = i | 0x80;
+    }
+    dashHead = (dashHead + 1) % TACO_DASH_HISTORY;
+    dashStep = 0;
+  }
+
+  do {
+    if(dashStep == 0) {
+      drawDashHeader();
+    } else {
+      drawDashChannel(dashStep - 1);
+    }
+    dashStep++;
+    if(dashStep > dashChannels){
+      dashStep = -1;      //frame done
+      return;
+    }
+  } while(micros() - start < dashBudget);
+}
+
+void Taco::drawDashHeader(){
+  unsigned long now = millis();
+  if(now - dashRateTime >= 1000){
+    dashRate = (txPackets - dashRateCount) * 1000 / (now - dashRateTime);
+    dashRateCount = txPackets;
+    dashRateTime = now;
+  }
+
+  //the right side shows the wifi mode and the stations
+  oledLock();
+  display.fillRect(0, 0, 90, 8, SSD1306_BLACK);
+  display.setTextSize(1);
+  display.setCursor(0, 0);
+  display.print(dashRate);
+  display.print("p/s ");
+  display.print(nDests);
+  display.print("h");
+  if(dashChannels == 0){
+    display.fillRect(0, 9, display.width(), display.height() - 9, SSD1306_BLACK);
+    display.setCursor(0, 12);
+    display.print("no pins");
+  }
+  oledUnlock();
+}
+
+void Taco::drawDashChannel(int channel){
+  bool digital = dashPins[channel] & 0x80;
+  int index = dashPins[channel] & 0x7f;
+  int value = digital ? d_values[index] : a_values[index];
+  if(value < 0) value = 0;   //not read yet
+
+  //0-255
+  uint8_t level = digital ? (value ? 255 : 0) : (uint8_t)(constrain(value, 0, 4095) >> 4);
+  dashHistory[channel][dashHead] = level;
+
+  //every pin has a slot of the screen under the header
+  int w = display.width() / dashChannels;
+  int x = channel * w;
+  int top = 9;
+  int h = display.height() - top;
+  if(w > 1) w--;      //a gap between slots
+
+  oledLock();
+  display.fillRect(x, top, w, h, SSD1306_BLACK);
+  if(dashStyle == TACO_DASH_BARS){
+    int bar = level * h / 255;
+    if(digital && bar == 0) bar = 1;   //digital lows are a line
+    display.fillRect(x, top + h - bar, w, bar, SSD1306_WHITE);
   } else {
-    accesspoint = false;
+    //newest sample on the right
+    int n = min(w, TACO_DASH_HISTORY);
+    for(int i = 0; i < n; i++){
+      int sample = dashHistory[channel][(dashHead - i + TACO_DASH_HISTORY) % TACO_DASH_HISTORY];
+      display.drawPixel(x + w - 1 - i, top + h - 1 - sample * (h - 1) / 255, SSD1306_WHITE);
+    }
   }
+  oledUnlock();
+}
 
-  address = 2; //we know the flag is always 2 bytes long
-  d = read_String(2);
-  //Serial.print("- SSID Length:");
-  //Serial.println(d);
 
-  d = read_String(20);  //reading ssid, address (20) is arbitrary, the following are too.
-  Serial.print("- SSID:");
-  Serial.println(d);
-  network = d;
+///////////////////////////////////////////////
+/// OLED refresh
+///////////////////////////////////////////////
 
-  d = read_String(86);
-  Serial.print("- Password:");
-  Serial.println(d);
-  password = d;
+// Drawing only changes the buffer in memory. Every helper locks it while
+// drawing and marks it as changed when it unlocks.
+void Taco::oledLock(){
+  if(oledMutex) xSemaphoreTake(oledMutex, portMAX_DELAY);
+}
 
-  d = read_String(130);
-  Serial.print("- Access Point Name: ");
-  Serial.println(d);
-  APssid_read_from_eeprom = d.c_str();
+void Taco::oledUnlock(){
+  oledDirty = true;
+  if(oledMutex) xSemaphoreGive(oledMutex);
+}
 
-  /*
-  d = read_String(170);
-  Serial.print("- ip at new network:");
-  Serial.println(d);
-  if(!accesspoint ) staIP = string2IP(d);
-  */
+bool Taco::lockI2C(TickType_t timeout){
+  return i2cMutex == NULL || xSemaphoreTake(i2cMutex, timeout) == pdTRUE;
+}
 
-  d = read_String(200);
-  Serial.print("- OSC port:");
-  Serial.println(d);
-  if(!accesspoint ) _udpPort = d.toInt();  //cause it can be empty at the beginning
+void Taco::unlockI2C(){
+  if(i2cMutex) xSemaphoreGive(i2cMutex);
+}
 
-  /*
-  d = read_String(216);
-  Serial.print("- Gateway ip:");
-  Serial.println(d);
-  if(!accesspoint ) staGateway = string2IP(d);
-  */
+//the bus has a single owner, the I2C task, so the loop never waits for it
+void Taco::startI2C(){
+  if(i2cTaskHandle != NULL) return;
+  if(i2cMutex == NULL) i2cMutex = xSemaphoreCreateMutex();
+  Wire.begin();
+  Wire.setTimeOut(TACO_OLED_I2C_TIMEOUT);
+  xTaskCreatePinnedToCore(i2cTask, "taco_i2c", 4096, this, 1, &i2cTaskHandle, 0);
+}
 
+//the I2C task reads the sensors at their rates, refreshes the screen at
+//TACO_OLED_MAX_FPS at most and checks that the display is still there
+void Taco::i2cTask(void* param){
+  Taco* taco = (Taco*)param;
+  TacoAlloc::setTask(TACO_SUB_SENSORS);
+  unsigned long lastProbe = millis();
+  unsigned long lastFlush = millis();
+  for(;;){
+    vTaskDelay(1);
+    taco->readSensors();
+    taco->readImu();
+
+    if(millis() - lastFlush >= 1000 / TACO_OLED_MAX_FPS){
+      lastFlush = millis();
+      if(taco->oled && taco->oledDirty) taco->oledFlush();
+    }
+
+    if(millis() - lastProbe >= TACO_OLED_PROBE_INTERVAL){
+      lastProbe = millis();
+      taco->oledProbe();
+    }
+  }
 }
 
+//is the display answering at its address? Call it with the I2C bus locked
+bool Taco::oledAnswers(){
+  Wire.beginTransmission(TACO_OLED_ADDRESS);
+  return Wire.endTransmission() == 0;
+}
 
+//initialise the display if it answers, keeping what was drawn
+//Call it with the I2C bus locked
+bool Taco::oledInit(){
+  if(!oledAnswers()) return false;
+
+  //begin() clears the buffer, the shadow keeps the drawing meanwhile
+  oledLock();
+  bool first = !display.getBuffer();
+  if(!first) memcpy(oledShadow, display.getBuffer(), min(display.width() * display.height() / 8, TACO_OLED_BUFFER_SIZE));
+  bool ok = display.begin(SSD1306_SWITCHCAPVCC, TACO_OLED_ADDRESS, first, first);
+  if(ok){
+    if(!first) memcpy(display.getBuffer(), oledShadow, min(display.width() * display.height() / 8, TACO_OLED_BUFFER_SIZE));
+    display.setTextSize(1);             // Normal 1:1 pixel scale
+    display.setTextColor(SSD1306_WHITE);        // Draw white text
+    oledFullRefresh = true;
+  }
+  oledUnlock();
 
-// reset board to Access Point mode and clear eeprom
-void Taco::resetBoard(){
-  Serial.println();
-  Serial.println("I will reset this ESP32");
-
-  //LOAD INFORMATION IN EEPROM
-  Serial.println();
-  Serial.println("writing original data in eeprom memory");
+  if(!ok){
+    Serial.println(F("SSD1306 allocation failed"));
+    return false;
+  }
+  oled = true;
+  return true;
+}
 
-    //clear eeprom
-    for (int i = 0 ; i < EEPROM_SIZE ; i++) {
-      EEPROM.write(i, 0);
+//the display was unplugged or plugged again
+void Taco::oledProbe(){
+  if(!oledCreated) return;
+  if(!lockI2C(pdMS_TO_TICKS(TACO_OLED_I2C_TIMEOUT))) return;
+  if(oled){
+    if(!oledAnswers()){
+      oled = false;
+      Serial.println("OLED lost");
     }
+  } else if(oledInit()){
+    Serial.println("OLED found");
+  }
+  unlockI2C();
+}
 
-    int address = 0;
-    writeStringMem(0, "0");                   //flag for setting access point OR NOT (0=AP, 1=STA)
+// Compare the buffer with what the screen shows (oledShadow) and send only
+// the columns that changed in every page. The buffer is locked only while
+// comparing, the slow I2C transfer is made from the shadow copy.
+void Taco::oledFlush(){
+  TACO_TRACE_SCOPE("oledFlush");
+  int width = display.width();
+  int pages = min(display.height() / 8, 8);
+  int16_t first[8];
+  int16_t last[8];
+  bool changed = false;
+
+  if(width * pages > TACO_OLED_BUFFER_SIZE) return;
+
+  oledLock();
+  const uint8_t* buffer = display.getBuffer();
+  for(int p = 0; p < pages; p++){
+    const uint8_t* row = buffer + p * width;
+    uint8_t* shadow = oledShadow + p * width;
+    first[p] = -1;
+    last[p] = -1;
+    for(int c = 0; c < width; c++){
+      if(oledFullRefresh || row[c] != shadow[c]){
+        if(first[p] < 0) first[p] = c;
+        last[p] = c;
+      }
+    }
+    if(first[p] >= 0){
+      memcpy(shadow + first[p], row + first[p], last[p] - first[p] + 1);
+      changed = true;
+    }
+  }
+  oledFullRefresh = false;
+  oledDirty = false;          //with the lock held: a later draw sets it again
+  if(oledMutex) xSemaphoreGive(oledMutex);
 
-    Serial.println("ESP32 should be in AP mode, rebooting...");
-    delay(300);
-    //shouldReboot = true;
+  if(!changed) return;
 
+  lockI2C(portMAX_DELAY);
+  for(int p = 0; p < pages && oled; p++){
+    if(first[p] >= 0 && !oledSendRange(p, first[p], last[p])){
+      //no answer, the probe will bring it back
+      oled = false;
+    }
+  }
+  unlockI2C();
 }
 
-
-// eeprom basic read/write functions
-void Taco::writeStringMem(char add,String data){
-  int _size = data.length();
-  int i;
-  for(i=0;i<_size;i++)
-  {
-    EEPROM.write(add+i,data[i]);
+//send the columns first..last of a page to the SSD1306, false if it does not answer
+bool Taco::oledSendRange(int page, int first, int last){
+  Wire.beginTransmission(TACO_OLED_ADDRESS);
+  Wire.write((uint8_t)0x00);      //commands
+  Wire.write((uint8_t)0x21);      //column range
+  Wire.write((uint8_t)first);
+  Wire.write((uint8_t)last);
+  Wire.write((uint8_t)0x22);      //page range
+  Wire.write((uint8_t)page);
+  Wire.write((uint8_t)page);
+  if(Wire.endTransmission() != 0) return false;
+
+  const uint8_t* data = oledShadow + page * display.width() + first;
+  int n = last - first + 1;
+  while(n > 0){
+    int chunk = min(n, 31);       //the 32 bytes of the smallest Wire buffers, with the data byte
+    Wire.beginTransmission(TACO_OLED_ADDRESS);
+    Wire.write((uint8_t)0x40);    //data
+    Wire.write(data, chunk);
+    if(Wire.endTransmission() != 0) return false;
+    data += chunk;
+    n -= chunk;
   }
-  EEPROM.write(add+_size,'\0');   //Add termination null character for String Data
-  EEPROM.commit();
+  return true;
 }
 
 
-// eeprom functions
-String Taco::read_String(char add){
-  int i;
-  char data[100]; //Max 100 Bytes
-  int len=0;
-  unsigned char k;
-  k=EEPROM.read(add);
-  while(k != '\0' && len<500)   //Read until null character
-  {
-    k=EEPROM.read(add+len);
-    data[len]=k;
-    len++;
+
+
+
+
+#define TACO_STR(x) #x
+#define TACO_XSTR(x) TACO_STR(x)
+
+//page of the live view: it asks for frames at a rate and plots them
+static const char TACO_LIVE_PAGE[] PROGMEM = R"rawliteral(<!DOCTYPE html>
+<html><head><meta name="viewport" content="width=device-width, initial-scale=1">
+<title>Taco - live</title>
+<style>body{font-family:Arial;background:#222;color:#ddd}canvas{width:100%;height:60vh;background:#000}</style>
+</head><body>
+<p>Frames/s <input id="rate" type="number" value="20" min="1" max="50" onchange="ws.send(this.value)"> <span id="stats"></span></p>
+<canvas id="plot" width="800" height="400"></canvas>
+<p id="pins"></p>
+<script>
+var layout = {analog: [], digital: []}, history = [], N = 200;
+var colors = ["#e44", "#4e4", "#44e", "#ee4", "#e4e", "#4ee", "#fa0", "#0af"];
+var ws = new WebSocket("ws://" + location.hostname + ":" + )rawliteral" TACO_XSTR(TACO_LIVE_PORT) R"rawliteral( + "/");
+ws.binaryType = "arraybuffer";
+ws.onopen = function(){ ws.send(document.getElementById("rate").value); };
+ws.onmessage = function(e){
+  if(typeof e.data == "string"){
+    layout = JSON.parse(e.data); history = [];
+    document.getElementById("pins").textContent = "analog " + layout.analog + " / digital " + layout.digital;
+    return;
+  }
+  var v = new DataView(e.data), na = v.getUint8(1), nd = v.getUint8(2), p = 20, row = [];
+  for(var i = 0; i < na; i++, p += 6) row.push(v.getUint16(p, true) / 4095);
+  for(var i = 0; i < nd; i++, p++) row.push(v.getUint8(p) / 255);
+  history.push(row); if(history.length > N) history.shift();
+  document.getElementById("stats").textContent = "seq " + v.getUint32(4, true) + "  packets/s " + v.getUint16(16, true)
+    + "  hosts " + v.getUint8(3) + "  samples " + v.getUint16(18, true) + "  heap " + v.getUint32(12, true);
+  draw();
+};
+function draw(){
+  var c = document.getElementById("plot"), g = c.getContext("2d");
+  g.clearRect(0, 0, c.width, c.height);
+  if(!history.length) return;
+  for(var ch = 0; ch < history[0].length; ch++){
+    g.strokeStyle = colors[ch % colors.length]; g.beginPath();
+    for(var i = 0; i < history.length; i++){
+      var x = i * c.width / N, y = c.height * (1 - history[i][ch]);
+      if(i) g.lineTo(x, y); else g.moveTo(x, y);
+    }
+    g.stroke();
   }
-  data[len]='\0';
-  return String(data);
 }
+</script></body></html>)rawliteral";
 
 
-/////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////
 //
-// SSDD1306 display functions
+// server
 //
-//////////////////////////////////////////////////
-
-struct my_monitor
-{
-   Adafruit_SSD1306 d;
-   int pin;
-};
+/////////////////////////////////////////////////////////////////////////////////////////
 
-void Taco::createSSD1306(Adafruit_SSD1306& ssd1306){
+void Taco::beginServer(WebServer& s, bool background) {
+
+  //firmware updates, only with the user and password
+  s.on("/update", HTTP_GET, [this, &s](){
+    boundClient(s);
+    if(!s.authenticate(otaUser, otaPassword)) return s.requestAuthentication();
+    s.send(200, "text/html", updateform);
+  });
+  s.on("/serverIndex", HTTP_GET, [this, &s](){
+    boundClient(s);
+    if(!s.authenticate(otaUser, otaPassword)) return s.requestAuthentication();
+    s.send(200, "text/html", updateform);
+  });
+  s.on("/update", HTTP_POST, [this, &s](){
+    boundClient(s);
+    if(!s.authenticate(otaUser, otaPassword)) return s.requestAuthentication();
+    s.sendHeader("Connection", "close");
+    s.sendHeader("Access-Control-Allow-Origin", "*");
+    if(otaError[0]) s.send(500, "text/plain", otaError);
+    else s.send(200, "text/plain", "OK, rebooting\r\n");
+  }, [this, &s](){
+    handleOtaUpload(s);
+  });
+
+  //memory of the board, and what the loop spent its time on
+  s.on("/api/stats", HTTP_GET, [this, &s](){
+    handleApiStats(s);
+  });
+  s.on("/api/trace", HTTP_GET, [this, &s](){
+    handleApiTrace(s);
+  });
+
+  //the whole configuration as JSON
+  s.on("/api/config", HTTP_GET, [this, &s](){
+    handleApiGet(s);
+  });
+  s.on("/api/config", HTTP_POST, [this, &s](){
+    handleApiPost(s);
+  });
+
+  //live view of the pins
+  s.on("/live", [&s](){
+    boundClient(s);
+    s.send_P(200, "text/html", TACO_LIVE_PAGE);
+  });
+  beginLive();
+
+  //Server start, once every route is there: the task can serve a request at once
+  s.begin();
+  Serial.println("Web Server started");
+  webStarted = true;
+  if(mdnsStarted) MDNS.addService("http", "tcp", 80);
 
-  display = ssd1306;
-  //ssd1306.begin();
+  //its own task, so a slow browser never stalls the loop
+  if(background && webTaskHandle == NULL){
+    webServer = &s;
+    xTaskCreatePinnedToCore(webTask, "taco_web", 8192, this, tskIDLE_PRIORITY, &webTaskHandle, 0);
+  }
+}
 
-  Serial.println("INIT OLED");
-  //delay(20);
-  // SSD1306_SWITCHCAPVCC = generate display voltage from 3.3V internally
-  if(!display.begin(SSD1306_SWITCHCAPVCC, 0x3C)) { // Address 0x3C for 128x32
-    Serial.println(F("SSD1306 allocation failed"));
-    for(;;); // Don't proceed, loop forever
+//the server task looks for clients at a fixed interval, at the lowest
+//priority: the loop never waits for it
+void Taco::webTask(void* param){
+  Taco* taco = (Taco*)param;
+  TacoAlloc::setTask(TACO_SUB_WEB);
+  for(;;){
+    {
+      TACO_TRACE_SCOPE("handleClient");
+      taco->webServer->handleClient();
+    }
+    vTaskDelay(pdMS_TO_TICKS(TACO_WEB_POLL_INTERVAL));
   }
-  Serial.println("OLED ok");
+}
 
-  oled = true;
-  // Clear the buffer
-  display.clearDisplay();
+//the socket of the request waits TACO_WEB_CLIENT_TIMEOUT s at most for the
+//client, when reading the body or sending the answer
+void Taco::boundClient(WebServer& s){
+  s.client().setTimeout(TACO_WEB_CLIENT_TIMEOUT);
+}
 
-  //init a few things of the clearDisplaydisplay.setTextSize(1);             // Normal 1:1 pixel scale
-  display.setTextColor(SSD1306_WHITE);        // Draw white text
+void Taco::handleRoot(WebServer& s){
+  boundClient(s);
+  Serial.println("*** he llegado aqui tras /");
 
-  //print a few things
-  SSD1306_write(20, 10, "hola, I'm taco");
-  delay(1000);
-  display.clearDisplay();
-  display.display();
+  //Browse information received
+  for(int i=0; i<s.args(); i++) {
+    Serial.println(s.arg(i));
+  }
 
-  delay(500);
+  //the changes are made by update(), in the loop, as the server can be in its task
+  if (s.hasArg("mode_ap")) {            //when it is STA mode and we want to change to access point
+    if (webAction == TACO_WEB_NONE) webAction = TACO_WEB_AP;
+  }
+  else if (s.hasArg("ssid_name")) {     //when it is access point and we want to change to STA
+    if (!handleSsid(s)) return;
+  }
 
+  s.send(200, "text/html", SendHTML()); //refresh the website or the browser will show an empty page
 }
 
-//returns if there is oled
-bool Taco::hasOled(){
-  return oled;
+//GET /api/config: the configuration, written in a buffer on the stack
+void Taco::handleApiGet(WebServer& s){
+  boundClient(s);
+  char json[TACO_JSON_SIZE];
+  int length = configToJson(json, sizeof(json));
+  if(length < 0){
+    returnFail(s, "TOO BIG");
+    return;
+  }
+  s.sendHeader("Access-Control-Allow-Origin", "*");
+  s.setContentLength(length);
+  s.send(200, "application/json", "");
+  s.sendContent_P(json, length);
 }
 
-void Taco::SSD1306_clear(){
-  // Clear the buffer
-  display.clearDisplay();
-  display.display();
+//GET /api/stats: memory of the board
+void Taco::handleApiStats(WebServer& s){
+  boundClient(s);
+  char json[TACO_STATS_JSON_SIZE];
+  int length = statsToJson(json, sizeof(json));
+  if(length < 0){
+    returnFail(s, "TOO BIG");
+    return;
+  }
+  s.sendHeader("Access-Control-Allow-Origin", "*");
+  s.setContentLength(length);
+  s.send(200, "application/json", "");
+  s.sendContent_P(json, length);
 }
 
-void Taco::SSD1306_write(int x, int y, const char* text){
-  display.setTextSize(1);
-  display.setCursor(x,y);             // Start at top-left corner
-  display.println(F(text));
-  display.display();
+#if TACO_TRACE
+//the trace goes to the server in pieces, or straight to a Print
+struct TacoTraceChunk
+{
+  WebServer* server;
+  char buffer[1024];
+  int length;
+};
+
+static void traceToServer(const char* text, int length, void* context){
+  TacoTraceChunk* c = (TacoTraceChunk*)context;
+  if(c->length + length > (int)sizeof(c->buffer)){
+    c->server->sendContent_P(c->buffer, c->length);
+    c->length = 0;
+  }
+  memcpy(c->buffer + c->length, text, length);
+  c->length += length;
 }
 
-void Taco::SSD1306_writeInt(int x, int y, int value){
-  display.setTextSize(1);
-  display.setCursor(x,y);             // Start at top-left corner
-  display.println(value);
-  display.display();
+static void traceToPrint(const char* text, int length, void* context){
+  ((Print*)context)->write((const uint8_t*)text, length);
+}
+#endif
+
+//GET /api/trace: the last spans as Chrome trace JSON, ?clear=1 starts again
+void Taco::handleApiTrace(WebServer& s){
+  boundClient(s);
+#if TACO_TRACE
+  TacoTraceChunk chunk;
+  chunk.server = &s;
+  chunk.length = 0;
+  s.sendHeader("Access-Control-Allow-Origin", "*");
+  s.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  s.send(200, "application/json", "");
+  TacoTrace::dump(traceToServer, &chunk);
+  if(chunk.length > 0) s.sendContent_P(chunk.buffer, chunk.length);
+  s.sendContent("");
+  if(s.hasArg("clear")) TacoTrace::clear();
+#else
+  returnFail(s, "BUILT WITHOUT TACO_TRACE");
+#endif
 }
 
-void Taco::SSD1306_analog_monitor(int pin){
+void Taco::dumpTrace(Print& out){
+#if TACO_TRACE
+  TacoTrace::dump(traceToPrint, &out);
+#else
+  out.println("{\"traceEvents\":[]}");
+#endif
+}
 
-  if(millis() >= time_1 + INTERVAL_UPDATE_OLED){
-          time_1 +=INTERVAL_UPDATE_OLED;
+//POST /api/config: the settings are checked here and applied by the loop
+void Taco::handleApiPost(WebServer& s){
+  boundClient(s);
+  s.sendHeader("Access-Control-Allow-Origin", "*");
+  if(!s.hasArg("plain")){
+    s.send(400, "application/json", "{\"ok\":false,\"error\":\"no body\"}");
+    return;
+  }
+  const String& body = s.arg("plain");
+  if(body.length() >= TACO_JSON_SIZE){
+    s.send(413, "application/json", "{\"ok\":false,\"error\":\"too big\"}");
+    return;
+  }
+  TacoConfig scratch = conf;
+  const char* error;
+  if(!configFromJson(body.c_str(), body.length(), scratch, false, &error)){
+    char reply[64];
+    snprintf(reply, sizeof(reply), "{\"ok\":false,\"error\":\"%s\"}", error);
+    s.send(400, "application/json", reply);
+    return;
+  }
+  if(webAction != TACO_WEB_NONE){
+    s.send(503, "application/json", "{\"ok\":false,\"error\":\"busy\"}");
+    return;
+  }
+  memcpy(webJson, body.c_str(), body.length() + 1);
+  webJsonLength = body.length();
+  webAction = TACO_WEB_JSON;
+  s.send(200, "application/json", "{\"ok\":true}");
+}
 
-          display.setCursor(0,10);
-          display.println("pin");
-          display.setCursor(25,10);
-          display.println(pin);
-          display.setCursor(45,10);
-          display.println(":");
 
-          //clear lines of the value
-          display.fillRect(65, 10, 25, 10, SSD1306_BLACK);
 
-          display.setCursor(65,10);
-          display.println(analogRead(pin));
-          display.display();
-  }
+/////////////////////////////////////////////////////////////////////////////////////////
+//
+// firmware updates: the upload goes straight to the other app partition, a
+// chunk at a time, and the new firmware is on trial until it is healthy
+//
+/////////////////////////////////////////////////////////////////////////////////////////
+
+static mbedtls_sha256_context otaSha;     //one update at a time
 
+static_assert(EEPROM_CONF_ADDRESS + sizeof(TacoConfig) <= EEPROM_OTA_ADDRESS, "the configuration overlaps the OTA state");
+static_assert(EEPROM_OTA_ADDRESS + sizeof(TacoOtaState) <= EEPROM_SIZE, "the OTA state does not fit in eeprom");
+
+void Taco::otaFail(const char* error){
+  strlcpy(otaError, error, sizeof(otaError));
+  Serial.printf("OTA failed: %s\n", otaError);
+  if(otaRunning) Update.abort();
+  otaRunning = false;
 }
 
-void Taco::SSD1306_digital_monitor(int pin){
-  if(millis() >= time_1 + INTERVAL_UPDATE_OLED){
-          time_1 +=INTERVAL_UPDATE_OLED;
+//called by the server for every chunk of the upload (HTTP_UPLOAD_BUFLEN bytes)
+void Taco::handleOtaUpload(WebServer& s){
+  HTTPUpload& upload = s.upload();
+
+  if(upload.status == UPLOAD_FILE_START){
+    boundClient(s);
+    otaError[0] = 0;
+    otaRunning = false;
+    if(!s.authenticate(otaUser, otaPassword)){    //nothing is written to flash
+      otaFail("UNAUTHORIZED");
+      return;
+    }
+    //optional: the SHA-256 of the image, in hex (/update?sha256=...)
+    strlcpy(otaExpected, s.hasArg("sha256") ? s.arg("sha256").c_str() : "", sizeof(otaExpected));
+    Serial.printf("OTA: %s\n", upload.filename.c_str());
+    mbedtls_sha256_init(&otaSha);
+    mbedtls_sha256_starts_ret(&otaSha, 0);
+    otaRunning = Update.begin(UPDATE_SIZE_UNKNOWN);
+    if(!otaRunning) otaFail(Update.errorString());
+
+  } else if(upload.status == UPLOAD_FILE_WRITE){
+    if(!otaRunning) return;
+    mbedtls_sha256_update_ret(&otaSha, upload.buf, upload.currentSize);
+    if(Update.write(upload.buf, upload.currentSize) != upload.currentSize) otaFail(Update.errorString());
+
+  } else if(upload.status == UPLOAD_FILE_END){
+    if(!otaRunning) return;
+    uint8_t hash[32];
+    char hex[65];
+    mbedtls_sha256_finish_ret(&otaSha, hash);
+    mbedtls_sha256_free(&otaSha);
+    for(int i = 0; i < 32; i++) sprintf(hex + 2 * i, "%02x", hash[i]);
+
+    if(otaExpected[0] && strcasecmp(hex, otaExpected) != 0){
+      otaFail("SHA-256 does not match");
+    } else if(!Update.end(true)){    //checks the image and boots from it next time
+      otaFail(Update.errorString());
+    } else {
+      Serial.printf("OTA: %u bytes, SHA-256 %s\n", upload.totalSize, hex);
+      otaRunning = false;
+      otaDone = true;      //the loop puts the firmware on trial and reboots
+    }
 
-          display.setCursor(0,10);
-          display.println("pin");
-          display.setCursor(25,10);
-          display.println(pin);
-          display.setCursor(45,10);
-          display.println(":");
+  } else if(upload.status == UPLOAD_FILE_ABORTED){
+    otaFail("upload aborted");
+  }
+}
 
-          //clear lines of the value
-          display.fillRect(65, 10, 25, 10, SSD1306_BLACK);
+//the new firmware is on trial: it goes back to the previous one if it boots
+//TACO_OTA_MAX_BOOTS times without being healthy
+void Taco::otaBoot(){
+  EEPROM.get(EEPROM_OTA_ADDRESS, otaState);
+  if(otaState.magic != TACO_OTA_MAGIC) return;
 
-          display.setCursor(65,10);
-          display.println(digitalRead(pin));
-          display.display();
+  otaState.boots++;
+  if(otaState.boots > TACO_OTA_MAX_BOOTS){
+    otaRollback();
+    return;
   }
+  EEPROM.put(EEPROM_OTA_ADDRESS, otaState);
+  EEPROM.commit();
+  otaTrial = true;
+  Serial.printf("New firmware on trial, boot %d\n", otaState.boots);
 }
 
-void Taco::hSlider(int x, int y, int w, int h, int value){
-  //altura slider es h
-  //border
-  display.drawFastHLine(x,y, w, SSD1306_WHITE);
-  //display.display(); // Update screen with each newly-drawn line
-  display.drawFastHLine(x,y+h, w, SSD1306_WHITE);
-  //display.display(); // Update screen with each newly-drawn line
-  display.drawFastVLine(x,y, h, SSD1306_WHITE);
-  //display.display();
-  display.drawFastVLine(x+w,y, h, SSD1306_WHITE);
-  //display.display();
+//update(): a new firmware is confirmed when it is healthy after
+//TACO_OTA_HEALTH_TIME, or rolled back after TACO_OTA_TRIAL_TIME
+void Taco::updateOta(){
+  if(otaDone){
+    otaDone = false;
+    const esp_partition_t* running = esp_ota_get_running_partition();
+    otaState.magic = TACO_OTA_MAGIC;
+    otaState.previous = running ? running->address : 0;
+    otaState.boots = 0;
+    EEPROM.put(EEPROM_OTA_ADDRESS, otaState);
+    EEPROM.commit();
+    delay(500);    //the answer leaves
+    shouldReboot = true;
+    return;
+  }
 
-  //value
-  for(int i=0; i<value; i+=1) {
-    display.drawFastVLine(x+i,y, h, SSD1306_WHITE);
+  if(!otaTrial || millis() < TACO_OTA_HEALTH_TIME) return;
+  //by default healthy is having a network: the wifi or our access point
+  bool healthy = accesspoint ? APconnected : WiFi.status() == WL_CONNECTED;
+  if(healthCheck ? healthCheck() : healthy){
+    confirmFirmware();
+  } else if(millis() > TACO_OTA_TRIAL_TIME){
+    Serial.println("New firmware is not healthy");
+    otaRollback();
+  }
+}
 
+//SHA-256 of the firmware running, the same as sha256sum of its .bin. It reads
+//the whole image from flash, so it is worked out once, the first time it is asked
+const char* Taco::firmwareHash(){
+  if(firmwareSha[0]) return firmwareSha;
+  const esp_partition_t* running = esp_ota_get_running_partition();
+  uint32_t size = ESP.getSketchSize();
+  if(running == NULL || size == 0) return "";
+
+  mbedtls_sha256_context sha;
+  mbedtls_sha256_init(&sha);
+  mbedtls_sha256_starts_ret(&sha, 0);
+  uint8_t buffer[512];
+  for(uint32_t offset = 0; offset < size; offset += sizeof(buffer)){
+    uint32_t n = min((uint32_t)sizeof(buffer), size - offset);
+    if(esp_partition_read(running, offset, buffer, n) != ESP_OK){
+      mbedtls_sha256_free(&sha);
+      return "";
+    }
+    mbedtls_sha256_update_ret(&sha, buffer, n);
   }
- display.display();
+  uint8_t hash[32];
+  mbedtls_sha256_finish_ret(&sha, hash);
+  mbedtls_sha256_free(&sha);
+  for(int i = 0; i < 32; i++) sprintf(firmwareSha + 2 * i, "%02x", hash[i]);
+  return firmwareSha;
 }
 
+void Taco::confirmFirmware(){
+  if(!otaTrial) return;
+  otaTrial = false;
+  otaState.magic = 0;
+  EEPROM.put(EEPROM_OTA_ADDRESS, otaState);
+  EEPROM.commit();
+  Serial.println("New firmware confirmed");
+}
 
-void Taco::SSD1306_stars(){
-  // Draw a single pixel in white
-  //
-  // Draw a single pixel in white
-  for(int i= 0;i<50;i++){
-    display.drawPixel(random(127), random(32), SSD1306_WHITE);
-    display.display();
-    delay(50);
-  }
+void Taco::setHealthCheck(TacoHealthCheck check){
+  healthCheck = check;
+}
+
+void Taco::setOtaCredentials(const char* user, const char* password){
+  strlcpy(otaUser, user, sizeof(otaUser));
+  strlcpy(otaPassword, password, sizeof(otaPassword));
 }
 
+//boot the previous firmware again
+void Taco::otaRollback(){
+  const esp_partition_t* previous = NULL;
+  esp_partition_iterator_t it = esp_partition_find(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_ANY, NULL);
+  for(; it != NULL; it = esp_partition_next(it)){
+    const esp_partition_t* p = esp_partition_get(it);
+    if(p->address == otaState.previous) previous = p;
+  }
+  esp_partition_iterator_release(it);
+
+  otaState.magic = 0;
+  EEPROM.put(EEPROM_OTA_ADDRESS, otaState);
+  EEPROM.commit();
+  otaTrial = false;
 
+  if(previous == NULL || esp_ota_set_boot_partition(previous) != ESP_OK){
+    Serial.println("Rollback failed, keeping the new firmware");
+    return;
+  }
+  Serial.println("Rolling back to the previous firmware");
+  delay(100);
+  ESP.restart();
+}
 
 
+//what the web server asked for
+void Taco::updateWeb(){
+  TACO_TRACE_SCOPE("updateWeb");
+  TacoAllocScope scope(TACO_SUB_CONFIG);
+  if(webAction == TACO_WEB_JSON){
+    configFromJson(webJson, webJsonLength, editConfig(), true);
+    applyConfig();
+    if(webAction == TACO_WEB_JSON) webAction = TACO_WEB_NONE;
+  } else if(webAction == TACO_WEB_AP){
+    webAction = TACO_WEB_NONE;
+    handle_APchange();
+  } else if(webAction == TACO_WEB_SSID){
+    webAction = TACO_WEB_NONE;
+    saveSsid();
+  }
+}
 
 
 /////////////////////////////////////////////////////////////////////////////////////////
 //
-// server
+// live view: a websocket at TACO_LIVE_PORT pushes the pins to /live
 //
 /////////////////////////////////////////////////////////////////////////////////////////
 
-void Taco::beginServer(WebServer& s) {
+void Taco::beginLive(){
+  if(liveTaskHandle != NULL) return;
+  liveServer.begin(TACO_LIVE_PORT);
+  xTaskCreatePinnedToCore(liveTask, "taco_live", 4096, this, tskIDLE_PRIORITY, &liveTaskHandle, 0);
+}
 
-  //Server start
-  s.begin();
-  Serial.println("Web Server started");
+float Taco::liveLoad(){
+  return liveLoadPercent;
 }
 
+//every frame of readPins() is added to the frame of every client, so a
+//client gets the mean, min and max since its last frame (decimation)
+void Taco::liveSample(){
+  if(liveClients == 0) return;
+  int64_t start = esp_timer_get_time();
+
+  portENTER_CRITICAL(&liveMux);
+  for(int c = 0; c < TACO_LIVE_CLIENTS; c++){
+    TacoLiveFrame& f = live[c].frame;
+    if(!live[c].open) continue;
+    f.nAnalog = 0;
+    for(int i = 0; i < conf.nAnalog; i++){
+      if(!(conf.analogMask & (1UL << i)) || a_values[i] < 0) continue;
+      int n = f.nAnalog++;
+      f.pins[n] = conf.analogPins[i];
+      f.sum[n] += a_values[i];
+      if(f.samples == 0 || a_values[i] < f.min[n]) f.min[n] = a_values[i];
+      if(f.samples == 0 || a_values[i] > f.max[n]) f.max[n] = a_values[i];
+    }
+    f.nDigital = 0;
+    for(int i = 0; i < conf.nDigital; i++){
+      if(!(conf.digitalMask & (1UL << i)) || d_values[i] < 0) continue;
+      int n = f.nAnalog + f.nDigital++;
+      f.pins[n] = conf.digitalPins[i];
+      f.sum[n] += d_values[i] ? 255 : 0;
+    }
+    f.samples++;
+  }
+  portEXIT_CRITICAL(&liveMux);
 
-void Taco::handleRoot(WebServer& s){
-  Serial.println("*** he llegado aqui tras /");
+  liveLoopUs += esp_timer_get_time() - start;
+}
 
-  //Browse information received
-  for(int i=0; i<s.args(); i++) {
-    Serial.println(s.arg(i));
+//the websocket handshake: the answer to the key proves we speak websocket
+bool Taco::liveAccept(WiFiClient& client){
+  char key[64] = "";
+  ((Stream&)client).setTimeout(TACO_LIVE_TIMEOUT);     //ms, WiFiClient::setTimeout() takes seconds
+  for(int lines = 0; lines < 32; lines++){
+    String line = client.readStringUntil('\n');
+    line.trim();
+    if(line.length() == 0) break;
+    if(line.startsWith("Sec-WebSocket-Key:")) strncpy(key, line.substring(18).c_str() + (line[18] == ' '), sizeof(key) - 1);
+  }
+  if(key[0] == 0){
+    client.print("HTTP/1.1 400 Bad Request\r\nConnection: close\r\n\r\n");
+    return false;
   }
 
-  s.send(200, "text/html", SendHTML()); //refresh the website or the browser will show an empty page
+  char text[100];
+  snprintf(text, sizeof(text), "%s258EAFA5-E914-47DA-95CA-C5AB0DC85B11", key);
+  uint8_t hash[20];
+  mbedtls_sha1_ret((const uint8_t*)text, strlen(text), hash);
+  uint8_t accept[32];
+  size_t length = 0;
+  mbedtls_base64_encode(accept, sizeof(accept) - 1, &length, hash, sizeof(hash));
+  accept[length] = 0;
+
+  client.printf("HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: %s\r\n\r\n", (const char*)accept);
+  client.setNoDelay(true);
+  return true;
+}
+
+//frames from the browser: the rate it wants (text), ping and close
+void Taco::liveReceive(TacoLiveClient& c){
+  while(c.client.available() >= 2){
+    uint8_t head[2];
+    c.client.read(head, 2);
+    int opcode = head[0] & 0x0F;
+    int length = head[1] & 0x7F;
+    if(length > 125 || !(head[1] & 0x80)){   //only short frames, always masked
+      c.open = false;
+      return;
+    }
+    uint8_t mask[4];
+    char payload[126];
+    if(c.client.readBytes(mask, 4) != 4 || (int)c.client.readBytes((uint8_t*)payload, length) != length){
+      c.open = false;
+      return;
+    }
+    for(int i = 0; i < length; i++) payload[i] ^= mask[i % 4];
+    payload[length] = 0;
+
+    if(opcode == 0x1){
+      c.rate = constrain(atoi(payload), 1, TACO_LIVE_MAX_RATE);
+    } else if(opcode == 0x9){
+      uint8_t pong[2] = {0x8A, (uint8_t)length};
+      c.client.write(pong, 2);
+      c.client.write((const uint8_t*)payload, length);
+    } else if(opcode == 0x8){
+      uint8_t close[2] = {0x88, 0};
+      c.client.write(close, 2);
+      c.open = false;
+      return;
+    }
+  }
+}
+
+//write a websocket frame whose payload starts at data + 4
+static void liveWrite(WiFiClient& client, int opcode, uint8_t* data, int length){
+  uint8_t* head = data + 2;
+  if(length > 125){
+    head = data;
+    head[1] = 126;
+    head[2] = length >> 8;
+    head[3] = length;
+  } else {
+    head[1] = length;
+  }
+  head[0] = 0x80 | opcode;
+  client.write(head, data + 4 - head + length);
+}
 
-  //ESTO DE ABAJO PARA CUANDO TODO FUNCIONE
+//a binary frame with the mean, min and max of every pin since the last one
+void Taco::liveSend(TacoLiveClient& c){
+  TACO_TRACE_SCOPE("liveSend");
+  TacoLiveFrame f;
+  portENTER_CRITICAL(&liveMux);
+  f = c.frame;
+  c.frame.samples = 0;
+  memset(c.frame.sum, 0, sizeof(c.frame.sum));
+  portEXIT_CRITICAL(&liveMux);
+
+  //the pins, as text, when they change
+  uint32_t layout = f.nAnalog << 8 | f.nDigital;
+  for(int i = 0; i < f.nAnalog + f.nDigital; i++) layout = layout * 31 + f.pins[i];
+  if(layout != c.layout){
+    c.layout = layout;
+    uint8_t buffer[4 + TACO_LIVE_FRAME_SIZE];
+    char* text = (char*)buffer + 4;
+    int size = TACO_LIVE_FRAME_SIZE;
+    int n = snprintf(text, size, "{\"analog\":[");
+    for(int i = 0; i < f.nAnalog + f.nDigital; i++){
+      if(i == f.nAnalog) n += snprintf(text + n, size - n, "],\"digital\":[");
+      n += snprintf(text + n, size - n, (i == 0 || i == f.nAnalog) ? "%d" : ",%d", f.pins[i]);
+    }
+    if(f.nAnalog + f.nDigital == f.nAnalog) n += snprintf(text + n, size - n, "],\"digital\":[");
+    n += snprintf(text + n, size - n, "]}");
+    liveWrite(c.client, 0x1, buffer, min(n, size - 1));
+  }
 
-  if (s.hasArg("mode_ap") && s.args()==1) {     //when it is STA mode and we want to change to access point
-      handle_APchange();
-      //send a response
-      s.send(200, "text/html", SendHTML());
+  //the frame, little endian as the browsers
+  uint8_t data[4 + TACO_LIVE_FRAME_SIZE];
+  int n = 4;
+  data[n++] = 1;
+  data[n++] = f.nAnalog;
+  data[n++] = f.nDigital;
+  data[n++] = min(nDests, 255);
+  uint32_t words[3] = {c.seq++, (uint32_t)millis(), ESP.getFreeHeap()};
+  memcpy(data + n, words, 12);
+  n += 12;
+  uint16_t halves[2] = {(uint16_t)min(livePacketRate, 65535UL), f.samples};
+  memcpy(data + n, halves, 4);
+  n += 4;
+  for(int i = 0; i < f.nAnalog; i++){
+    uint16_t v[3] = {(uint16_t)(f.samples ? f.sum[i] / f.samples : 0), f.min[i], f.max[i]};
+    memcpy(data + n, v, 6);
+    n += 6;
+  }
+  for(int i = f.nAnalog; i < f.nAnalog + f.nDigital; i++){
+    data[n++] = f.samples ? f.sum[i] / f.samples : 0;
   }
-  else{
-    if (s.hasArg("ssid_name") && s.args()==3) { //when it is access point and we want to change to STA
-      handleSsid(s);
-      //send a response
-      s.send(200, "text/html", SendHTML());
+  liveWrite(c.client, 0x2, data, n - 4);
+}
+
+//the live task takes new clients and sends every client its frames at its
+//rate, at the lowest priority: the loop never waits for it
+void Taco::liveTask(void* param){
+  Taco* taco = (Taco*)param;
+  TacoAlloc::setTask(TACO_SUB_LIVE);
+  int64_t busy = 0;
+  unsigned long second = millis();
+  unsigned long packets = taco->txPackets;
+  for(;;){
+    vTaskDelay(pdMS_TO_TICKS(TACO_WEB_POLL_INTERVAL));
+    int64_t start = esp_timer_get_time();
+
+    if(taco->liveServer.hasClient()){
+      WiFiClient client = taco->liveServer.available();
+      int free = -1;
+      for(int i = 0; i < TACO_LIVE_CLIENTS; i++){
+        if(!taco->live[i].open) free = i;
+      }
+      if(free >= 0 && taco->liveAccept(client)){
+        TacoLiveClient& c = taco->live[free];
+        c.client = client;
+        c.rate = TACO_LIVE_RATE;
+        c.nextFrame = millis();
+        c.layout = 0;
+        c.seq = 0;
+        memset(&c.frame, 0, sizeof(c.frame));
+        c.open = true;
+        taco->liveClients++;
+      } else {
+        client.stop();
+      }
     }
-    else {
-      s.send(200, "text/html", SendHTML()); //refresh the website or the browser will show an empty page
+
+    for(int i = 0; i < TACO_LIVE_CLIENTS; i++){
+      TacoLiveClient& c = taco->live[i];
+      if(!c.open) continue;
+      if(c.client.connected()) taco->liveReceive(c);
+      else c.open = false;
+      if(c.open && (long)(millis() - c.nextFrame) >= 0){
+        c.nextFrame += 1000 / c.rate;
+        if((long)(millis() - c.nextFrame) > 1000) c.nextFrame = millis();
+        taco->liveSend(c);
+      }
+      if(!c.open){
+        c.client.stop();
+        taco->liveClients--;
+      }
     }
- }
 
+    //percent of a core used by the live view, in the task and in the loop,
+    //and the packets sent, whether the OLED dashboard runs or not
+    busy += esp_timer_get_time() - start;
+    if(millis() - second >= 1000){
+      unsigned long sent = taco->txPackets;
+      taco->livePacketRate = (sent - packets) * 1000 / (millis() - second);
+      packets = sent;
+      taco->liveLoadPercent = (busy + taco->liveLoopUs) / 10000.0f * 1000 / (millis() - second);
+      taco->liveLoopUs = 0;
+      busy = 0;
+      second = millis();
+    }
+  }
 }
 
 
@@ -1052,7 +4860,7 @@ void Taco::handle_APchange() {
     //writing strings at memory. First arg sets a byte address, second the data to store
 
     //clear eeprom first
-    for (int i = 0 ; i < EEPROM_SIZE ; i++) {
+    for (int i = 0 ; i < EEPROM_NETWORK_SIZE ; i++) {
       EEPROM.write(i, 0);
     }
 
@@ -1066,57 +4874,56 @@ void Taco::handle_APchange() {
 
 
 //function for changing from Access Point mode to STA mode  with the HTML Server
-void Taco::handleSsid(WebServer& s)
+//It keeps what the user typed, saveSsid() writes it from the loop
+bool Taco::handleSsid(WebServer& s)
 {
-  //some aux strings to store information typed by user at the webserver
-  String new_ssid;
-  String new_passw;
-  String new_fixed_ip;
-  String new_host_ip;
-  String new_host_port;
-  String new_gateway_ip;
+  if (webAction != TACO_WEB_NONE) return true;   //the last one is not saved yet
 
   //check data and load wifi data
-  if (!s.hasArg("ssid_name")) return returnFail(s, "BAD ARGS");
-  new_ssid = s.arg("ssid_name");
-  Serial.println("New SSID to connect: " + new_ssid);
+  if (!s.hasArg("ssid_name") || !s.hasArg("password_name") || !s.hasArg("host_Port")) {
+    returnFail(s, "BAD ARGS");
+    return false;
+  }
+  strlcpy(web_ssid, s.arg("ssid_name").c_str(), sizeof(web_ssid));
+  Serial.printf("New SSID to connect: %s\n", web_ssid);
 
-  if (!s.hasArg("password_name")) return returnFail(s, "BAD ARGS");
-  new_passw = s.arg("password_name");
-  Serial.println("New passw to connect " + new_passw);
+  strlcpy(web_passw, s.arg("password_name").c_str(), sizeof(web_passw));
+  Serial.printf("New passw to connect %s\n", web_passw);
 
 
   /*
   if (!server.hasArg("fixed_IP")) return returnFail("BAD ARGS");
-  new_fixed_ip = server.arg("fixed_IP");
-  Serial.println("IP at new network  " + new_fixed_ip);
-
-  if (!server.hasArg("host_IP")) return returnFail("BAD ARGS");
-  new_host_ip = server.arg("host_IP");
-  Serial.println("IP of host at new network  " + new_host_ip);
+  web_fixed_ip = server.arg("fixed_IP");
+  Serial.println("IP at new network  " + web_fixed_ip);
 
   if (!server.hasArg("gateway_IP")) return returnFail("BAD ARGS");
-  new_gateway_ip = server.arg("gateway_IP");
-  Serial.println("Gateway IP  " + new_gateway_ip);
+  web_gateway_ip = server.arg("gateway_IP");
+  Serial.println("Gateway IP  " + web_gateway_ip);
   */
-  if (!s.hasArg("host_Port")) return returnFail(s, "BAD ARGS");
-  new_host_port = s.arg("host_Port");
-  Serial.println("OSC port to change  " + new_host_port);
+  strlcpy(web_host_port, s.arg("host_Port").c_str(), sizeof(web_host_port));
+  Serial.printf("OSC port to change  %s\n", web_host_port);
+
+  //optional: the host that gets the OSC at that port
+  strlcpy(web_host_ip, s.hasArg("host_IP") ? s.arg("host_IP").c_str() : "", sizeof(web_host_ip));
+
+  webAction = TACO_WEB_SSID;
+  return true;
+}
 
+//write the new network in eeprom and reboot
+void Taco::saveSsid()
+{
   //LOAD INFORMATION IN EEPROM
   Serial.println();
   Serial.println("writing data in eeprom memory");
 
-  String data = new_ssid;
-
-
   //writing strings in flash memory. First arg sets a byte address, second the data to store
   Serial.print("Writing Data:");
-  Serial.println(data);
+  Serial.println(web_ssid);
 
 
     //clear eeprom first
-    for (int i = 0 ; i < EEPROM_SIZE ; i++) {
+    for (int i = 0 ; i < EEPROM_NETWORK_SIZE ; i++) {
       EEPROM.write(i, 0);
     }
 
@@ -1124,28 +4931,37 @@ void Taco::handleSsid(WebServer& s)
     writeStringMem(0, "1");                   //flag for setting access point OR NOT (0=AP, 1=STA)
 
     address = 2; // as the flag "1" is two bytes long
-    writeStringMem(2, String(new_ssid.length()));           //SSID string length
+    writeStringMem(2, String(strlen(web_ssid)));           //SSID string length
 
     address = 20;       //20 is arbitrary, to leave some space for other flags
-    writeStringMem(address, new_ssid);
+    writeStringMem(address, web_ssid);
 
     address = 86;       //SSIDs can be 32 character long (65 bytes)
-    writeStringMem(address, new_passw);
+    writeStringMem(address, web_passw);
 
     address = 130;       //passw max is 20 char long (41 bytes)
     writeStringMem(address, APssid);                 //IP is 16 bythes long
 
     /*
     address = 170;       //an IP is max 15 char long (31 bytes)
-    writeStringMem(address, new_fixed_ip);
+    writeStringMem(address, web_fixed_ip);
     */
     address = 200;       //an IP is max 15 char long (31 bytes)
-    writeStringMem(address, new_host_port);
+    writeStringMem(address, web_host_port);
     /*
     address = 216;       //an IP is max 15 char long (31 bytes)
-    writeStringMem(address, new_gateway_ip);
+    writeStringMem(address, web_gateway_ip);
     */
 
+  //the host subscribes at its port, saved with the configuration once applied
+  IPAddress hostIP;
+  if (web_host_ip[0] && hostIP.fromString(web_host_ip)) {
+    Serial.printf("IP of host at new network  %s\n", web_host_ip);
+    TacoConfig& c = editConfig();
+    if (setSubscription(c, (uint32_t)hostIP, atoi(web_host_port), "", 0, 1)) addHostTo(c, (uint32_t)hostIP);
+    confSaveRequested = true;
+  }
+
   //We should reboot the esp32 now
   Serial.println();
   Serial.println("data written in eeprom memory");
@@ -1174,7 +4990,9 @@ void Taco::returnOK(WebServer& s){
 
 
 String Taco::SendHTML(){
-  String ptr = "<!DOCTYPE HTML>";
+  String ptr;
+  ptr.reserve(TACO_HTML_SIZE);    //a single allocation for the whole page
+  ptr += "<!DOCTYPE HTML>";
 ptr +="<html>";
 ptr +="<head>";
 ptr +="<meta name = \"viewport\" content = \"width = device-width, initial-scale = 1.0, maximum-scale = 1.0, user-scalable=0\">";
@@ -1218,10 +5036,11 @@ if(accesspoint){                              //html code when access point. it
   ptr +="</P>";
   ptr +="Password<br>";
   ptr +="<INPUT type=\"text\" name=\"password_name\"<BR>";
-  /*
+
   ptr +="</P>";
-  ptr +="IP of the computer you will send OSC<br>";
+  ptr +="IP of the computer you will send OSC (optional)<br>";
   ptr +="<INPUT type=\"text\" name=\"host_IP\"<BR>";
+  /*
 
   ptr +="</P>";
   ptr +="Your IP number in the new Wifi Network<br>";
@@ -1265,9 +5084,9 @@ if(accesspoint){                              //html code when access point. it
   */
   ptr +="Available devices to transmit OSC: ";
   ptr +="<P>";
-  for (int i = 0; i < nServices; ++i) {
+  for (int i = 0; i < nMdnsHosts; ++i) {
       // Print details for each service found
-      ptr +=MDNS.hostname(i) + " (" +  IpAddress2String(MDNS.IP(i)) +") ";
+      ptr +=String(mdnsHosts[i].name) + " (" +  IpAddress2String(IPAddress(mdnsHosts[i].ip)) +") ";
       ptr +=" ";
       ptr +="<INPUT type=\"checkbox\"";
       ptr += " name=\"host" + String(i) + "\"<BR>host to transmit<br>";
@@ -1307,6 +5126,13 @@ if(accesspoint){                              //html code when access point. it
 }
 
 ptr +="</FORM>";
+ptr +="<a href=\"/live\">Live view of the pins</a>";
+ptr +="<P>";
+TacoMemoryStats mem;
+memoryStats(mem);
+ptr +="Free memory: " + String(mem.freeHeap) + " bytes, largest block " + String(mem.largestBlock);
+ptr +=", lowest " + String(mem.minFreeHeap) + " (<a href=\"/api/stats\">details</a>)";
+ptr +="</P>";
 ptr +="</body>";
 ptr +="</html>";
 ptr +=style;
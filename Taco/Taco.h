@@ -28,16 +28,25 @@
 #include <ESPmDNS.h>
 #include <WebServer.h>
 #include "esp_wifi.h"
+#include <esp_now.h>
+#include "esp_timer.h"
 #include "EEPROM.h"
 #include <Wire.h>
+#include "TacoTrace.h"
+#include "TacoAlloc.h"
+#include "TacoPacket.h"
+#include "TacoClock.h"
+#include "TacoSlip.h"
+#include "TacoEspNow.h"
+#include "TacoImuSamples.h"
 
 // ADDONS includes:
 #include <Adafruit_GFX.h>
 #include <Adafruit_SSD1306.h>
 
 ////C++ includes
-#include <list>
 #include <string>
+#include <functional>
 
 using namespace std;
 
@@ -48,8 +57,753 @@ using namespace std;
 
 
 //EEPROM global vars
-#define EEPROM_SIZE 256
+#define EEPROM_SIZE 1024
+#define EEPROM_NETWORK_SIZE 256       //network settings written by the web server
+#define EEPROM_CONF_ADDRESS 256       //runtime configuration saved with /taco/config/save
+#define EEPROM_OTA_ADDRESS 1000       //state of a new firmware on trial
+#define TACO_CONF_MAGIC 0x54434f35    //"TCO5", tells if there is a saved configuration
+
+//pins and destinations
+#define TACO_MAX_PINS 16              //max number of digital (and of analog) pins
+#define TACO_MAX_HOSTS 10             //max number of extra hosts
+#define TACO_MAX_DESTS 24             //max number of destinations (clients + mDNS hosts + extra hosts)
 #define INTERVAL_UPDATE_OLED 250
+#define TACO_OLED_MAX_FPS 20          //max refresh rate of the OLED
+#define TACO_OLED_ADDRESS 0x3C        //I2C address of the SSD1306
+#define TACO_OLED_BUFFER_SIZE 1024    //128x64 pixels
+#define TACO_OLED_I2C_TIMEOUT 20      //ms to wait for an I2C answer
+#define TACO_OLED_PROBE_INTERVAL 1000 //ms between checks of the OLED
+#define TACO_OLED_SPLASH_TIME 1000    //ms showing the splash
+#define TACO_MAX_SENSORS 8            //I2C sensors added with addSensor()
+#define TACO_I2C_MAX_READ 32          //bytes read from a sensor at once
+#define TACO_I2C_MAX_INIT 8           //registers written to start a sensor
+#define TACO_I2C_MAX_VALUES 16        //values sent by a sensor
+#define TACO_IMU_POLL 5               //ms between reads of the IMU FIFO
+#define TACO_IMU_MAX_PER_PACKET 64    //IMU samples in a packet
+#define TACO_MAX_STREAMS 4            //block streams added with addBlockStream()
+#define TACO_BLOCK_RING 4             //blocks of every stream waiting to be sent
+#define TACO_BLOCK_MAX_SIZE 512       //samples in a block
+#define TACO_FRAME_HISTORY 4096       //bytes of recent frames kept for slow destinations
+#define TACO_FRAME_SLOTS 32           //recent frames kept
+#define TACO_RATE_MAX 1000            //default max packets per second of a destination
+#define TACO_RATE_MIN 5               //packets per second a destination never goes under
+#define TACO_RATE_INCREASE 50         //packets per second gained every second without congestion
+#define TACO_RATE_BURST 2             //packets sent at once after a quiet period
+#define TACO_RATE_MAX_BUNDLE 16       //frames bundled in a packet, older ones are dropped
+#define TACO_RATE_BLOCK_US 2000       //endPacket() taking longer means a full TX queue
+#define TACO_RATE_RTT_MARGIN 5000     //us of echo over the min RTT that mean congestion
+#define TACO_ECHO_INTERVAL 1000       //ms between echo requests
+#define TACO_WEB_POLL_INTERVAL 5      //ms between two looks for clients
+#define TACO_WEB_CLIENT_TIMEOUT 2     //s a silent client can hold a request
+#define TACO_HTML_SIZE 4096           //memory reserved for the page of the server
+#define TACO_JSON_SIZE 2048           //max size of the JSON of /api/config
+#define TACO_OTA_MAGIC 0x5441544f     //"TOTA": a new firmware is on trial
+#define TACO_OTA_HEALTH_TIME 10000    //ms a new firmware runs before being confirmed
+#define TACO_OTA_TRIAL_TIME 120000    //ms it has to become healthy, or it is rolled back
+#define TACO_OTA_MAX_BOOTS 3          //boots it has to become healthy
+#ifndef TACO_OTA_USER
+#define TACO_OTA_USER "admin"         //asked for by /update, change it with setOtaCredentials()
+#define TACO_OTA_PASSWORD "admin"
+#endif
+#define TACO_LIVE_PORT 81             //websocket of the live view
+#define TACO_LIVE_CLIENTS 2           //browsers showing the live view at once
+#define TACO_LIVE_RATE 20             //frames per second, until the browser asks for another rate
+#define TACO_LIVE_MAX_RATE 50
+#define TACO_LIVE_TIMEOUT 1000        //ms to wait for the websocket handshake
+#define TACO_LIVE_FRAME_SIZE 256      //bytes of a frame, all the pins fit
+#define TACO_MDNS_TXT_LEN 200         //max length of a text record of the mDNS service
+#define TACO_MAX_DISCOVERY 4          //services looked for with mDNS
+#define TACO_MAX_FOUND 16             //hosts found with mDNS
+#define TACO_MDNS_INTERVAL 30000      //ms between two rounds of discovery
+#define TACO_MDNS_MISSES 2            //rounds a host can miss before it is forgotten
+
+//memory statistics
+#define TACO_MAX_TASK_STATS 8         //tasks whose stack is reported
+#define TACO_STATS_JSON_SIZE 3072     //buffer of /api/stats
+//scheduler of update()
+#define TACO_MAX_JOBS 16              //jobs run by update(), Taco uses 9
+#define TACO_JOB_MAX_DEFER 500        //ms a background job can wait for slack before it runs anyway
+#define TACO_WIFI_RETRY_MIN 1000      //ms before the first attempt to reconnect to the wifi
+#define TACO_WIFI_RETRY_MAX 30000     //the wait doubles after every attempt up to this
+
+#define TACO_FILTER_LEN 32            //address filter of a subscription
+#define TACO_MAX_ADDRESSES 32         //OSC addresses sent that filters can tell apart
+#define TACO_ADDRESS_OTHER (TACO_MAX_ADDRESSES - 1)   //bundles and the rest of addresses
+#define TACO_DASH_BUDGET 500          //default microseconds of dashboard drawing per update()
+#define TACO_DASH_HISTORY 32          //samples of every sparkline
+
+//OSC receive
+#define TACO_RX_BUFFER_SIZE 1024      //biggest datagram we accept, bigger ones are dropped
+#define TACO_MAX_ROUTES 32            //max number of OSC routes
+#define TACO_ROUTE_MAX_LEN 48         //max length of a route pattern
+#define TACO_OSC_MAX_ARGS 16          //max number of arguments of a received message
+#define TACO_OSC_MAX_SEGMENTS 8       //max number of /segments/ of an OSC address
+#define TACO_OSC_MAX_BUNDLE_DEPTH 4   //max nesting of received bundles
+
+//Transports
+
+
+/* Transports */
+enum TacoTransportType
+{
+  TACO_TRANSPORT_UDP = 0,       //wifi, one packet per destination
+  TACO_TRANSPORT_SERIAL = 1,    //SLIP encoded packets through a serial port (OSC 1.1)
+  TACO_TRANSPORT_ESPNOW = 2     //ESP-NOW frames to a gateway Taco
+};
+
+/* JSON written into a buffer of the caller, without any allocation. Commas
+are added between the values of objects and arrays (16 levels at most) */
+class TacoJsonWriter
+{
+  public:
+    TacoJsonWriter(char* buffer, int size);
+    void beginObject();
+    void endObject();
+    void beginArray();
+    void endArray();
+    void key(const char* name);           //the next value belongs to it
+    void addString(const char* str);
+    void addNumber(double v);
+    void addBool(bool v);
+    void addNull();
+    void addIP(uint32_t ip);              //as a string
+    int length();
+    bool overflow();                      //true if it did not fit
+
+  private:
+    void separate();
+    void put(char c);
+    char* _buffer;
+    int _size;
+    int _length = 0;
+    bool _overflow = false;
+    int _depth = 0;
+    uint16_t _hasValues = 0;              //bit i set if level i has a value already
+    bool _afterKey = false;
+};
+
+/* JSON read in place, as it comes: nothing is allocated or copied but the
+strings asked for. The caller walks the document:
+  j.beginObject();
+  while(j.nextKey(key, sizeof(key))){
+    if(strcmp(key, "port") == 0) j.readNumber(port);
+    else j.skip();
+  }
+Any syntax error makes every later call fail, and ok() false */
+class TacoJsonReader
+{
+  public:
+    TacoJsonReader(const char* text, int length);
+    bool beginObject();
+    bool nextKey(char* key, int size);    //false at the end of the object
+    bool beginArray();
+    bool nextItem();                      //false at the end of the array
+    bool readString(char* str, int size); //cut to size
+    bool readNumber(double& v);
+    bool readBool(bool& v);
+    bool readIP(uint32_t& ip);            //a string like "192.168.0.3"
+    bool skip();                          //any value
+    char peek();                          //first char of the next value
+    bool ok();
+
+  private:
+    bool expect(char c);
+    void spaces();
+    const char* _text;
+    int _length;
+    int _pos = 0;
+    bool _ok = true;
+    uint16_t _started = 0;                //bit i set if level i has a value already
+    int _depth = 0;
+};
+
+/* Where the OSC packets go. A transport is a Print, so OSCMessage::send()
+writes the packet into it between beginPacket() and endPacket() */
+class TacoTransport : public Print
+{
+  public:
+    /* start a packet to this host (ignored by point to point transports) */
+    virtual bool beginPacket(const IPAddress& ip, uint16_t port) = 0;
+
+    /* finish and send the packet. Returns false if it could not be sent */
+    virtual bool endPacket() = 0;
+
+    /* true if there is a single receiver, so we do not send one packet per host */
+    virtual bool isPointToPoint() { return false; }
+
+    using Print::write;
+};
+
+/* OSC packets through wifi */
+class TacoUdpTransport : public TacoTransport
+{
+  public:
+    TacoUdpTransport(WiFiUDP& udp);
+    bool beginPacket(const IPAddress& ip, uint16_t port);
+    bool endPacket();
+    size_t write(uint8_t b);
+    size_t write(const uint8_t* buffer, size_t size);
+
+  private:
+    WiFiUDP& _udp;
+};
+
+/* OSC packets through a serial port, SLIP encoded with an END byte at both
+ends of every packet (OSC 1.1). Packets are encoded in a ring buffer that a
+task writes to the port, so sending never waits for the UART: when the ring
+is full the packet is dropped. The encoding and the ring are in TacoSlip.h */
+class TacoSlipTransport : public TacoTransport
+{
+  public:
+    /* open the port and start the writer task */
+    void begin(HardwareSerial& serial, unsigned long baud);
+    bool isStarted();
+
+    bool beginPacket(const IPAddress& ip, uint16_t port);
+    bool endPacket();
+    size_t write(uint8_t b);
+    bool isPointToPoint() { return true; }
+    TaskHandle_t task() { return _task; }   //its writer task, NULL before begin()
+
+    /* decode the bytes received so far. Returns the length of a complete packet
+    and points packet to it, or 0 if there is none yet */
+    int receive(const uint8_t*& packet);
+
+    unsigned long dropped();      //packets that did not fit in the ring
+
+  private:
+    static void writerTask(void* param);
+
+    HardwareSerial* _serial = NULL;
+    TaskHandle_t _task = NULL;
+    TacoSlipEncoder _encoder;
+    TacoSlipDecoder _decoder;
+};
+
+/* OSC packets through ESP-NOW, without joining any network.
+A node sends every packet in a frame (max 250 bytes) to a gateway Taco, which
+forwards the frames it receives to its hosts grouped in bundles. The frames
+and the queue of the gateway are in TacoEspNow.h */
+class TacoEspNowTransport : public TacoTransport
+{
+  public:
+    /* node: send to the gateway with this mac (NULL = broadcast) on this wifi channel */
+    bool beginNode(const uint8_t* gatewayMac, int channel);
+
+    /* gateway: receive the frames of the nodes */
+    bool beginGateway();
+
+    bool isStarted();
+    bool isGateway();
+
+    bool beginPacket(const IPAddress& ip, uint16_t port);
+    bool endPacket();
+    size_t write(uint8_t b);
+    bool isPointToPoint() { return true; }
+
+    /* gateway: next received frame, or 0 if there is none */
+    int receive(const uint8_t*& frame);
+
+    unsigned long dropped = 0;    //frames that could not be sent or queued
+
+  private:
+    bool init();
+    static void onReceive(const uint8_t* mac, const uint8_t* data, int len);
+    static TacoEspNowTransport* gateway;    //who gets the frames of the callback
+
+    bool _started = false;
+    bool _gateway = false;
+    uint8_t _peer[ESP_NOW_ETH_ALEN];
+
+    TacoEspNowFrame _frame;                 //frame being written
+    TacoEspNowQueue _queue;                 //filled by the wifi task, read by the loop
+};
+
+/* A received OSC message. It does not copy anything: it points to the receive
+buffer, so it is only valid inside the handler it is passed to. */
+class TacoOSCMessage
+{
+  public:
+    /* OSC address of the message */
+    const char* address();
+
+    /* number of arguments */
+    int size();
+
+    /* type tag of argument i ('i', 'f', 's', 'b'...) or 0 if it does not exist */
+    char getType(int i);
+    bool isInt(int i);
+    bool isFloat(int i);
+    bool isString(int i);
+    bool isBlob(int i);
+
+    /* numeric arguments are converted between int and float if necessary */
+    int32_t getInt(int i);
+    float getFloat(int i);
+
+    /* string argument or "" */
+    const char* getString(int i);
+
+    /* blob argument and its length in bytes, or NULL */
+    const uint8_t* getBlob(int i, int& len);
+
+    /* 64 bit int argument (i, h or t), 0 for other types */
+    int64_t getInt64(int i);
+
+    /* timetag of the bundle containing the message (1 = immediately) */
+    uint64_t getTimeTag();
+
+    /* esp_timer_get_time() when the packet was received */
+    int64_t receiveTime();
+
+    /* who sent the message */
+    IPAddress remoteIP();
+    uint16_t remotePort();
+
+  private:
+    friend class Taco;
+    bool parse(const uint8_t* data, int len);   //validate and index a message, no heap used
+
+    const uint8_t* _data = NULL;
+    const char* _address = "";
+    const char* _types = "";                  //type tags without the leading ','
+    int _nArgs = 0;
+    uint16_t _argOffset[TACO_OSC_MAX_ARGS];   //where every argument starts inside _data
+    uint64_t _timetag = 1;
+    IPAddress _remoteIP;
+    uint16_t _remotePort = 0;
+    TacoTransport* _transport = NULL;         //where it came from, to answer
+    int64_t _rxTime = 0;                      //local microseconds at reception
+};
+
+/* How frames are sent */
+enum TacoSendMode
+{
+  TACO_SEND_UNICAST = 0,      //one packet to every destination
+  TACO_SEND_MULTICAST = 1,    //one packet to a multicast group
+  TACO_SEND_BROADCAST = 2     //one packet to the subnet broadcast address
+};
+
+//OLED dashboard
+enum TacoDashStyle
+{
+  TACO_DASH_OFF = 0,          //no dashboard
+  TACO_DASH_BARS = 1,         //a vertical bar per pin
+  TACO_DASH_SPARKLINES = 2    //the recent values of every pin
+};
+
+//how the IMU samples are sent
+enum TacoImuPacking
+{
+  TACO_IMU_BLOB = 0,          //a message with a blob of N samples
+  TACO_IMU_BUNDLE = 1         //a bundle of N messages of floats
+};
+
+//samples of a block stream
+enum TacoBlockFormat
+{
+  TACO_BLOCK_INT16 = 0,       //signed 16 bit, little endian
+  TACO_BLOCK_FLOAT32 = 1      //32 bit float, little endian
+};
+
+//what every frame carries to know its order and time
+enum TacoFrameHeader
+{
+  TACO_HEADER_NONE = 0,       //nothing
+  TACO_HEADER_ARGS = 1,       //two more arguments: i sequence number, h microseconds
+  TACO_HEADER_BUNDLE = 2      //a bundle with the time as timetag and /taco/frame i sequence number
+};
+
+enum TacoWebAction
+{
+  TACO_WEB_NONE = 0,
+  TACO_WEB_AP = 1,            //go back to access point
+  TACO_WEB_SSID = 2,          //connect to the wifi typed in the form
+  TACO_WEB_JSON = 3           //settings posted to /api/config
+};
+
+/* Bytes of the stack of a task never used since it started */
+struct TacoTaskStats
+{
+  const char* name;
+  uint32_t stackFree;
+};
+
+/* Memory of the board, filled by Taco::memoryStats() */
+struct TacoMemoryStats
+{
+  uint32_t freeHeap;                  //internal RAM
+  uint32_t minFreeHeap;               //lowest since boot
+  uint32_t largestBlock;              //biggest allocation that can succeed now
+  uint32_t freeBlocks;                //pieces the free heap is split in
+  float fragmentation;                //percent of the free heap out of the largest block
+  unsigned long frames;               //packets sent since boot
+  TacoTaskStats tasks[TACO_MAX_TASK_STATS];
+  int nTasks;
+  uint32_t allocs[TACO_SUB_COUNT];    //operator new calls (0 without TACO_ALLOC_STATS)
+  uint32_t frees[TACO_SUB_COUNT];     //operator delete calls
+};
+
+/* A service looked for with mDNS, without underscores ("osc", "udp") */
+struct TacoDiscoveryService
+{
+  char service[16];
+  char proto[8];
+};
+
+/* A host found with mDNS */
+struct TacoFoundHost
+{
+  uint32_t ip;
+  uint16_t port;              //of its service, 0 = the udp port of Taco
+  uint8_t misses;             //rounds of discovery it did not answer
+  char name[32];
+};
+
+/* Saved in eeprom while a new firmware is on trial */
+struct TacoOtaState
+{
+  uint32_t magic;             //TACO_OTA_MAGIC while on trial
+  uint32_t previous;          //flash address of the firmware to go back to
+  uint8_t boots;              //boots without being confirmed
+};
+
+/* Priorities of the jobs of update() */
+enum TacoJobPriority
+{
+  TACO_JOB_STREAM = 0,        //run whenever they are due, first
+  TACO_JOB_CONTROL = 1,       //run whenever they are due, after the stream jobs
+  TACO_JOB_BACKGROUND = 2     //run only if their mean run time fits before the next stream job is due
+};
+
+typedef std::function<void()> TacoJobHandler;
+
+/* A job run by update() every period, see Taco::addJob() */
+struct TacoJob
+{
+  const char* name;
+  TacoJobHandler run;
+  uint32_t period;            //us, 0 = every update()
+  uint8_t priority;
+  uint32_t budget;            //us it should take at most
+  uint32_t next;              //micros() when it is due
+  uint32_t lastRun;           //micros() when it ran
+  bool enabled;
+  bool waiting;               //background job waiting for slack
+  //statistics
+  uint32_t runs;
+  uint32_t misses;            //ran a whole period late (or waited TACO_JOB_MAX_DEFER for slack)
+  uint32_t overruns;          //took longer than its budget
+  uint32_t deferred;          //times a background job had to wait for slack
+  uint32_t maxTime;           //us, the longest run
+  uint32_t meanTime;          //us, mean of the last runs: what has to fit in the slack
+};
+
+/* Is the new firmware working? (see setHealthCheck()) */
+typedef std::function<bool()> TacoHealthCheck;
+
+/* Mean, min and max of every pin since the last frame sent to a browser */
+struct TacoLiveFrame
+{
+  uint8_t nAnalog;
+  uint8_t nDigital;
+  uint16_t samples;
+  uint8_t pins[TACO_MAX_PINS * 2];      //analog pins, then digital pins
+  uint32_t sum[TACO_MAX_PINS * 2];
+  uint16_t min[TACO_MAX_PINS];
+  uint16_t max[TACO_MAX_PINS];
+};
+
+struct TacoLiveClient
+{
+  WiFiClient client;
+  bool open = false;
+  uint16_t rate;              //frames per second
+  unsigned long nextFrame;    //ms
+  uint32_t layout;            //pins the browser knows
+  uint32_t seq;
+  TacoLiveFrame frame;        //filled by the loop
+};
+
+/* Where a destination comes from */
+enum TacoDestSource
+{
+  TACO_DEST_AP_CLIENT = 0,    //client of our access point
+  TACO_DEST_MDNS = 1,         //found with mDNS
+  TACO_DEST_HOST = 2          //extra host
+};
+
+/* Congestion control of a destination (see setRateControl()) */
+struct TacoDestRate
+{
+  float rate;                 //packets per second allowed now
+  float tokens;               //packets that can be sent now
+  uint32_t nextFrame;         //first recent frame not sent yet
+  int64_t lastRefill;         //us
+  int64_t lastBackOff;        //us
+  int64_t echoSent;           //us, 0 if no echo is waiting
+  uint32_t rtt;               //us of the last echo
+  uint32_t minRtt;            //us, 0 until the first echo
+  unsigned long backOffs;     //congestion events
+  unsigned long dropped;      //frames never sent to it
+};
+
+/* A host we send to */
+struct TacoDest
+{
+  IPAddress ip;
+  uint8_t source;
+  bool fallback;              //gets unicast packets when we send to a group
+  uint16_t port;              //0 = the udp port of Taco
+  int8_t sub;                 //its subscription in conf.subs, -1 = none
+  uint32_t mask;              //bit i set if it gets address i of the address table
+  uint8_t decimation;         //1 of every n messages of every address
+  float maxRate;              //packets per second of every address, 0 = no limit
+  uint32_t lastSent[TACO_MAX_ADDRESSES];  //us, of every address
+  TacoDestRate rate;          //kept when the table is rebuilt
+};
+
+/* What a host wants to get: saved with the configuration */
+struct TacoSubscription
+{
+  uint32_t ip;
+  uint16_t port;              //0 = the udp port of Taco
+  uint16_t maxRate;           //packets per second, 0 = no limit
+  uint8_t decimation;         //1 of every n messages of every address, 0 or 1 = all
+  char filter[TACO_FILTER_LEN];   //addresses separated by spaces, "" = all
+};
+
+/* A frame kept in the recent frames, as a bundle element (size and message) */
+struct TacoFrameSlot
+{
+  uint16_t offset;
+  uint16_t length;
+  uint8_t address;            //in the address table
+  uint32_t seq;               //number of the message of its address
+};
+
+/* Runtime configuration. It can be changed from the hosts with /taco/config/...
+messages and saved to the eeprom, so it has to stay a plain struct */
+struct TacoConfig
+{
+  uint32_t magic = TACO_CONF_MAGIC;
+  uint32_t samplePeriod = 0;              //microseconds between frames, 0 = every readPins()
+  uint32_t digitalMask = 0xFFFFFFFF;      //bit i enables digital pin i
+  uint32_t analogMask = 0xFFFFFFFF;       //bit i enables analog pin i
+  uint8_t nDigital = 0;
+  uint8_t nAnalog = 0;
+  uint8_t digitalPins[TACO_MAX_PINS] = {};
+  uint8_t analogPins[TACO_MAX_PINS] = {};
+  uint16_t deadband[TACO_MAX_PINS] = {};  //min change of analog pin i to be a new value
+  uint16_t udpPort = 0;
+  uint8_t nHosts = 0;                     //extra hosts
+  uint32_t hosts[TACO_MAX_HOSTS] = {};
+  uint8_t sendMode = TACO_SEND_UNICAST;
+  uint32_t group = 0;                     //multicast group
+  uint8_t nFallback = 0;                  //hosts getting unicast in multicast or broadcast mode
+  uint32_t fallback[TACO_MAX_HOSTS] = {};
+  uint8_t transport = TACO_TRANSPORT_UDP;
+  uint8_t frameHeader = TACO_HEADER_NONE;
+  uint8_t nSubs = 0;
+  TacoSubscription subs[TACO_MAX_HOSTS];
+};
+
+/* Function called when a received message matches a route */
+typedef std::function<void(TacoOSCMessage& msg)> TacoOSCHandler;
+
+/* A route is compiled once when it is registered: the pattern is split in
+segments and every literal segment is hashed, so matching a packet does not
+need any string parsing */
+struct TacoRoute
+{
+  char pattern[TACO_ROUTE_MAX_LEN];
+  uint8_t nSegments;
+  uint8_t segOffset[TACO_OSC_MAX_SEGMENTS];
+  uint8_t segLength[TACO_OSC_MAX_SEGMENTS];
+  uint32_t segHash[TACO_OSC_MAX_SEGMENTS];
+  uint8_t wildcards;                  //bit i set if segment i is '*'
+  TacoOSCHandler handler;
+};
+
+
+/* An I2C sensor read by Taco. Every frame reads `length` consecutive registers
+from `firstRegister` in a single transaction, and the values are sent to
+`oscAddress` as floats. The reads are made by the background I2C task, so the
+loop never waits for the bus.
+By default every pair of bytes is a big endian signed int (like most IMUs).
+Other sensors can override init() and decode():
+  class MySensor : public TacoI2CSensor {
+    public:
+      MySensor() : TacoI2CSensor(0x29, 0x14, 12, "/tof", 50) {}
+      int decode(const uint8_t* data, int length, float* values) { ... return n; }
+  }; */
+class TacoI2CSensor
+{
+  public:
+    TacoI2CSensor(uint8_t address, uint8_t firstRegister, uint8_t length, const char* oscAddress, float rate);
+    virtual ~TacoI2CSensor() {}
+
+    /* Register written when the sensor starts (or is plugged again), like
+    waking it up or choosing its range */
+    bool addInitRegister(uint8_t reg, uint8_t value);
+
+    /* Start the sensor, false if it does not answer. Called by the I2C task
+    with the bus locked. By default it writes the init registers */
+    virtual bool init(TwoWire& wire);
+
+    /* Convert the bytes read into up to TACO_I2C_MAX_VALUES values, returns how many */
+    virtual int decode(const uint8_t* data, int length, float* values);
+
+    /* Last values decoded */
+    float value(int index);
+    int valueCount();
+
+    /* Frames per second */
+    void setRate(float hz);
+
+    /* Send the values to oscAddress (default true), or only keep them */
+    void setSendOSC(bool send);
+
+    uint8_t address;
+    uint8_t firstRegister;
+    uint8_t length;
+    const char* oscAddress;
+
+  private:
+    friend class Taco;
+    uint8_t initRegs[TACO_I2C_MAX_INIT][2];
+    int nInitRegs = 0;
+    unsigned long period;             //ms between frames
+    unsigned long nextRead = 0;       //millis() of the next frame
+    bool ready = false;               //init() done
+    bool sendOSC = true;
+    uint8_t rx[TACO_I2C_MAX_READ];    //written by the I2C task while fresh is false
+    volatile bool fresh = false;      //rx has a frame for update()
+    float values[TACO_I2C_MAX_VALUES];
+    int nValues = 0;
+    unsigned long overruns = 0;       //frames lost because update() did not take the last one
+    unsigned long errors = 0;         //failed reads
+};
+
+
+/* An IMU of the InvenSense MPU-6050/6500/9250 family (and compatibles) streamed
+at high rates. The sensor stores the samples in its FIFO at `rate` samples per
+second and the I2C task drains it in bursts every TACO_IMU_POLL ms, so no
+sample is lost while the loop is busy. The same task (on the other core) can
+fuse accelerometer and gyroscope into an orientation quaternion (Madgwick).
+update() sends the samples in groups of N:
+  TACO_IMU_BLOB    oscAddress/blob b  with the blob:
+                   uint32 index of the first sample, uint16 samples, uint16 rate (Hz,
+                   of the sensor: 1000 / n, so 300 is sent as 333),
+                   the index counts every sample of the sensor, so its gaps are
+                   the lost samples (a blob can have less than N samples, it
+                   ends before a gap),
+                   and per sample 10 int16 (big endian): accel x y z, gyro x y z
+                   (raw), quaternion w x y z (multiplied by 16384)
+  TACO_IMU_BUNDLE  a bundle of oscAddress f f f f f f f f f f messages:
+                   accel (g), gyro (degrees/s), quaternion w x y z */
+class TacoImu
+{
+  public:
+    TacoImu(uint8_t address = 0x68, float rate = 200, const char* oscAddress = "/imu");
+
+    /* Madgwick fusion on or off, beta is its gain (0.1 is a good start) */
+    void setFusion(bool enabled, float beta = 0.1);
+
+    /* TACO_IMU_BLOB or TACO_IMU_BUNDLE, with samplesPerPacket samples each */
+    void setPacking(int packing, int samplesPerPacket);
+
+    /* Last orientation (w, x, y, z) */
+    float quaternion(int index);
+
+    /* Samples lost because the FIFO or the ring were full */
+    unsigned long lostSamples();
+
+    uint8_t address;
+    float rate;                   //Hz, once started the rate the MPU really samples at
+    const char* oscAddress;
+
+  private:
+    friend class Taco;
+    bool init(TwoWire& wire);
+    void drain(TwoWire& wire);    //read the FIFO into the ring
+    bool writeRegister(TwoWire& wire, uint8_t reg, uint8_t value);
+
+    bool ready = false;
+    unsigned long nextRead = 0;
+    bool fusion = true;
+    TacoMadgwick madgwick;
+    int packing = TACO_IMU_BLOB;
+    int perPacket = 10;
+    TacoImuRing samples;          //written by the I2C task, read by update()
+};
+
+
+/* Blocks of samples at audio rates (a piezo, a microphone...) sent as a single
+OSC blob each, instead of one argument per sample. Every block of blockSize
+samples is sent to oscAddress as a message with a blob:
+  uint32 sequence number, float32 sample rate, uint16 format, uint16 samples
+  (big endian, like OSC) followed by the samples as they are in memory
+  (little endian int16 or float32, see TacoBlockFormat).
+Missing sequence numbers are lost blocks (see TacoBlockReceiver).
+push() can be called from another task or a timer at the sample rate */
+class TacoBlockStream
+{
+  public:
+    TacoBlockStream(const char* oscAddress, int blockSize, float sampleRate, int format = TACO_BLOCK_INT16);
+    ~TacoBlockStream();
+
+    /* Add a sample (int16 streams round it) */
+    void push(float sample);
+
+    /* Blocks lost because update() did not send them in time */
+    unsigned long lostBlocks();
+
+    const char* oscAddress;
+    float sampleRate;
+
+  private:
+    friend class Taco;
+    int format;
+    int blockSize;
+    int sampleBytes;
+    uint8_t* buffer;                        //TACO_BLOCK_RING blocks
+    uint32_t blockSeq[TACO_BLOCK_RING];     //sequence number of every full block
+    volatile int writeBlock = 0;            //block being filled
+    volatile int readBlock = 0;             //oldest full block
+    int writePos = 0;                       //next sample of writeBlock
+    uint32_t produced = 0;                  //blocks filled
+    unsigned long overruns = 0;
+};
+
+/* Receiving side of a TacoBlockStream, for a Taco receiving blocks of another one:
+  TacoBlockReceiver piezo;
+  taco.route("/piezo", [](TacoOSCMessage& msg){
+    const uint8_t* samples = piezo.receive(msg);
+    if(samples) ... piezo.count() samples of piezo.format() ...
+  }); */
+class TacoBlockReceiver
+{
+  public:
+    /* The samples of the block, or NULL if it is not a block */
+    const uint8_t* receive(TacoOSCMessage& msg);
+
+    int count();                  //samples of the last block
+    int format();                 //TACO_BLOCK_INT16 or TACO_BLOCK_FLOAT32
+    float sampleRate();
+    unsigned long received();     //blocks received
+    unsigned long lost();         //blocks missing in the sequence
+    unsigned long errors();       //messages that were not blocks
+
+  private:
+    uint32_t _expected = 0;
+    unsigned long _received = 0;
+    unsigned long _lost = 0;
+    unsigned long _errors = 0;
+    int _count = 0;
+    int _format = TACO_BLOCK_INT16;
+    float _sampleRate = 0;
+};
 
 
 class Taco
@@ -92,12 +846,124 @@ class Taco
     It has to be called before Begin */
     void configureWifi(String net, String pass);
 
+    /* Read all pending OSC packets (messages and bundles) and dispatch them to the routes.
+    It never blocks and it is called by update(), but you can call it more often.
+    Returns the number of packets read */
+    int poll();
+
+    /* Call handler when a received message matches pattern. Patterns are OSC addresses
+    where a segment made of a single star matches any segment. Returns false if the table is full.
+    Example:
+      taco.route("/led", [](TacoOSCMessage& msg){
+        digitalWrite(2, msg.getInt(0));
+      }); */
+    bool route(const char* pattern, TacoOSCHandler handler);
+
     /* Transmit OSC data - a simple float value */
     void send(OSCMessage& msg, float value);
 
     /* Transmit OSC data - an array of float values. You need to specify its size */
     void send(OSCMessage& msg, float *arr, int size);
 
+    /* Transmit OSC data - a message with its arguments already added */
+    void sendMessage(OSCMessage& msg);
+
+    /* How frames are sent: TACO_SEND_UNICAST sends a packet to every host (default),
+    TACO_SEND_MULTICAST and TACO_SEND_BROADCAST send one packet to a multicast group
+    or to the subnet broadcast address, whatever the number of hosts.
+    The hosts can change it with /taco/config/send_mode s [s] ("unicast", "broadcast"
+    or "multicast" and the group) */
+    void setSendMode(int mode);
+
+    /* Opt-in header of the frames of send(), sendMessage() and the sensors, so the
+    receivers can tell lost frames from a quiet sensor and measure the jitter:
+      TACO_HEADER_NONE    nothing (default)
+      TACO_HEADER_ARGS    two more arguments: i sequence number, h microseconds since boot
+      TACO_HEADER_BUNDLE  the message in a bundle with the time as its timetag
+                          and a /taco/frame i message with the sequence number
+    Every OSC address has its own sequence numbers, so a host that subscribed to
+    some addresses (see subscribe()) only sees its own losses.
+    The hosts can change it with /taco/config/header s ("none", "args" or "bundle").
+    tools/taco_monitor.py reports loss, reordering and jitter */
+    void setFrameHeader(int header);
+
+    /* Congestion control: every destination gets at most the packets per second
+    its link can take. A destination backs off (halves its rate) when sending
+    to it fails, when endPacket() blocks (the wifi queue is full) or when the
+    echo round trip grows, and gains rate again while the air is clear (AIMD).
+    The frames a slow destination could not get in time are sent to it together
+    in a bundle, up to TACO_RATE_MAX_BUNDLE frames, so it gets fewer packets with
+    the same data. Hosts have to answer /taco/echo h with the same message
+    (tools/taco_monitor.py --echo does it), without echo the other signals are used */
+    void setRateControl(bool enabled, float maxRate = TACO_RATE_MAX);
+
+    /* Packets per second allowed to a host now, -1 if it is not a destination */
+    float destinationRate(IPAddress host);
+
+    /* What a host gets, instead of everything at the udp port of Taco:
+      port        where it listens, 0 = the udp port of Taco
+      filter      the addresses it wants, separated by spaces ("/imu /piezo"); an address
+                  includes the ones under it ("/imu" includes "/imu/blob"), "" = all
+      maxRate     packets per second of every address at most, 0 = no limit
+      decimation  1 of every n messages of every address
+    The host is added to the hosts if it was not a destination. A visualiser can get
+    30 Hz while an audio engine gets everything from the same board:
+      taco.subscribe(IPAddress(192, 168, 0, 3), 9000, "/imu", 30);
+    The hosts can do it themselves with /taco/config/subscribe i s f i (port, filter,
+    max rate, decimation) and /taco/config/unsubscribe. It is saved with saveConfig() */
+    bool subscribe(IPAddress host, uint16_t port, const char* filter = "", float maxRate = 0, int decimation = 1);
+    void unsubscribe(IPAddress host);
+
+    /* Synchronize the clock of the board with a host running tools/taco_sync_server.py
+    (or a Taco that called beginSyncMaster()), asking for its time every interval seconds
+    through the current transport. Timestamps of the frames and bundle timetags are then
+    in the time of the server, with the drift of the board compensated */
+    void beginSync(IPAddress server, uint16_t port, float interval = 1.0);
+
+    /* Answer the sync requests of other Tacos with the time of this one */
+    void beginSyncMaster();
+
+    /* Microseconds in the time of the server (since boot if not synced yet).
+    Use it to timestamp your samples */
+    int64_t syncedMicros();
+
+    /* True after the first answer of the server */
+    bool isSynced();
+
+    /* Max error of the synced time in microseconds, and drift of the board in ppm */
+    uint32_t syncError();
+    float clockDrift();
+
+    /* Send the OSC packets SLIP encoded through a serial port instead of wifi, for
+    wired operation. High baud rates (2000000 or more) work if your USB-UART does.
+    Taco messages for the serial monitor will show up as broken packets at the
+    receiver, so better use a second port if you can:
+      taco.beginSerialTransport(Serial, 2000000);
+    Packets received through the port are dispatched to the routes too */
+    void beginSerialTransport(HardwareSerial& serial, unsigned long baud);
+
+    /* Send the OSC packets with ESP-NOW to a gateway Taco, without joining a network.
+    Call it instead of begin(). gatewayMac is printed by the gateway at
+    beginEspNowGateway(); NULL broadcasts to any gateway on the channel.
+    Packets have to fit in an ESP-NOW frame (250 bytes) */
+    bool beginEspNowNode(const uint8_t* gatewayMac, int channel);
+
+    /* Receive the ESP-NOW frames of the nodes and forward them to our hosts as
+    bundles. Call it after begin(), nodes have to use the wifi channel of this board */
+    bool beginEspNowGateway();
+
+    /* Choose the transport at runtime: TACO_TRANSPORT_UDP, TACO_TRANSPORT_SERIAL or
+    TACO_TRANSPORT_ESPNOW. Hosts can change it with /taco/config/transport s
+    ("udp", "serial" or "espnow") */
+    void setTransport(int type);
+
+    /* Send to a multicast group, like 239.0.0.1. Hosts have to join the group */
+    void setMulticastGroup(IPAddress group);
+
+    /* Hosts that can not join the group keep receiving unicast packets.
+    A host can ask for it itself sending /taco/config/fallback 1 */
+    void setUnicastFallback(IPAddress ip, bool fallback);
+
     /* Define a list of digital pins to read. It is necessary to define the size if the array with n_pins.
     Example:
       int digital_pins[] = {16, 18, 20, 22};
@@ -114,8 +980,45 @@ class Taco
       ....} */
     void def_analog_pins(int analog_pins[], int n_pins);
 
-    /* Read both lists of analog and digital pins. You should program something inside */
-    void readPins();
+    /* Read both lists of analog and digital pins at the sampling rate.
+    Returns true if a new frame was read and some enabled pin changed more than its deadband,
+    so you can use it to decide when to send:
+      if(taco.readPins()) taco.send(msg, taco.analogValue(0)); */
+    bool readPins();
+
+    /* Last value read from the digital or analog pin number index of the lists (-1 if not read yet) */
+    int digitalValue(int index);
+    int analogValue(int index);
+
+    /* Frames per second read by readPins(), 0 reads every time it is called */
+    void setSampleRate(float hz);
+
+    /* Min change of the analog pin number index to be a new value. index -1 sets all pins */
+    void setDeadband(int index, int value);
+
+    /* Enable or disable pins of the lists: bit i of each mask enables pin i */
+    void setPinMasks(uint32_t digitalMask, uint32_t analogMask);
+
+    /* Save or forget the runtime configuration (pins, sampling rate, deadbands, port, hosts).
+    A saved configuration is loaded at begin(). The hosts can do the same with OSC:
+      /taco/config/rate f                    frames per second
+      /taco/config/deadband i [i]            deadband of all pins or (pin index, deadband)
+      /taco/config/digital_mask i            enabled digital pins
+      /taco/config/analog_mask i             enabled analog pins
+      /taco/config/digital_pins i i ...      new list of digital pins
+      /taco/config/analog_pins i i ...       new list of analog pins
+      /taco/config/port i                    udp port
+      /taco/config/host/add s                add the host with this ip
+      /taco/config/host/remove s             remove the host with this ip
+      /taco/config/host/clear                remove all the extra hosts
+      /taco/config/save                      save the configuration
+      /taco/config/reset                     forget the saved configuration
+      /taco/config/get                       answers /taco/config/state f i i i i
+    Changes are applied by update() between frames. A list with a pin that is not
+    a GPIO (or not an ADC pin for the analog ones) changes nothing, and fails
+    the POST to /api/config */
+    void saveConfig();
+    void resetConfig();
 
     //OLED display functions
     /*Constructor needs to get a reference of the actual display*/
@@ -130,7 +1033,7 @@ class Taco
     /*Clear Display*/
     void SSD1306_clear();
 
-    /*Show a small animation of pixels*/
+    /*Show a small animation of pixels, drawn by update() without stopping the loop*/
     void SSD1306_stars();
 
     /*Display the value of an analog pin on the display*/
@@ -139,12 +1042,125 @@ class Taco
     /*Display the value of digital pin on the display*/
     void SSD1306_digital_monitor(int pin);
 
-    /*Inform if the user has created an OLED object or not*/
+    /*Inform if there is an OLED working. A display that does not answer does
+    not stop the board: it is checked every second and initialised again when
+    it is plugged, meanwhile the OLED functions return at once*/
     bool hasOled();
 
+    /*Show all the enabled pins as bars (TACO_DASH_BARS) or sparklines
+    (TACO_DASH_SPARKLINES), with the packets per second and the number of hosts.
+    It uses the values of readPins() and it is drawn by update() a bit at a time,
+    never more than budgetUs microseconds per call. TACO_DASH_OFF stops it */
+    void SSD1306_dashboard(int style, unsigned long budgetUs = TACO_DASH_BUDGET);
+
+    /*Add an I2C sensor (see TacoI2CSensor). It is read by a background task at
+    its own rate and its values are sent by update(). Up to TACO_MAX_SENSORS.
+    Example:
+      TacoI2CSensor imu(0x68, 0x3B, 14, "/imu/raw", 100);   //MPU6050
+      ... setup() {
+      ...   imu.addInitRegister(0x6B, 0);                     //wake up
+      ...   taco.addSensor(imu);
+      ....} */
+    bool addSensor(TacoI2CSensor& sensor);
+
+    /*Stream an IMU (see TacoImu and the IMU_Stream example). Its FIFO is read
+    in the background and update() sends its samples in packets of N */
+    void addImu(TacoImu& imu);
+
+    /*Send the blocks of a TacoBlockStream as they are filled. Up to TACO_MAX_STREAMS.
+    Example:
+      TacoBlockStream piezo("/piezo", 256, 8000);
+      ... setup() {
+      ...   taco.addBlockStream(piezo);
+      ....}
+      ... at 8 kHz: piezo.push(analogRead(35)); */
+    bool addBlockStream(TacoBlockStream& stream);
+
+    /*The OLED is refreshed in the background (only the parts that changed, 20 times
+    per second at most), sharing the I2C bus with your code. If you use Wire
+    in the loop, lock the bus while you use it:
+      if(taco.lockI2C()){ ...Wire... taco.unlockI2C(); } */
+    bool lockI2C(TickType_t timeout = portMAX_DELAY);
+    void unlockI2C();
+
     //SERVER FUNCTIONS
-    /*Begin a server to configure the board. Receive a reference*/
-    void beginServer(WebServer& s);
+    /*Begin a server to configure the board. Receive a reference.
+    Call server.handleClient() from the loop as before. With background = true
+    it runs instead in its own low priority task on core 0, looking for clients
+    every TACO_WEB_POLL_INTERVAL ms, so a slow browser never stalls the loop: do
+    not call server.handleClient() then. A client that stops answering holds a
+    request TACO_WEB_CLIENT_TIMEOUT s at most.
+    It also serves the configuration as JSON at /api/config: GET returns all the
+    settings (network, port, sample_rate, pins, masks, deadband, hosts, send_mode,
+    group, fallback, transport, header, subscriptions, rate_control, rate_max, and
+    firmware: the SHA-256 of the one running and whether it is on trial) and
+    POST changes the ones in the posted object, for example
+      curl -d '{"sample_rate": 200, "analog_pins": [34, 35], "save": true}' http://192.168.0.1/api/config
+    "network": {"ssid": ..., "password": ...} or {"mode": "ap"} reboots the board*/
+    void beginServer(WebServer& s, bool background = false);
+
+    /* Firmware updates: beginServer() serves /update, where a .bin file is
+    uploaded straight into the other app partition, a chunk at a time. The
+    page and the upload ask for a user and password (HTTP basic
+    authentication, TACO_OTA_USER and TACO_OTA_PASSWORD by default). With
+    /update?sha256=<hex> the SHA-256 of the image is checked before booting it.
+      curl -u admin:admin -F "update=@firmware.bin" "http://192.168.0.1/update?sha256=$(sha256sum firmware.bin | cut -c1-64)"
+    The new firmware is on trial: it is confirmed once it is healthy after
+    TACO_OTA_HEALTH_TIME ms (the wifi is connected or the access point is up,
+    or your own check), and the
+    board goes back to the previous one if it is not healthy in
+    TACO_OTA_TRIAL_TIME ms or boots TACO_OTA_MAX_BOOTS times without it.
+    confirmFirmware() confirms it at once. "firmware" in /api/config tells which
+    one runs and if it is still on trial: tools/taco_fleet.py waits for the
+    trial to end and checks the SHA-256 */
+    void setHealthCheck(TacoHealthCheck check);
+    void confirmFirmware();
+    void setOtaCredentials(const char* user, const char* password);
+
+    /* Percent of a core used by the live view of the pins in the last second.
+    beginServer() serves it at /live: a page that plots the mean, min and max
+    of every pin, pushed by a websocket at TACO_LIVE_PORT at the rate the
+    browser asks for (TACO_LIVE_MAX_RATE frames per second at most) */
+    float liveLoad();
+
+    /* Free heap, largest free block, lowest free heap since boot and the
+    unused stack of the loop and of every Taco task. Built with
+    -DTACO_ALLOC_STATS=1 the operator new and delete calls are counted too,
+    for every subsystem: the ones of a board that keeps running should not
+    grow with the frames sent. The same is served at /api/stats and answered
+    to /taco/stats/get */
+    void memoryStats(TacoMemoryStats& stats);
+
+    /* Built with -DTACO_TRACE=1 the phases of Taco (update, readPins, send,
+    poll, handleClient, oledFlush...) are recorded with the cycles they took in
+    a ring of the last TACO_TRACE_EVENTS. This writes them as Chrome trace
+    JSON, to open in ui.perfetto.dev or chrome://tracing:
+      taco.dumpTrace(Serial);
+    The server gives the same at /api/trace. The sketch can trace its own
+    code with TACO_TRACE_SCOPE("name") */
+    void dumpTrace(Print& out);
+
+    /* update() runs Taco as jobs: every job has a rate (0 = every update()),
+    a priority and a budget in us (overruns are counted, keep it below a
+    period of the stream jobs). Stream jobs run first whenever they are
+    due, then control jobs; background jobs (display, web, discovery, wifi)
+    only run if what they usually take (meanTime) fits before the next
+    periodic stream job, so the streaming keeps its rate. Sketches can add
+    their own:
+      taco.addJob("sample", sample, 1000, TACO_JOB_STREAM, 300);   //1 kHz, 300 us
+    and then loop() only calls taco.update(). It returns the job number or
+    -1 if there are TACO_MAX_JOBS already */
+    int addJob(const char* name, TacoJobHandler run, float rate, TacoJobPriority priority, uint32_t budget);
+    void setJobRate(int job, float rate);
+    void enableJob(int job, bool enabled);
+    int findJob(const char* name);          //-1 if there is none
+
+    /* The jobs and their statistics: runs, deadlines missed, budgets
+    overrun, times a background job waited and longest run. Also in
+    /api/stats */
+    int jobCount();
+    const TacoJob* job(int index);          //NULL if there is none
+    static const char* subsystemName(int subsystem);
 
     /*Callback function to deal with clients asking the server
     Example:
@@ -161,28 +1177,174 @@ class Taco
     */
     void handleRoot(WebServer& s);
 
+    /* Name of the board on the network: <AP name>-<end of the MAC address>, as
+    <name>.local. Every board advertises an _osc._udp service at its OSC port with
+    text records: name, analog and digital (pins), rate (Hz), streams (OSC
+    addresses of sensors, IMU and blocks), header and subscribe (the address to
+    subscribe with). Empty until the network is up */
+    const char* boardName();
+
+    /* In STA mode the hosts are found with mDNS in the background, every
+    TACO_MDNS_INTERVAL ms: the ones advertising an _osc._udp service get the
+    packets at the port of their service. Add other services to look for,
+    without underscores:
+      taco.addDiscoveryService("http", "tcp");
+    Other Taco boards are not taken as hosts */
+    bool addDiscoveryService(const char* service, const char* proto);
+
     //find host by name
     void addHost(String host_name);
 
+    //add a host by ip
+    void addHost(IPAddress ip);
+
 
   private:
     void createAccessPoint();                   //creates the actual AP
     int connectToWiFi(String ssid, String pwd); //connect to wifi with ssid and passw
-    void updateStations();                      //update the connected devices in this network
+    void updateStations();                      //update the connected devices in this network (wifi event task)
+    void updateClients();                       //update(): the devices found go to the destinations
+    uint32_t stationsShared[10];                //handed from the wifi event task to the loop
+    int nStationsShared = 0;
+    volatile bool stationsChanged = false;
+    portMUX_TYPE stationsMux = portMUX_INITIALIZER_UNLOCKED;
     void resetBoard();                          //reset board to access point mode
     void writeStringMem(char add,String data);  //write string in eeprom with add as the address in eeprom
     String read_String(char add);               //read string from eeprom with add as the address in eeprom
     void confSettings();                        //read the board configuration from eeprom
     void discoverMDNShosts();                   //discover hosts connect to this network
-    void browseService(const char * service, const char * proto);  //find devices browsing network services (ftp, samba, etc)
+    void updateDestinations();                  //rebuild the table of hosts we send to
+    TacoDest* addDestination(const IPAddress& ip, uint8_t source);   //NULL if it was there
+    IPAddress broadcastAddress();               //subnet broadcast address
+    //send an encoded packet to all the destinations, address is its index in the address table
+    void sendBuffer(const uint8_t* data, int length, int address = TACO_ADDRESS_OTHER, uint32_t seq = 0);
+    void sendParts(const uint8_t* const* parts, const int* lengths, int nParts, int address = TACO_ADDRESS_OTHER, uint32_t seq = 0);
+    bool wants(TacoDest& d, int address, uint32_t seq);   //is the message for this destination?
+    bool sendPacket(const uint8_t* const* parts, const int* lengths, int nParts, const IPAddress& ip, uint16_t port);
+    void sendFrame();                           //send txPacket with the frame header
+    uint64_t timeTag();                         //now as an OSC timetag
+    void forwardEspNow();                       //gateway: forward the frames of the nodes
+    void sendReply(OSCMessage& msg, TacoOSCMessage& to);  //answer a received message
+    void sendReply(const uint8_t* data, int length, TacoOSCMessage& to);  //the same, already encoded
+
+    //Runtime configuration
+    TacoConfig& editConfig();                   //staged configuration to change
+    void applyConfig();                         //apply the staged configuration between frames
+    void loadConfig();                          //load the saved configuration from eeprom
+    void configRoutes();                        //OSC routes of /taco/config/...
+
+    //discovery of the hosts with mDNS, in its task
+    static void discoveryTask(void* param);
+    void discover();                            //one round, in the task
+    void updateDiscovery();                     //update(): the hosts found go to the destinations
+    TaskHandle_t discoveryTaskHandle = NULL;
+    TacoDiscoveryService discovery[TACO_MAX_DISCOVERY] = {{"osc", "udp"}};
+    int nDiscovery = 1;
+    TacoFoundHost found[TACO_MAX_FOUND];        //owned by the task
+    int nFound = 0;
+    TacoFoundHost foundShared[TACO_MAX_FOUND];  //handed to the loop
+    int nFoundShared = 0;
+    volatile bool foundChanged = false;
+    portMUX_TYPE foundMux = portMUX_INITIALIZER_UNLOCKED;
+    TacoFoundHost mdnsHosts[TACO_MAX_FOUND];    //owned by the loop
+    int nMdnsHosts = 0;
+    void advertise();                           //this board as an _osc._udp service
+    void mdnsTxt();                             //its text records
+    char mdnsName[32] = "";
+    bool mdnsStarted = false;
+    bool mdnsTxtDirty = false;
+    bool webStarted = false;
 
     //SSD1306 OLED display
     void hSlider(int x, int y, int w, int h, int value);    //show a horizontal slider with a value at x,y coordinates with weight w and hight h.
+    void updateStars();                         //draw the next star of SSD1306_stars()
+    void oledLock();                            //lock the display buffer to draw
+    void oledUnlock();                          //unlock it and mark it as changed
+    void oledFlush();                           //send the parts of the buffer that changed
+    bool oledSendRange(int page, int first, int last);  //send some columns of a page
+    bool oledAnswers();                         //is the display on the bus?
+    bool oledInit();                            //initialise the display if it answers
+    void oledProbe();                           //unplugged or plugged again?
+    static void i2cTask(void* param);           //background I2C work (OLED refresh, sensors)
+    void startI2C();                            //start the bus and its task
+    void updateDashboard();                     //draw the next parts of the dashboard
+    void drawDashHeader();                      //packets/s and hosts
+    void drawDashChannel(int channel);          //bar or sparkline of a pin
+    int sampledValue(int pin, bool analog);     //value of readPins() or a new read
 
     //Server
     String SendHTML();                          //function to send the html code of the server
     void handle_APchange();                     //handle function to deal with user changing to Access Point mode with the server
-    void handleSsid(WebServer& s);              //handle function to deal with user changing to Wifi mode with the server
+    bool handleSsid(WebServer& s);              //handle function to deal with user changing to Wifi mode with the server
+    void saveSsid();                            //write the new wifi in eeprom, from the loop
+    void updateWeb();                           //do what the web server asked for
+    static void webTask(void* param);           //serves the clients when the server is in the background
+    static void boundClient(WebServer& s);      //a silent client gives up after TACO_WEB_CLIENT_TIMEOUT
+    WebServer* webServer = NULL;
+    TaskHandle_t webTaskHandle = NULL;
+    volatile uint8_t webAction = TACO_WEB_NONE;     //TacoWebAction waiting for the loop
+
+    //firmware updates
+    void handleOtaUpload(WebServer& s);
+    void otaFail(const char* error);
+    void otaBoot();                             //is a new firmware on trial?
+    void updateOta();                           //update(): its health
+
+    //scheduler of update()
+    void addTacoJobs();                         //the jobs of Taco, from the constructors
+    void runJobs();
+    uint32_t runJob(TacoJob& j, uint32_t now);  //micros() after it ran
+    int32_t streamSlack(uint32_t now);          //us before the next periodic stream job is due
+    TacoJob jobs[TACO_MAX_JOBS];
+    int nJobs = 0;
+
+    //wifi reconnection, a background job
+    void updateWifi();
+    volatile bool wifiLost = false;             //set by the wifi events
+    volatile unsigned long wifiRetryTime = 0;
+    volatile unsigned long wifiRetryWait = TACO_WIFI_RETRY_MIN;
+    void otaRollback();
+    TacoOtaState otaState;
+    TacoHealthCheck healthCheck;
+    bool otaTrial = false;                      //running a new firmware on trial
+    bool otaRunning = false;                    //an upload is being written
+    volatile bool otaDone = false;              //an upload is written, for the loop
+    char otaExpected[65];                       //SHA-256 asked for, in hex
+    const char* firmwareHash();                 //SHA-256 of the running firmware, in hex
+    char firmwareSha[65] = "";
+    char otaError[64] = "";
+    char otaUser[33] = TACO_OTA_USER;
+    char otaPassword[65] = TACO_OTA_PASSWORD;
+
+    //live view
+    void beginLive();
+    void liveSample();                          //adds a frame of readPins() to the frames of the clients
+    bool liveAccept(WiFiClient& client);        //websocket handshake
+    void liveReceive(TacoLiveClient& c);
+    void liveSend(TacoLiveClient& c);
+    static void liveTask(void* param);
+    WiFiServer liveServer;
+    TaskHandle_t liveTaskHandle = NULL;
+    TacoLiveClient live[TACO_LIVE_CLIENTS];
+    volatile int liveClients = 0;
+    portMUX_TYPE liveMux = portMUX_INITIALIZER_UNLOCKED;
+    volatile int64_t liveLoopUs = 0;            //spent by the loop in the last second
+    volatile float liveLoadPercent = 0;
+    unsigned long livePacketRate = 0;           //packets per second, counted by the live task
+    char web_ssid[33];                          //what the user typed at the webserver
+    char web_passw[65];
+    char web_host_ip[16];
+    char web_host_port[8];
+    char webJson[TACO_JSON_SIZE];               //posted to /api/config, for the loop
+    int webJsonLength = 0;
+    void handleApiGet(WebServer& s);
+    void handleApiPost(WebServer& s);
+    void handleApiStats(WebServer& s);
+    void handleApiTrace(WebServer& s);
+    int statsToJson(char* buffer, int size);    //-1 if it does not fit
+    TaskHandle_t loopTaskHandle = NULL;         //the task begin() was called from
+    int configToJson(char* buffer, int size);   //-1 if it does not fit
+    bool configFromJson(const char* text, int length, TacoConfig& c, bool apply, const char** error = NULL);
     void returnFail(WebServer& s, String msg);  //basic html response
     void returnOK(WebServer& s);                //basic html response
 
@@ -190,22 +1352,80 @@ class Taco
     IPAddress string2IP(String strIP);
     String IpAddress2String(const IPAddress& ipAddress);
 
+    //OSC receive
+    void dispatchPacket(const uint8_t* data, int len, uint64_t timetag, int depth); //split bundles
+    void dispatchMessage(TacoOSCMessage& msg);                                     //match the routes
+
     //Wifi objects
     WiFiUDP udp;  //Using Wifi UDP
 
+    //Transports
+    TacoUdpTransport udpTransport{udp};
+    TacoSlipTransport slipTransport;
+    TacoEspNowTransport espNowTransport;
+    TacoPacket txPacket;                        //message being sent
+    TacoBundle espNowBundle;                    //frames of the nodes being forwarded
+    TacoTransport* transport = &udpTransport;   //the one in use
+
+    //addresses sent, so the filters of the subscriptions are bitmasks
+    uint32_t addrHashes[TACO_MAX_ADDRESSES];
+    char addrNames[TACO_MAX_ADDRESSES][TACO_ROUTE_MAX_LEN];
+    uint32_t addrCount[TACO_MAX_ADDRESSES];     //messages sent of every address
+    int nAddresses = 0;
+    int addressIndex(const char* address);      //index in the table, added if it is new
+    uint32_t filterMask(const char* filter);    //bits of the addresses of a filter
+
+    //congestion control
+    bool rateControl = false;
+    float rateMax = TACO_RATE_MAX;
+    uint8_t frameHistory[TACO_FRAME_HISTORY];   //recent frames, for the destinations that are behind
+    TacoFrameSlot frameSlots[TACO_FRAME_SLOTS];
+    uint32_t framesStored = 0;                  //number of the next frame
+    uint32_t oldestFrame = 0;                   //oldest frame still in frameHistory
+    int historyWrite = 0;                       //where the next frame goes
+    unsigned long nextEcho = 0;
+    bool echoRoute = false;
+    void storeFrame(const uint8_t* const* parts, const int* lengths, int nParts, int address, uint32_t seq);
+    void flushDest(TacoDest& d);                //send what a destination did not get, if its rate allows it
+    void backOff(TacoDestRate& r, int64_t now); //congestion: halve the rate
+    void updateRate();                          //update(): echoes and late frames
+
+    //clock sync
+    TacoClock clock;
+    IPAddress syncServer;
+    uint16_t syncPort = 0;
+    unsigned long syncInterval = 0;             //ms between requests, 0 = no sync
+    unsigned long nextSync = 0;
+    bool syncReplyRoute = false;
+    void updateSync();                          //send the sync requests
+
+    //OSC receive
+    uint8_t rxBuffer[TACO_RX_BUFFER_SIZE]; //datagram being parsed
+    TacoOSCMessage rxMsg;                  //reused for every received message
+    TacoRoute routes[TACO_MAX_ROUTES];     //compiled routes
+    int nRoutes = 0;
+    unsigned long rxPackets = 0;           //received datagrams
+    unsigned long rxErrors = 0;            //malformed datagrams
+    unsigned long rxDropped = 0;           //datagrams bigger than rxBuffer
+    unsigned long rxUnhandled = 0;         //messages without route
+    unsigned long txPackets = 0;           //sent packets
+
     //SERVER
     WebServer _server;
 
     //OLED
     Adafruit_SSD1306 display;
 
-    //list of pins
-    int nr_d_pins;      //nr of digital pins used
-    list<int> d_pins;   //list of digital pins
-    list<int> d_values; //list of digital pin values
-    int nr_a_pins;      //nr of analog pins used
-    list<int> a_pins;   //list of analog pins
-    list<int> a_values; //list of analog pin values
+    //runtime configuration (pins, rates, hosts...)
+    TacoConfig conf;            //configuration in use
+    TacoConfig pendingConf;     //changes waiting for the next frame
+    bool confChanged = false;   //pendingConf has to be applied
+    bool confSaveRequested = false; //save it to eeprom once applied
+
+    //pin values
+    int d_values[TACO_MAX_PINS];    //digital pin values
+    int a_values[TACO_MAX_PINS];    //analog pin values
+    unsigned long lastSample = 0;   //micros() of the last frame
 
     //hardcoding flags for debugging
     bool mode_clean;    //if true, code cleans the eeprom at Begin
@@ -239,18 +1459,64 @@ class Taco
     IPAddress clientsAddress[10];       //ten clients can be connected in access point mode
     int numClients = 0;
 
-    int nExtraHosts = 0;                //number of extra hosts added
-    IPAddress extraHostAddress[10];     //ten extra hosts can be added
+    //extra hosts are in conf.hosts
+
+    //all the hosts we send to
+    TacoDest dests[TACO_MAX_DESTS];
+    int nDests = 0;
 
-    //client ip address in STA-MODE
-    IPAddress sta_clientAddress;
     int nServices = 0;            //mDNS services count: number of devices connected in Wifi Mode
 
     //TIME control
-    unsigned long time_1 = 0;
+    unsigned long time_1 = 0;       //analog monitor
+    unsigned long time_2 = 0;       //digital monitor
 
     //to know if there are oleds
-    bool oled = false;
+    bool oled = false;            //an OLED is working
+    bool oledCreated = false;     //createSSD1306() was called
+    bool splash = false;          //the splash is shown until splashUntil
+    unsigned long splashUntil = 0;
+
+    //OLED refresh
+    uint8_t oledShadow[TACO_OLED_BUFFER_SIZE];  //what the screen shows now
+    volatile bool oledDirty = false;            //the buffer changed since the last refresh
+    bool oledFullRefresh = false;               //send everything at the next refresh
+    SemaphoreHandle_t oledMutex = NULL;         //display buffer
+    SemaphoreHandle_t i2cMutex = NULL;          //I2C bus
+    TaskHandle_t i2cTaskHandle = NULL;
+    int starsLeft = 0;                          //SSD1306_stars() animation
+    unsigned long nextStar = 0;
+
+    //I2C sensors
+    TacoI2CSensor* sensors[TACO_MAX_SENSORS];
+    int nSensors = 0;
+    void readSensors();                         //I2C task: read the sensors due
+    void updateSensors();                       //update(): decode and send the new frames
+    void sendFloats(const char* address, const float* values, int n);  //encode and send
+
+    //IMU
+    TacoImu* imu = NULL;
+    void readImu();                             //I2C task: drain the FIFO
+    void updateImu();                           //update(): send the samples in packets
+    TacoBundle imuBundle;
+
+    //blocks of samples
+    TacoBlockStream* streams[TACO_MAX_STREAMS];
+    int nStreams = 0;
+    void updateStreams();                       //update(): send the full blocks
+
+    //OLED dashboard
+    int dashStyle = TACO_DASH_OFF;
+    unsigned long dashBudget = TACO_DASH_BUDGET;  //microseconds per update()
+    unsigned long dashNext = 0;                   //millis() of the next frame
+    int dashStep = -1;                            //part being drawn, -1 waits for the next frame
+    int dashChannels = 0;                         //pins of this frame
+    uint8_t dashPins[TACO_MAX_PINS * 2];          //pin index, 0x80 for digital
+    uint8_t dashHistory[TACO_MAX_PINS * 2][TACO_DASH_HISTORY];  //sparklines, 0-255
+    int dashHead = 0;                             //newest sample of the sparklines
+    unsigned long dashRate = 0;                   //packets per second
+    unsigned long dashRateCount = 0;              //txPackets at dashRateTime
+    unsigned long dashRateTime = 0;
 
 
 
@@ -263,28 +1529,12 @@ class Taco
     "form{background:#fff;max-width:358px;margin:75px auto;padding:30px;border-radius:5px;text-align:center}"
     ".btn{background:#3498db;color:#fff;cursor:pointer}</style>";
 
-    /* Login page */
-    String loginIndex =
-    "<form name=loginForm>"
-    "<h1>ESP32 Login</h1>"
-    "<input name=userid placeholder='User ID'> "
-    "<input name=pwd placeholder=Password type=Password> "
-    "<input type=submit onclick=check(this.form) class=btn value=Login></form>"
-    "<script>"
-    "function check(form) {"
-    "if(form.userid.value=='admin' && form.pwd.value=='admin')"
-    "{window.open('/serverIndex')}"
-    "else"
-    "{alert('Error Password or Username')}"
-    "}"
-    "</script>" + style;
-
     /* Server Index Page */
      String updateform =
-    "<script src='https://ajax.googleapis.com/ajax/libs/jquery/3.2.1/jquery.min.js'></script>"
-    "<form method='POST' action='#' enctype='multipart/form-data' id='upload_form'>"
+    "<form method='POST' action='/update' enctype='multipart/form-data' id='upload_form'>"
     "<input type='file' name='update' id='file' onchange='sub(this)' style=display:none>"
     "<label id='file-input' for='file'>   Choose file...</label>"
+    "<input name='sha256' id='sha256' placeholder='SHA-256 (optional)'>"
     "<input type='submit' class=btn value='Update'>"
     "<br><br>"
     "<div id='prg'></div>"
@@ -294,34 +1544,22 @@ class Taco
     "var fileName = obj.value.split('\\\\');"
     "document.getElementById('file-input').innerHTML = '   '+ fileName[fileName.length-1];"
     "};"
-    "$('form').submit(function(e){"
+    "document.getElementById('upload_form').onsubmit = function(e){"
     "e.preventDefault();"
-    "var form = $('#upload_form')[0];"
-    "var data = new FormData(form);"
-    "$.ajax({"
-    "url: '/update',"
-    "type: 'POST',"
-    "data: data,"
-    "contentType: false,"
-    "processData:false,"
-    "xhr: function() {"
-    "var xhr = new window.XMLHttpRequest();"
-    "xhr.upload.addEventListener('progress', function(evt) {"
+    "var data = new FormData();"
+    "data.append('update', document.getElementById('file').files[0]);"
+    "var xhr = new XMLHttpRequest();"
+    "xhr.open('POST', '/update?sha256=' + document.getElementById('sha256').value.trim());"
+    "xhr.upload.onprogress = function(evt){"
     "if (evt.lengthComputable) {"
-    "var per = evt.loaded / evt.total;"
-    "$('#prg').html('progress: ' + Math.round(per*100) + '%');"
-    "$('#bar').css('width',Math.round(per*100) + '%');"
+    "var per = Math.round(evt.loaded / evt.total * 100);"
+    "document.getElementById('prg').innerHTML = 'progress: ' + per + '%';"
+    "document.getElementById('bar').style.width = per + '%';"
     "}"
-    "}, false);"
-    "return xhr;"
-    "},"
-    "success:function(d, s) {"
-    "console.log('success!') "
-    "},"
-    "error: function (a, b, c) {"
-    "}"
-    "});"
-    "});"
+    "};"
+    "xhr.onload = function(){ document.getElementById('prg').innerHTML = xhr.responseText; };"
+    "xhr.send(data);"
+    "};"
     "</script>" + style;
 
 
@@ -0,0 +1,114 @@
+/////////////////////////////////////////////////////////////////////////
+/// Allocations of every subsystem of Taco, see TacoAlloc.h            //
+/////////////////////////////////////////////////////////////////////////
+
+#include "TacoAlloc.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if TACO_ALLOC_STATS
+
+#ifdef ARDUINO
+#include "Arduino.h"
+
+typedef TaskHandle_t AllocTask;
+static portMUX_TYPE allocMux = portMUX_INITIALIZER_UNLOCKED;
+#define ALLOC_LOCK() portENTER_CRITICAL(&allocMux)
+#define ALLOC_UNLOCK() portEXIT_CRITICAL(&allocMux)
+
+static AllocTask allocCurrentTask(){
+  return xTaskGetCurrentTaskHandle();
+}
+#else
+//Linux: the tasks are threads
+#include <mutex>
+#include <thread>
+
+typedef std::thread::id AllocTask;
+static std::mutex allocMutex;
+#define ALLOC_LOCK() allocMutex.lock()
+#define ALLOC_UNLOCK() allocMutex.unlock()
+
+static AllocTask allocCurrentTask(){
+  return std::this_thread::get_id();
+}
+#endif
+
+static volatile uint32_t allocCount[TACO_SUB_COUNT];
+static volatile uint32_t freeCount[TACO_SUB_COUNT];
+static AllocTask allocTasks[TACO_SUB_COUNT];      //the task of a subsystem, the loop at TACO_SUB_OTHER
+static bool allocTaskSet[TACO_SUB_COUNT];
+static volatile int allocLoopSubsystem = TACO_SUB_OTHER;
+
+static int allocSubsystem(){
+  AllocTask t = allocCurrentTask();
+  if(allocTaskSet[TACO_SUB_OTHER] && t == allocTasks[TACO_SUB_OTHER]) return allocLoopSubsystem;
+  for(int i = 1; i < TACO_SUB_COUNT; i++){
+    if(allocTaskSet[i] && allocTasks[i] == t) return i;
+  }
+  return TACO_SUB_OTHER;            //before the scheduler runs, or a task of the sketch
+}
+
+static void allocCountCall(volatile uint32_t* counts){
+  int subsystem = allocSubsystem();
+  ALLOC_LOCK();
+  counts[subsystem]++;
+  ALLOC_UNLOCK();
+}
+
+void* operator new(size_t size){
+  allocCountCall(allocCount);
+  return malloc(size);
+}
+
+void* operator new[](size_t size){
+  allocCountCall(allocCount);
+  return malloc(size);
+}
+
+void operator delete(void* p){
+  if(p) allocCountCall(freeCount);
+  free(p);
+}
+
+void operator delete[](void* p){
+  if(p) allocCountCall(freeCount);
+  free(p);
+}
+
+void TacoAlloc::setTask(int subsystem){
+  allocTasks[subsystem] = allocCurrentTask();
+  allocTaskSet[subsystem] = true;
+}
+
+void TacoAlloc::counts(uint32_t* allocs, uint32_t* frees){
+  ALLOC_LOCK();
+  for(int i = 0; i < TACO_SUB_COUNT; i++){
+    allocs[i] = allocCount[i];
+    frees[i] = freeCount[i];
+  }
+  ALLOC_UNLOCK();
+}
+
+TacoAllocScope::TacoAllocScope(uint8_t subsystem){
+  _previous = -1;
+  if(!allocTaskSet[TACO_SUB_OTHER] || allocCurrentTask() != allocTasks[TACO_SUB_OTHER]) return;   //only the loop has scopes
+  _previous = allocLoopSubsystem;
+  allocLoopSubsystem = subsystem;
+}
+
+TacoAllocScope::~TacoAllocScope(){
+  if(_previous >= 0) allocLoopSubsystem = _previous;
+}
+
+#else
+
+void TacoAlloc::setTask(int subsystem){
+}
+
+void TacoAlloc::counts(uint32_t* allocs, uint32_t* frees){
+  memset(allocs, 0, TACO_SUB_COUNT * sizeof(uint32_t));
+  memset(frees, 0, TACO_SUB_COUNT * sizeof(uint32_t));
+}
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef TacoAlloc_h
+#define TacoAlloc_h
+
+/////////////////////////////////////////////////////////////////////////
+/// Allocations of every subsystem of Taco                             //
+///                                                                    //
+/// Built with -DTACO_ALLOC_STATS=1 operator new and delete are        //
+/// replaced to count the calls. The subsystem is the one of the task  //
+/// making them, or for the loop the innermost TacoAllocScope. Arduino //
+/// Strings use malloc() and are not counted: their churn shows as     //
+/// free blocks and a smaller largest block.                           //
+///                                                                    //
+/// It needs nothing of Arduino, so it also runs in a Linux build      //
+/// (tools/taco_alloc_test.py builds it), with threads for the tasks.  //
+/////////////////////////////////////////////////////////////////////////
+
+#include <stdint.h>
+
+#ifndef TACO_ALLOC_STATS
+#define TACO_ALLOC_STATS 0            //1 counts operator new/delete per subsystem (build flag -DTACO_ALLOC_STATS=1)
+#endif
+
+/* Parts of Taco whose allocations are counted with TACO_ALLOC_STATS */
+enum TacoSubsystem
+{
+  TACO_SUB_OTHER = 0,     //the sketch and everything below does not cover
+  TACO_SUB_PINS,          //readPins()
+  TACO_SUB_SEND,          //send() and the block streams
+  TACO_SUB_OSC,           //poll(): the messages received and their handlers
+  TACO_SUB_CONFIG,        //applyConfig() and the changes from the web server
+  TACO_SUB_SENSORS,       //I2C sensors, IMU and their task
+  TACO_SUB_WEB,           //web server task
+  TACO_SUB_LIVE,          //live view task
+  TACO_SUB_DISCOVERY,     //mDNS task and the destinations it finds
+  TACO_SUB_COUNT
+};
+
+class TacoAlloc
+{
+  public:
+    /* the task calling it works for a subsystem, the loop for TACO_SUB_OTHER */
+    static void setTask(int subsystem);
+
+    /* operator new and delete calls of every subsystem since boot, zeros
+    without TACO_ALLOC_STATS */
+    static void counts(uint32_t* allocs, uint32_t* frees);
+};
+
+/* The allocations made by the loop while it exists are counted for a
+subsystem. Nothing at all without TACO_ALLOC_STATS */
+class TacoAllocScope
+{
+  public:
+#if TACO_ALLOC_STATS
+    TacoAllocScope(uint8_t subsystem);
+    ~TacoAllocScope();
+  private:
+    int _previous;
+#else
+    TacoAllocScope(uint8_t subsystem) {}
+#endif
+};
+
+#endif
@@ -0,0 +1,95 @@
+/////////////////////////////////////////////////////////////////////////
+/// Clock sync of Taco, see TacoClock.h                                //
+/////////////////////////////////////////////////////////////////////////
+
+#include "TacoClock.h"
+#include <stdlib.h>
+
+void TacoClock::sample(int64_t t1, int64_t t2, int64_t t3, int64_t t4){
+  RoundTrip& r = filter[filterHead];
+  r.local = t1 + (t4 - t1) / 2;
+  r.offset = ((t2 - t1) + (t3 - t4)) / 2;
+  r.delay = (t4 - t1) - (t3 - t2);
+  if(r.delay < 0) r.delay = 0;
+  filterHead = (filterHead + 1) % TACO_SYNC_FILTER;
+  if(nFilter < TACO_SYNC_FILTER) nFilter++;
+
+  //the fastest of the last round trips, if it was not used yet
+  int best = 0;
+  for(int i = 1; i < nFilter; i++){
+    if(filter[i].delay < filter[best].delay) best = i;
+  }
+  if(synced && filter[best].local <= lastUsed) return;
+  lastUsed = filter[best].local;
+
+  //the server clock jumped (restarted or changed): start again
+  if(synced && llabs(filter[best].offset - (toServer(filter[best].local) - filter[best].local)) > TACO_SYNC_STEP){
+    RoundTrip last = filter[best];
+    reset();
+    filter[0] = last;
+    nFilter = 1;
+    filterHead = 1;
+    lastUsed = last.local;
+  }
+
+  history[historyHead] = filter[best];
+  historyHead = (historyHead + 1) % TACO_SYNC_HISTORY;
+  if(nHistory < TACO_SYNC_HISTORY) nHistory++;
+  _error = filter[best].delay / 2;
+  fit();
+  synced = true;
+}
+
+// Least squares line of the offsets against the local time. Times are taken
+// from the newest one so the doubles keep their precision
+void TacoClock::fit(){
+  int newest = (historyHead - 1 + TACO_SYNC_HISTORY) % TACO_SYNC_HISTORY;
+  base = history[newest].local;
+
+  double sx = 0, sy = 0, sxx = 0, sxy = 0;
+  for(int i = 0; i < nHistory; i++){
+    double x = history[i].local - base;
+    double y = history[i].offset - history[newest].offset;
+    sx += x;
+    sy += y;
+    sxx += x * x;
+    sxy += x * y;
+  }
+  double n = nHistory;
+  double d = n * sxx - sx * sx;
+
+  //a line needs some seconds of history, until then the offset is constant
+  if(nHistory < 2 || d <= 0 || sxx - sx * sx / n < 1e12){
+    slope = 0;
+    offset = history[newest].offset;
+    return;
+  }
+  slope = (n * sxy - sx * sy) / d;
+  offset = history[newest].offset + (sy - slope * sx) / n;
+}
+
+int64_t TacoClock::toServer(int64_t local){
+  if(!synced) return local;
+  return local + (int64_t)(offset + slope * (double)(local - base));
+}
+
+bool TacoClock::isSynced(){
+  return synced;
+}
+
+float TacoClock::drift(){
+  return slope * 1e6;
+}
+
+uint32_t TacoClock::error(){
+  return _error;
+}
+
+void TacoClock::reset(){
+  nFilter = filterHead = 0;
+  nHistory = historyHead = 0;
+  lastUsed = 0;
+  slope = offset = 0;
+  _error = 0;
+  synced = false;
+}
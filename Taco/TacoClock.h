@@ -0,0 +1,63 @@
+#ifndef TacoClock_h
+#define TacoClock_h
+
+/////////////////////////////////////////////////////////////////////////
+/// Clock sync of Taco                                                 //
+///                                                                    //
+/// The time of a server (a host or a master Taco) from the round      //
+/// trips of beginSync(). It needs nothing of Arduino, so it also runs //
+/// in a Linux build (tools/taco_sync_test.py builds it).              //
+/////////////////////////////////////////////////////////////////////////
+
+#include <stdint.h>
+
+#define TACO_SYNC_FILTER 8            //round trips compared to find the fastest one
+#define TACO_SYNC_HISTORY 16          //offsets used to estimate the drift
+#define TACO_SYNC_STEP 100000         //us of difference that restart the sync (the server clock jumped)
+
+
+/* The clock of a server (a host or a master Taco) seen from this board.
+Every round trip of a request gives the offset between both clocks:
+  t1 request sent (local), t2 request received (server),
+  t3 reply sent (server), t4 reply received (local)
+  offset = ((t2 - t1) + (t3 - t4)) / 2, delay = (t4 - t1) - (t3 - t2)
+Only the fastest round trip of the last TACO_SYNC_FILTER is used, as NTP does,
+because a slow one is slow in one direction and its offset is wrong. The
+drift of the local crystal is the slope of a line fitted to the last
+TACO_SYNC_HISTORY offsets, so the time is right between requests too. */
+class TacoClock
+{
+  public:
+    /* Add a round trip, all times in microseconds */
+    void sample(int64_t t1, int64_t t2, int64_t t3, int64_t t4);
+
+    /* Server time of a local time (esp_timer_get_time()), local time if not synced */
+    int64_t toServer(int64_t local);
+
+    bool isSynced();
+    float drift();            //ppm of the local clock against the server
+    uint32_t error();         //max error of the offset in us (half the fastest round trip)
+    void reset();
+
+  private:
+    struct RoundTrip {
+      int64_t local;          //middle of the round trip
+      int64_t offset;
+      int64_t delay;
+    };
+    RoundTrip filter[TACO_SYNC_FILTER];
+    int nFilter = 0;
+    int filterHead = 0;
+    int64_t lastUsed = 0;                 //local time of the last round trip in the history
+    RoundTrip history[TACO_SYNC_HISTORY];
+    int nHistory = 0;
+    int historyHead = 0;
+    int64_t base = 0;                     //local time of the fit
+    double offset = 0;                    //offset at base
+    double slope = 0;                     //drift, us per us
+    uint32_t _error = 0;
+    bool synced = false;
+    void fit();
+};
+
+#endif
@@ -0,0 +1,57 @@
+/////////////////////////////////////////////////////////////////////////
+/// ESP-NOW frames of Taco, see TacoEspNow.h                           //
+/////////////////////////////////////////////////////////////////////////
+
+#include "TacoEspNow.h"
+#include <string.h>
+
+void TacoEspNowFrame::begin(){
+  _length = 0;
+  _overflow = false;
+}
+
+size_t TacoEspNowFrame::write(uint8_t b){
+  if(_length >= TACO_ESPNOW_FRAME_SIZE){
+    _overflow = true;
+    return 0;
+  }
+  _data[_length++] = b;
+  return 1;
+}
+
+bool TacoEspNowFrame::isOverflow(){
+  return _overflow;
+}
+
+const uint8_t* TacoEspNowFrame::data(){
+  return _data;
+}
+
+int TacoEspNowFrame::length(){
+  return _length;
+}
+
+bool TacoEspNowQueue::push(const uint8_t* data, int length){
+  if(length <= 0 || length > TACO_ESPNOW_FRAME_SIZE) return false;
+
+  uint32_t head = _head;
+  if(head - _tail >= TACO_ESPNOW_QUEUE) return false;   //the loop is not forwarding fast enough
+  Slot& slot = _slots[head % TACO_ESPNOW_QUEUE];
+  memcpy(slot.data, data, length);
+  slot.length = length;
+  _head = head + 1;
+  return true;
+}
+
+int TacoEspNowQueue::receive(const uint8_t*& frame){
+  if(_release){   //the last frame was already forwarded
+    _tail = _tail + 1;
+    _release = false;
+  }
+  if(_tail == _head) return 0;
+
+  Slot& slot = _slots[_tail % TACO_ESPNOW_QUEUE];
+  frame = slot.data;
+  _release = true;
+  return slot.length;
+}
@@ -0,0 +1,59 @@
+#ifndef TacoEspNow_h
+#define TacoEspNow_h
+
+/////////////////////////////////////////////////////////////////////////
+/// ESP-NOW frames of Taco                                             //
+///                                                                    //
+/// The frame a node writes a packet into, and the queue where a       //
+/// gateway keeps the frames the wifi task receives until the loop     //
+/// forwards them. It needs nothing of Arduino, so it also runs in a   //
+/// Linux build (tools/taco_espnow_test.py builds it).                 //
+/////////////////////////////////////////////////////////////////////////
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define TACO_ESPNOW_QUEUE 16          //ESP-NOW frames received by a gateway waiting to be forwarded
+#define TACO_ESPNOW_FRAME_SIZE 250    //biggest ESP-NOW frame (ESP_NOW_MAX_DATA_LEN)
+
+/* A packet written into a frame. The frame overflows if the packet does not fit */
+class TacoEspNowFrame
+{
+  public:
+    void begin();
+    size_t write(uint8_t b);
+    bool isOverflow();
+    const uint8_t* data();
+    int length();
+
+  private:
+    uint8_t _data[TACO_ESPNOW_FRAME_SIZE];
+    int _length = 0;
+    bool _overflow = false;
+};
+
+/* Frames received, from the wifi task (push) to the loop (receive). A frame
+returned by receive() is not overwritten until the next receive(): its slot
+is only freed then, so a full queue drops the new frames instead. */
+class TacoEspNowQueue
+{
+  public:
+    /* copy a frame. Returns false if the queue is full or it is not a frame */
+    bool push(const uint8_t* data, int length);
+
+    /* next frame, or 0 if there is none */
+    int receive(const uint8_t*& frame);
+
+  private:
+    struct Slot
+    {
+      uint8_t length;
+      uint8_t data[TACO_ESPNOW_FRAME_SIZE];
+    };
+    Slot _slots[TACO_ESPNOW_QUEUE];
+    volatile uint32_t _head = 0;            //written by push()
+    volatile uint32_t _tail = 0;            //written by receive()
+    bool _release = false;                  //the frame at _tail was returned by receive()
+};
+
+#endif
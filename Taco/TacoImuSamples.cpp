@@ -0,0 +1,131 @@
+/////////////////////////////////////////////////////////////////////////
+/// IMU samples of Taco, see TacoImuSamples.h                          //
+/////////////////////////////////////////////////////////////////////////
+
+#include "TacoImuSamples.h"
+#include <math.h>
+#include <string.h>
+
+//big endian, as OSC
+static void writeBE16(uint8_t* p, uint16_t v){
+  p[0] = v >> 8;
+  p[1] = v;
+}
+
+static void writeBE32(uint8_t* p, uint32_t v){
+  p[0] = v >> 24;
+  p[1] = v >> 16;
+  p[2] = v >> 8;
+  p[3] = v;
+}
+
+void TacoMadgwick::update(float gx, float gy, float gz, float ax, float ay, float az, float dt){
+  float q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3];
+
+  //rate of change from the gyro
+  float qDot1 = 0.5f * (-q1 * gx - q2 * gy - q3 * gz);
+  float qDot2 = 0.5f * (q0 * gx + q2 * gz - q3 * gy);
+  float qDot3 = 0.5f * (q0 * gy - q1 * gz + q3 * gx);
+  float qDot4 = 0.5f * (q0 * gz + q1 * gy - q2 * gx);
+
+  //corrected with the gravity measured by the accelerometer
+  if(!(ax == 0.0f && ay == 0.0f && az == 0.0f)){
+    float norm = 1.0f / sqrtf(ax * ax + ay * ay + az * az);
+    ax *= norm;
+    ay *= norm;
+    az *= norm;
+
+    float _2q0 = 2.0f * q0, _2q1 = 2.0f * q1, _2q2 = 2.0f * q2, _2q3 = 2.0f * q3;
+    float _4q0 = 4.0f * q0, _4q1 = 4.0f * q1, _4q2 = 4.0f * q2;
+    float _8q1 = 8.0f * q1, _8q2 = 8.0f * q2;
+    float q0q0 = q0 * q0, q1q1 = q1 * q1, q2q2 = q2 * q2, q3q3 = q3 * q3;
+
+    float s0 = _4q0 * q2q2 + _2q2 * ax + _4q0 * q1q1 - _2q1 * ay;
+    float s1 = _4q1 * q3q3 - _2q3 * ax + 4.0f * q0q0 * q1 - _2q0 * ay - _4q1 + _8q1 * q1q1 + _8q1 * q2q2 + _4q1 * az;
+    float s2 = 4.0f * q0q0 * q2 + _2q0 * ax + _4q2 * q3q3 - _2q3 * ay - _4q2 + _8q2 * q1q1 + _8q2 * q2q2 + _4q2 * az;
+    float s3 = 4.0f * q1q1 * q3 - _2q1 * ax + 4.0f * q2q2 * q3 - _2q2 * ay;
+    float sn = s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3;
+    if(sn > 0){
+      norm = 1.0f / sqrtf(sn);
+      qDot1 -= beta * s0 * norm;
+      qDot2 -= beta * s1 * norm;
+      qDot3 -= beta * s2 * norm;
+      qDot4 -= beta * s3 * norm;
+    }
+  }
+
+  q0 += qDot1 * dt;
+  q1 += qDot2 * dt;
+  q2 += qDot3 * dt;
+  q3 += qDot4 * dt;
+  float norm = 1.0f / sqrtf(q0 * q0 + q1 * q1 + q2 * q2 + q3 * q3);
+  q[0] = q0 * norm;
+  q[1] = q1 * norm;
+  q[2] = q2 * norm;
+  q[3] = q3 * norm;
+}
+
+void TacoMadgwick::reset(){
+  q[0] = 1;
+  q[1] = q[2] = q[3] = 0;
+}
+
+void TacoImuRing::push(const int16_t raw[6], const float q[4]){
+  uint32_t index = _next++;
+
+  //ring full: update() is late, lose the sample
+  int next = (_head + 1) % TACO_IMU_RING;
+  if(next == _tail){
+    lost++;
+    return;
+  }
+  TacoImuSample& s = _ring[_head];
+  s.index = index;
+  memcpy(s.raw, raw, sizeof(s.raw));
+  memcpy(s.q, q, sizeof(s.q));
+  _head = next;
+}
+
+void TacoImuRing::skip(uint32_t n){
+  _next += n;
+  lost += n;
+}
+
+void TacoImuRing::clear(){
+  _head = _tail = 0;
+}
+
+int TacoImuRing::available(){
+  return (_head - _tail + TACO_IMU_RING) % TACO_IMU_RING;
+}
+
+const TacoImuSample& TacoImuRing::peek(int i){
+  return _ring[(_tail + i) % TACO_IMU_RING];
+}
+
+void TacoImuRing::pop(int n){
+  _tail = (_tail + n) % TACO_IMU_RING;
+}
+
+int TacoImuRing::blobHeader(uint8_t* out, int n, uint16_t rate){
+  if(n > available()) n = available();
+  if(n <= 0) return 0;
+  uint32_t first = peek(0).index;
+  int k = 1;
+  while(k < n && peek(k).index == first + k) k++;
+
+  writeBE32(out, first);
+  writeBE32(out + 4, ((uint32_t)k << 16) | rate);
+  return k;
+}
+
+void TacoImuRing::blobSample(int i, uint8_t* out){
+  const TacoImuSample& s = peek(i);
+  for(int j = 0; j < 6; j++){
+    writeBE16(out + 2 * j, s.raw[j]);
+  }
+  for(int j = 0; j < 4; j++){
+    int v = (int)(s.q[j] * 16384);
+    writeBE16(out + 12 + 2 * j, (int16_t)(v < -32768 ? -32768 : v > 32767 ? 32767 : v));
+  }
+}
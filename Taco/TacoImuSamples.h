@@ -0,0 +1,67 @@
+#ifndef TacoImuSamples_h
+#define TacoImuSamples_h
+
+/////////////////////////////////////////////////////////////////////////
+/// IMU samples of Taco                                                //
+///                                                                    //
+/// The Madgwick fusion of TacoImu and the ring that takes its samples //
+/// from the I2C task to update(), which sends them as blobs. It needs //
+/// nothing of Arduino, so it also runs in a Linux build               //
+/// (tools/taco_imu_test.py builds it).                                //
+/////////////////////////////////////////////////////////////////////////
+
+#include <stdint.h>
+
+#define TACO_IMU_RING 128             //IMU samples waiting to be sent
+
+/* Madgwick's IMU filter: the orientation from the gyroscope, corrected with
+the gravity the accelerometer measures */
+class TacoMadgwick
+{
+  public:
+    /* gyro in rad/s, accel in any unit, dt in s */
+    void update(float gx, float gy, float gz, float ax, float ay, float az, float dt);
+    void reset();
+
+    float q[4] = {1, 0, 0, 0};    //w x y z
+    float beta = 0.1;             //gain of the correction
+};
+
+/* A sample of accelerometer and gyroscope with its orientation */
+struct TacoImuSample
+{
+  uint32_t index;                 //samples the sensor took before this one, lost ones too
+  int16_t raw[6];                 //accel x y z, gyro x y z
+  float q[4];                     //w x y z
+};
+
+/* Samples from the task reading the sensor (push) to the one sending them.
+Every sample the sensor takes gets the next index, also the lost ones, and a
+blob only has samples that follow each other, so the gaps of the indexes are
+the samples lost on the board and on the network. */
+class TacoImuRing
+{
+  public:
+    void push(const int16_t raw[6], const float q[4]);   //lost if the ring is full
+    void skip(uint32_t n);        //n samples lost before the ring (the FIFO of the sensor overflowed)
+    void clear();
+    int available();
+    const TacoImuSample& peek(int i);   //i-th waiting sample
+    void pop(int n);
+
+    /* The blob of TacoImu for up to n waiting samples: blobHeader() writes its
+    8 bytes of header and returns the samples that follow each other without a
+    gap, then blobSample() writes the 20 bytes of each of them */
+    int blobHeader(uint8_t* out, int n, uint16_t rate);
+    void blobSample(int i, uint8_t* out);
+
+    unsigned long lost = 0;
+
+  private:
+    TacoImuSample _ring[TACO_IMU_RING];
+    volatile int _head = 0;       //written by push()
+    volatile int _tail = 0;       //written by pop()
+    uint32_t _next = 0;           //index of the next sample of the sensor
+};
+
+#endif
@@ -0,0 +1,143 @@
+/////////////////////////////////////////////////////////////////////////
+/// Encoded OSC packets and bundles of Taco, see TacoPacket.h          //
+/////////////////////////////////////////////////////////////////////////
+
+#include "TacoPacket.h"
+#include <string.h>
+
+//big endian, as OSC
+static void writeBE32(uint8_t* p, uint32_t v){
+  p[0] = v >> 24;
+  p[1] = v >> 16;
+  p[2] = v >> 8;
+  p[3] = v;
+}
+
+void TacoPacket::clear(){
+  _length = 0;
+  _overflow = false;
+}
+
+size_t TacoPacket::write(uint8_t b){
+  if(_length >= TACO_TX_BUFFER_SIZE){
+    _overflow = true;
+    return 0;
+  }
+  _data[_length++] = b;
+  return 1;
+}
+
+size_t TacoPacket::write(const uint8_t* buffer, size_t size){
+  if(_length + size > TACO_TX_BUFFER_SIZE){
+    _overflow = true;
+    return 0;
+  }
+  memcpy(_data + _length, buffer, size);
+  _length += size;
+  return size;
+}
+
+const uint8_t* TacoPacket::data(){
+  return _data;
+}
+
+int TacoPacket::length(){
+  return _length;
+}
+
+bool TacoPacket::overflow(){
+  return _overflow;
+}
+
+//OSC strings end with zeros up to a multiple of 4 bytes
+void TacoPacket::addString(const char* str){
+  write((const uint8_t*)str, strlen(str));
+  write((uint8_t)0);
+  pad();
+}
+
+void TacoPacket::addInt32(uint32_t v){
+  uint8_t be[4] = {(uint8_t)(v >> 24), (uint8_t)(v >> 16), (uint8_t)(v >> 8), (uint8_t)v};
+  write(be, 4);
+}
+
+void TacoPacket::addInt64(uint64_t v){
+  addInt32(v >> 32);
+  addInt32((uint32_t)v);
+}
+
+void TacoPacket::addFloat(float v){
+  uint32_t bits;
+  memcpy(&bits, &v, 4);
+  addInt32(bits);
+}
+
+void TacoPacket::pad(){
+  while(_length & 3) write((uint8_t)0);
+}
+
+// Add type tags to the encoded message: the tags grow and the arguments move
+// forward if the padding needs it. The new arguments are then added at the end
+bool TacoPacket::insertTypeTags(const char* tags){
+  int address = strnlen((const char*)_data, _length);
+  int tagStart = (address + 4) & ~3;
+  if(tagStart >= _length || _data[tagStart] != ',') return false;
+  int tagEnd = tagStart + strnlen((const char*)_data + tagStart, _length - tagStart);
+
+  int n = strlen(tags);
+  int oldArgs = tagStart + ((tagEnd - tagStart + 4) & ~3);
+  int newArgs = tagStart + ((tagEnd - tagStart + n + 4) & ~3);
+  if(_length + newArgs - oldArgs > TACO_TX_BUFFER_SIZE){
+    _overflow = true;
+    return false;
+  }
+  memmove(_data + newArgs, _data + oldArgs, _length - oldArgs);
+  memcpy(_data + tagEnd, tags, n);
+  memset(_data + tagEnd + n, 0, newArgs - tagEnd - n);
+  _length += newArgs - oldArgs;
+  return true;
+}
+
+//a whole message of floats
+void TacoPacket::addFloats(const char* address, const float* values, int n){
+  addString(address);
+  write(',');
+  for(int i = 0; i < n; i++) write('f');
+  write((uint8_t)0);
+  pad();
+  for(int i = 0; i < n; i++) addFloat(values[i]);
+}
+
+void TacoBundle::begin(uint64_t timetag){
+  header(_data, timetag);
+  _length = 16;
+  _count = 0;
+}
+
+bool TacoBundle::add(const uint8_t* element, int length){
+  if(_length + 4 + length > TACO_TX_BUFFER_SIZE) return false;
+  writeBE32(_data + _length, length);
+  memcpy(_data + _length + 4, element, length);
+  _length += 4 + length;
+  _count++;
+  return true;
+}
+
+//the 16 bytes starting a bundle
+void TacoBundle::header(uint8_t* data, uint64_t timetag){
+  memcpy(data, "#bundle", 8);
+  writeBE32(data + 8, timetag >> 32);
+  writeBE32(data + 12, (uint32_t)timetag);
+}
+
+bool TacoBundle::isEmpty(){
+  return _count == 0;
+}
+
+const uint8_t* TacoBundle::data(){
+  return _data;
+}
+
+int TacoBundle::length(){
+  return _length;
+}
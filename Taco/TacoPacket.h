@@ -0,0 +1,80 @@
+#ifndef TacoPacket_h
+#define TacoPacket_h
+
+/////////////////////////////////////////////////////////////////////////
+/// Encoded OSC packets and bundles of Taco                            //
+///                                                                    //
+/// Every frame Taco sends is encoded once in a TacoPacket (or joined  //
+/// with others in a TacoBundle) and then written to every host. It    //
+/// needs nothing of Arduino but Print, so it also runs in a Linux     //
+/// build (tools/taco_alloc_test.py builds it).                        //
+/////////////////////////////////////////////////////////////////////////
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef ARDUINO
+#include "Print.h"
+#else
+/* What TacoPacket needs of the Print of Arduino, for Linux builds */
+class Print
+{
+  public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t b) = 0;
+    virtual size_t write(const uint8_t* buffer, size_t size){
+      size_t n = 0;
+      while(size--) n += write(*buffer++);
+      return n;
+    }
+};
+#endif
+
+#define TACO_TX_BUFFER_SIZE 1472      //biggest packet we send (udp payload of an ethernet frame)
+
+/* A packet encoded in memory, so it can be sent to many hosts without
+encoding it again */
+class TacoPacket : public Print
+{
+  public:
+    void clear();
+    size_t write(uint8_t b);
+    size_t write(const uint8_t* buffer, size_t size);
+    const uint8_t* data();
+    int length();
+    bool overflow();      //true if it did not fit
+    using Print::write;
+
+    //OSC encoding, big endian and padded to 4 bytes
+    void addString(const char* str);
+    void addInt32(uint32_t v);
+    void addFloat(float v);
+    void addInt64(uint64_t v);
+    void pad();
+    void addFloats(const char* address, const float* values, int n);  //a message of floats
+    bool insertTypeTags(const char* tags);  //more arguments for the encoded message, added after it
+
+  private:
+    uint8_t _data[TACO_TX_BUFFER_SIZE];
+    int _length = 0;
+    bool _overflow = false;
+};
+
+/* An OSC bundle built from already encoded messages */
+class TacoBundle
+{
+  public:
+    void begin(uint64_t timetag);
+    static void header(uint8_t* data, uint64_t timetag);   //write the 16 bytes of a bundle header
+    bool add(const uint8_t* element, int length);   //false if it does not fit
+    bool isEmpty();
+    const uint8_t* data();
+    int length();
+
+  private:
+    uint8_t _data[TACO_TX_BUFFER_SIZE];
+    int _length = 0;
+    int _count = 0;
+};
+
+#endif
@@ -0,0 +1,97 @@
+/////////////////////////////////////////////////////////////////////////
+/// SLIP framing of Taco, see TacoSlip.h                               //
+/////////////////////////////////////////////////////////////////////////
+
+#include "TacoSlip.h"
+
+void TacoSlipEncoder::beginFrame(){
+  _frame[0] = SLIP_END;
+  _frameLength = 1;
+  _frameOverflow = false;
+}
+
+size_t TacoSlipEncoder::write(uint8_t b){
+  if(_frameLength + 3 > TACO_SLIP_FRAME_SIZE){   //keep room for an escape and the END
+    _frameOverflow = true;
+    return 0;
+  }
+  if(b == SLIP_END){
+    _frame[_frameLength++] = SLIP_ESC;
+    _frame[_frameLength++] = SLIP_ESC_END;
+  } else if(b == SLIP_ESC){
+    _frame[_frameLength++] = SLIP_ESC;
+    _frame[_frameLength++] = SLIP_ESC_ESC;
+  } else {
+    _frame[_frameLength++] = b;
+  }
+  return 1;
+}
+
+bool TacoSlipEncoder::endFrame(){
+  if(_frameOverflow){
+    dropped++;
+    return false;
+  }
+  _frame[_frameLength++] = SLIP_END;
+
+  //copy the frame to the ring only if it fits completely
+  uint32_t head = _head;
+  uint32_t used = head - _tail;
+  if(TACO_SLIP_RING_SIZE - used < (uint32_t)_frameLength){
+    dropped++;
+    return false;
+  }
+  for(int i = 0; i < _frameLength; i++){
+    _ring[(head + i) & (TACO_SLIP_RING_SIZE - 1)] = _frame[i];
+  }
+  _head = head + _frameLength;
+  return true;
+}
+
+uint32_t TacoSlipEncoder::pending(const uint8_t*& data){
+  uint32_t tail = _tail;
+  uint32_t start = tail & (TACO_SLIP_RING_SIZE - 1);
+  uint32_t n = _head - tail;
+  if(n > TACO_SLIP_RING_SIZE - start) n = TACO_SLIP_RING_SIZE - start;   //until the end of the ring
+  data = _ring + start;
+  return n;
+}
+
+void TacoSlipEncoder::consume(uint32_t n){
+  _tail = _tail + n;
+}
+
+int TacoSlipDecoder::decode(uint8_t c, const uint8_t*& packet){
+  if(_rxComplete){   //the last packet was already dispatched
+    _rxLength = 0;
+    _rxComplete = false;
+  }
+
+  if(c == SLIP_END){
+    if(_rxLength > 0 && !_rxOverflow){
+      _rxComplete = true;
+      packet = _rx;
+      return _rxLength;
+    }
+    _rxLength = 0;         //empty or broken packet
+    _rxEscape = false;
+    _rxOverflow = false;
+    return 0;
+  }
+
+  if(_rxEscape){
+    _rxEscape = false;
+    if(c == SLIP_ESC_END) c = SLIP_END;
+    if(c == SLIP_ESC_ESC) c = SLIP_ESC;
+  } else if(c == SLIP_ESC){
+    _rxEscape = true;
+    return 0;
+  }
+
+  if(_rxLength < TACO_SLIP_PACKET_SIZE){
+    _rx[_rxLength++] = c;
+  } else {
+    _rxOverflow = true;
+  }
+  return 0;
+}
@@ -0,0 +1,69 @@
+#ifndef TacoSlip_h
+#define TacoSlip_h
+
+/////////////////////////////////////////////////////////////////////////
+/// SLIP framing of Taco (OSC 1.1 through a serial port)               //
+///                                                                    //
+/// Packets are encoded with an END byte at both ends into a ring that //
+/// the writer task of TacoSlipTransport writes to the uart, and the   //
+/// bytes received are decoded back into packets. It needs nothing of  //
+/// Arduino, so it also runs in a Linux build (tools/taco_slip_test.py //
+/// builds it).                                                        //
+/////////////////////////////////////////////////////////////////////////
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define TACO_SLIP_FRAME_SIZE 2048     //biggest encoded SLIP frame (every byte can need two)
+#define TACO_SLIP_RING_SIZE 8192      //frames waiting to be written to the serial port, power of 2
+#define TACO_SLIP_PACKET_SIZE 1024    //biggest packet decoded, as TACO_RX_BUFFER_SIZE for udp
+
+#define SLIP_END 0xC0
+#define SLIP_ESC 0xDB
+#define SLIP_ESC_END 0xDC
+#define SLIP_ESC_ESC 0xDD
+
+/* Encodes packets into the ring. One task writes packets between
+beginFrame() and endFrame(), another one takes the bytes with pending() and
+consume(). A packet is copied to the ring only if it fits completely, if not
+it is dropped, so the writer never waits for the reader. */
+class TacoSlipEncoder
+{
+  public:
+    void beginFrame();
+    size_t write(uint8_t b);
+    bool endFrame();              //false if the packet was dropped
+
+    /* bytes waiting in the ring until its end, data points to them */
+    uint32_t pending(const uint8_t*& data);
+    void consume(uint32_t n);     //the first n bytes of pending() were written
+
+    unsigned long dropped = 0;    //packets that did not fit in the frame or in the ring
+
+  private:
+    uint8_t _frame[TACO_SLIP_FRAME_SIZE];   //packet being encoded
+    int _frameLength = 0;
+    bool _frameOverflow = false;
+
+    uint8_t _ring[TACO_SLIP_RING_SIZE];     //encoded packets waiting for the uart
+    volatile uint32_t _head = 0;            //written by endFrame()
+    volatile uint32_t _tail = 0;            //written by consume()
+};
+
+/* Decodes the bytes received into packets. Broken packets (too big) are dropped */
+class TacoSlipDecoder
+{
+  public:
+    /* add a received byte. Returns the length of a complete packet and points
+    packet to it, or 0. The packet is valid until the next call */
+    int decode(uint8_t c, const uint8_t*& packet);
+
+  private:
+    uint8_t _rx[TACO_SLIP_PACKET_SIZE];     //packet being decoded
+    int _rxLength = 0;
+    bool _rxEscape = false;
+    bool _rxOverflow = false;
+    bool _rxComplete = false;
+};
+
+#endif
@@ -0,0 +1,156 @@
+/////////////////////////////////////////////////////////////////////////
+/// Tracing of the phases of Taco, see TacoTrace.h                     //
+/////////////////////////////////////////////////////////////////////////
+
+#include "TacoTrace.h"
+
+//nothing at all is built without -DTACO_TRACE=1
+#if TACO_TRACE
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef ARDUINO
+#include "Arduino.h"
+#include "esp_timer.h"
+#else
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <thread>
+#endif
+
+static TacoTraceEvent traceRing[TACO_TRACE_EVENTS];
+static uint32_t traceHead = 0;            //spans recorded since the last clear()
+static volatile bool tracePaused = false;
+
+#ifdef ARDUINO
+static portMUX_TYPE traceMux = portMUX_INITIALIZER_UNLOCKED;
+#define TRACE_LOCK() portENTER_CRITICAL(&traceMux)
+#define TRACE_UNLOCK() portEXIT_CRITICAL(&traceMux)
+
+uint32_t TacoTrace::now(){
+  return (uint32_t)esp_timer_get_time();
+}
+
+uint32_t TacoTrace::cycles(){
+  return ESP.getCycleCount();
+}
+
+uint32_t TacoTrace::thread(){
+  return (uint32_t)(uintptr_t)xTaskGetCurrentTaskHandle();
+}
+
+const char* TacoTrace::threadName(uint32_t thread, char* buffer, int size){
+  return pcTaskGetTaskName((TaskHandle_t)(uintptr_t)thread);
+}
+
+float TacoTrace::cyclesPerUs(){
+  return ESP.getCpuFreqMHz();
+}
+#else
+//Linux: the cycles are nanoseconds of the steady clock
+static std::mutex traceMutex;
+#define TRACE_LOCK() traceMutex.lock()
+#define TRACE_UNLOCK() traceMutex.unlock()
+
+static uint64_t traceNanos(){
+  static const std::chrono::steady_clock::time_point boot = std::chrono::steady_clock::now();
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - boot).count();
+}
+
+uint32_t TacoTrace::now(){
+  return (uint32_t)(traceNanos() / 1000);
+}
+
+uint32_t TacoTrace::cycles(){
+  return (uint32_t)traceNanos();
+}
+
+uint32_t TacoTrace::thread(){
+  return (uint32_t)std::hash<std::thread::id>()(std::this_thread::get_id());
+}
+
+const char* TacoTrace::threadName(uint32_t thread, char* buffer, int size){
+  snprintf(buffer, size, "thread %08x", (unsigned)thread);
+  return buffer;
+}
+
+float TacoTrace::cyclesPerUs(){
+  return 1000;
+}
+#endif
+
+void TacoTrace::record(const char* name, uint32_t start, uint32_t startCycles){
+  uint32_t length = cycles() - startCycles;   //right even if the counter wrapped
+  uint32_t t = thread();
+
+  TRACE_LOCK();
+  if(!tracePaused){
+    TacoTraceEvent& e = traceRing[traceHead % TACO_TRACE_EVENTS];
+    e.name = name;
+    e.start = start;
+    e.cycles = length;
+    e.thread = t;
+    traceHead++;
+  }
+  TRACE_UNLOCK();
+}
+
+void TacoTrace::clear(){
+  TRACE_LOCK();
+  traceHead = 0;
+  TRACE_UNLOCK();
+}
+
+int TacoTrace::count(){
+  return traceHead < TACO_TRACE_EVENTS ? traceHead : TACO_TRACE_EVENTS;
+}
+
+void TacoTrace::dump(TacoTraceWriter write, void* context){
+  char text[160];
+  int length;
+
+  //nothing is written to the ring while we read it
+  TRACE_LOCK();
+  tracePaused = true;
+  TRACE_UNLOCK();
+
+  int n = count();
+  uint32_t first = traceHead - n;
+  float perUs = cyclesPerUs();
+
+  length = snprintf(text, sizeof(text), "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+  write(text, length, context);
+
+  //the name of every thread, once
+  uint32_t threads[16];
+  int nThreads = 0;
+  for(int i = 0; i < n; i++){
+    uint32_t t = traceRing[(first + i) % TACO_TRACE_EVENTS].thread;
+    int j = 0;
+    while(j < nThreads && threads[j] != t) j++;
+    if(j < nThreads || nThreads == 16) continue;
+    threads[nThreads++] = t;
+
+    char name[24];
+    length = snprintf(text, sizeof(text), "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                      nThreads > 1 ? "," : "", (unsigned)t, threadName(t, name, sizeof(name)));
+    write(text, length, context);
+  }
+
+  for(int i = 0; i < n; i++){
+    const TacoTraceEvent& e = traceRing[(first + i) % TACO_TRACE_EVENTS];
+    length = snprintf(text, sizeof(text), "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%u,\"dur\":%.3f,\"args\":{\"cycles\":%u}}",
+                      nThreads > 0 || i > 0 ? "," : "", e.name, (unsigned)e.thread, (unsigned)e.start,
+                      e.cycles / perUs, (unsigned)e.cycles);
+    write(text, length, context);
+  }
+
+  length = snprintf(text, sizeof(text), "]}\n");
+  write(text, length, context);
+
+  tracePaused = false;
+}
+
+#endif
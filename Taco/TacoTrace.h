@@ -0,0 +1,77 @@
+#ifndef TacoTrace_h
+#define TacoTrace_h
+
+/////////////////////////////////////////////////////////////////////////
+/// Tracing of the phases of Taco                                      //
+///                                                                    //
+/// Every TACO_TRACE_SCOPE("name") records when it started and how     //
+/// many cycles it took in a ring of the last TACO_TRACE_EVENTS spans. //
+/// The ring is written as Chrome trace JSON, to open it in            //
+/// chrome://tracing or ui.perfetto.dev. Build with -DTACO_TRACE=1,    //
+/// without it the macros are nothing at all.                          //
+///                                                                    //
+/// It needs nothing of Arduino, so it also runs in a Linux build.     //
+/////////////////////////////////////////////////////////////////////////
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef TACO_TRACE
+#define TACO_TRACE 0                  //1 records the spans (build flag -DTACO_TRACE=1)
+#endif
+#define TACO_TRACE_EVENTS 512         //spans kept, 16 bytes each
+
+/* A span: the thread is the FreeRTOS task on the ESP32 */
+struct TacoTraceEvent
+{
+  const char* name;                   //a string literal, only the pointer is kept
+  uint32_t start;                     //us since boot (the same clock on both cores)
+  uint32_t cycles;                    //length in cycles of the core
+  uint32_t thread;
+};
+
+/* Called with every piece of the JSON, to send it where it has to go */
+typedef void (*TacoTraceWriter)(const char* text, int length, void* context);
+
+class TacoTrace
+{
+  public:
+    static uint32_t now();            //us
+    static uint32_t cycles();         //cycle counter of this core
+    static void record(const char* name, uint32_t start, uint32_t startCycles);
+
+    /* The spans in the ring, oldest first, as Chrome trace JSON. The
+    recording stops meanwhile */
+    static void dump(TacoTraceWriter write, void* context);
+    static void clear();
+    static int count();               //spans in the ring
+
+  private:
+    static uint32_t thread();
+    static const char* threadName(uint32_t thread, char* buffer, int size);
+    static float cyclesPerUs();
+};
+
+/* Records the span from its construction to the end of the scope */
+class TacoTraceScope
+{
+  public:
+    TacoTraceScope(const char* name) : _name(name), _start(TacoTrace::now()), _cycles(TacoTrace::cycles()) {}
+    ~TacoTraceScope() { TacoTrace::record(_name, _start, _cycles); }
+
+  private:
+    const char* _name;
+    uint32_t _start;
+    uint32_t _cycles;
+};
+
+#define TACO_TRACE_JOIN2(a, b) a##b
+#define TACO_TRACE_JOIN(a, b) TACO_TRACE_JOIN2(a, b)
+
+#if TACO_TRACE
+#define TACO_TRACE_SCOPE(name) TacoTraceScope TACO_TRACE_JOIN(tacoTrace, __LINE__)(name)
+#else
+#define TACO_TRACE_SCOPE(name)
+#endif
+
+#endif
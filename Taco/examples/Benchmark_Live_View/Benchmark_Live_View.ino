@@ -0,0 +1,69 @@
+/*
+ * Cost of the live view of the pins.
+ *
+ * It sends the analog pins as fast as it can and prints every second the
+ * frames sent per second and the percent of a core used by the live view.
+ * Open http://192.168.0.1/live (access point mode) in one or two browsers,
+ * change their frames per second, and compare the rates with the live view
+ * closed: the frames sent should not change.
+ *
+ * Enrique Tomas for Tangible Music Lab, Kunstuniversität Linz
+ * enrique.tomas@ufg.at
+ */
+
+#include <Taco.h>
+
+//init Taco: (led pin, hardware reset Pin)
+Taco taco(2, 15, "taco_bench");
+
+//HTML server, with the live view at /live
+WebServer server(80);
+
+int analog_pins[] = {32, 33, 34, 35};
+OSCMessage msg("/bench/pins");
+float values[4];
+unsigned long frames = 0;
+unsigned long last_print = 0;
+
+void setup()
+{
+  Serial.begin(115200);
+
+  WiFi.onEvent(WiFiEvent);
+  taco.begin(4444);
+
+  taco.def_analog_pins(analog_pins, 4);
+  taco.setSampleRate(1000);
+
+  server.on("/", handleRoot);
+  taco.beginServer(server, true);    //served in its own task, no need of server.handleClient()
+
+  Serial.println();
+  Serial.println("frames/s  live view %");   //frames that changed, sent to the hosts
+}
+
+void loop(){
+  taco.update();
+
+  //a frame of the pins every ms
+  if(taco.readPins()){
+    for(int i = 0; i < 4; i++) values[i] = taco.analogValue(i) / 4095.0;
+    taco.send(msg, values, 4);
+    frames++;
+  }
+
+  if(millis() - last_print >= 1000){
+    Serial.printf("%8lu  %11.2f\n", frames * 1000 / (millis() - last_print), taco.liveLoad());
+    frames = 0;
+    last_print = millis();
+  }
+}
+
+//Receive event from the network. We manage it with taco.
+void WiFiEvent(WiFiEvent_t event) {
+  taco.manageWiFiEvent(event);
+}
+
+void handleRoot() {
+  taco.handleRoot(server);
+}
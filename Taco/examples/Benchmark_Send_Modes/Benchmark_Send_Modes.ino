@@ -0,0 +1,92 @@
+/*
+ * Compare the cost of sending every frame to every host (unicast)
+ * with sending it once to a multicast group, for 1 to 10 receivers.
+ *
+ * Connect the board to your Wifi first (see the Server_OSC_TX example)
+ * and write the IPs of up to 10 computers listening below. To receive the multicast packets they have to join the
+ * group 239.0.0.1 at port 4444.
+ *
+ * For every number of receivers it prints the CPU time of taco.send(),
+ * the packets on air per frame and an estimation of the airtime per frame.
+ * Multicast frames are not acknowledged but they are sent at the basic rate
+ * of the network, so they are slower on air than unicast ones.
+ *
+ * Enrique Tomas for Tangible Music Lab, Kunstuniversität Linz
+ * enrique.tomas@ufg.at
+ */
+
+#include <Taco.h>
+
+//init Taco: (led pin, hardware reset Pin)
+Taco taco(2, 15);
+
+//receivers of the benchmark
+IPAddress receivers[] = {
+  IPAddress(192, 168, 0, 10), IPAddress(192, 168, 0, 11), IPAddress(192, 168, 0, 12),
+  IPAddress(192, 168, 0, 13), IPAddress(192, 168, 0, 14), IPAddress(192, 168, 0, 15),
+  IPAddress(192, 168, 0, 16), IPAddress(192, 168, 0, 17), IPAddress(192, 168, 0, 18),
+  IPAddress(192, 168, 0, 19)
+};
+const int max_receivers = 10;
+
+IPAddress group(239, 0, 0, 1);
+
+const int frames = 500;               //frames sent for every measure
+const float unicast_mbps = 54.0;      //data rate of the unicast packets
+const float basic_mbps = 6.0;         //basic rate of the network (1.0 in 802.11b networks)
+const float unicast_overhead_us = 100.0;   //DIFS, backoff, preamble, SIFS and ACK
+const float multicast_overhead_us = 70.0;  //DIFS, backoff and preamble
+const int header_bytes = 8 + 20 + 8 + 28;  //UDP, IP, LLC and MAC headers
+
+OSCMessage msg("/bench/frame");
+float values[] = {0, 1, 2, 3, 4, 5, 6, 7};
+
+void setup()
+{
+  Serial.begin(115200);
+
+  WiFi.onEvent(WiFiEvent);
+  taco.begin(4444);
+
+  delay(3000);    //let the network settle
+
+  //size of a frame on air
+  for(int i = 0; i < 8; i++) msg.add(values[i]);
+  int packet_bytes = msg.bytes() + header_bytes;
+  msg.empty();
+
+  Serial.println();
+  Serial.println("receivers  mode       us/frame  packets/frame  airtime us/frame");
+
+  for(int n = 1; n <= max_receivers; n++){
+    for(int i = 0; i < n; i++) taco.addHost(receivers[i]);
+
+    taco.setSendMode(TACO_SEND_UNICAST);
+    float cpu = measure();
+    float airtime = n * (unicast_overhead_us + packet_bytes * 8 / unicast_mbps);
+    Serial.printf("%9d  unicast    %8.1f  %13d  %16.1f\n", n, cpu, n, airtime);
+
+    taco.setMulticastGroup(group);
+    cpu = measure();
+    airtime = multicast_overhead_us + packet_bytes * 8 / basic_mbps;
+    Serial.printf("%9d  multicast  %8.1f  %13d  %16.1f\n", n, cpu, 1, airtime);
+  }
+}
+
+void loop(){
+  taco.update();
+}
+
+//average CPU time of a frame
+float measure(){
+  unsigned long start = micros();
+  for(int i = 0; i < frames; i++){
+    taco.send(msg, values, 8);
+  }
+  return (micros() - start) / (float)frames;
+}
+
+//Receive event from the network. We manage it with taco.
+void WiFiEvent(WiFiEvent_t event) {
+  taco.manageWiFiEvent(event);
+}
@@ -0,0 +1,64 @@
+/*
+ * Stream a piezo at 8000 samples per second in blocks of 256 samples.
+ * Every block is a single /piezo message with a blob (sequence number,
+ * sample rate, format, number of samples and the int16 samples), about
+ * 31 messages per second instead of 8000 floats.
+ *
+ * A hardware timer wakes up a task at the sample rate to read the pin,
+ * the loop only has to call taco.update().
+ *
+ * Enrique Tomas for Tangible Music Lab, Kunstuniversität Linz
+ * enrique.tomas@ufg.at
+ */
+
+#include <Taco.h>
+
+//init Taco: (led pin, hardware reset Pin)
+Taco taco(2, 15);
+
+const int piezo_pin = 35;
+const int sample_rate = 8000;
+
+//blocks of 256 int16 samples sent to /piezo
+TacoBlockStream piezo("/piezo", 256, sample_rate, TACO_BLOCK_INT16);
+
+hw_timer_t* timer = NULL;
+TaskHandle_t samplerTask = NULL;
+
+//the timer only wakes up the sampler
+void IRAM_ATTR onTimer(){
+  BaseType_t woken = pdFALSE;
+  vTaskNotifyGiveFromISR(samplerTask, &woken);
+  if(woken) portYIELD_FROM_ISR();
+}
+
+void sampler(void* param){
+  for(;;){
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    piezo.push(analogRead(piezo_pin) - 2048);   //centered around 0
+  }
+}
+
+void setup()
+{
+  Serial.begin(115200);
+
+  taco.begin(4444);         //connect as access point and transmit to all connected devices using this port
+  taco.addBlockStream(piezo);
+
+  xTaskCreatePinnedToCore(sampler, "sampler", 2048, NULL, 5, &samplerTask, 1);
+
+  //80 MHz / 80 = 1 MHz timer
+  timer = timerBegin(0, 80, true);
+  timerAttachInterrupt(timer, &onTimer, true);
+  timerAlarmWrite(timer, 1000000 / sample_rate, true);
+  timerAlarmEnable(timer);
+}
+
+void loop(){
+
+  taco.update();        //update board, sends the full blocks
+
+  //blocks lost because the loop was too slow
+  //Serial.println(piezo.lostBlocks());
+}
@@ -0,0 +1,40 @@
+/*
+ * A gateway receiving the OSC data of many ESP-NOW nodes (see the
+ * ESPNOW_Node example) and forwarding it to the hosts of its network.
+ * The frames received between two taco.update() are sent as OSC bundles.
+ *
+ * Copy the mac address and channel printed at start to the nodes.
+ *
+ * Enrique Tomas for Tangible Music Lab, Kunstuniversität Linz
+ * enrique.tomas@ufg.at
+ */
+
+#include <Taco.h>
+
+//name of this board
+const char *board_name = "taco-gateway";
+
+//init Taco: (led pin, hardware reset Pin, access point name)
+Taco taco(2, 15, board_name);
+
+void setup()
+{
+  Serial.begin(115200);
+
+  //NETWORK, as access point (channel 1) or connected to a wifi
+  WiFi.onEvent(WiFiEvent);
+  taco.begin(4444);
+
+  //receive the nodes
+  taco.beginEspNowGateway();
+}
+
+void loop(){
+  taco.update();        //update board and forward the frames of the nodes
+}
+
+
+//Receive event from the network. We manage it with taco.
+void WiFiEvent(WiFiEvent_t event) {
+  taco.manageWiFiEvent(event);
+}
@@ -0,0 +1,42 @@
+/*
+ * A sensor node sending OSC data with ESP-NOW to a gateway Taco
+ * (see the ESPNOW_Gateway example). It does not join any network, so
+ * there is no association time and no limit of clients per access point.
+ *
+ * Write the mac address and channel printed by the gateway below.
+ * Give every node different OSC addresses so the hosts can tell them apart.
+ *
+ * Enrique Tomas for Tangible Music Lab, Kunstuniversität Linz
+ * enrique.tomas@ufg.at
+ */
+
+#include <Taco.h>
+
+//init Taco: (led pin, hardware reset Pin)
+Taco taco(2, 15);
+
+//gateway printed by the gateway board at start
+uint8_t gateway_mac[] = {0x24, 0x6F, 0x28, 0x00, 0x00, 0x01};
+const int channel = 1;
+
+//OSC messages (they have to fit in 250 bytes)
+OSCMessage msg_node("/node1/sensors");
+
+void setup()
+{
+  Serial.begin(115200);
+
+  //NO taco.begin(): the node only needs the radio
+  taco.beginEspNowNode(gateway_mac, channel);
+}
+
+void loop(){
+
+  taco.update();        //update board
+
+  //send an array of values
+  float a[] = {analogRead(35) / 4095.0, analogRead(34) / 4095.0, analogRead(33) / 4095.0};
+  taco.send(msg_node, a, 3);
+
+  delay(5);
+}
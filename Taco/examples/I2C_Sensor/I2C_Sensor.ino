@@ -0,0 +1,52 @@
+/*
+ * Read I2C sensors without blocking the loop. Taco reads them in the
+ * background at their own rates and sends their values as OSC messages.
+ *
+ * An MPU6050 (accelerometer, temperature and gyroscope) is read with the
+ * default decoding (big endian 16 bit values). A BMP280 needs its own
+ * decoding, so it is a TacoI2CSensor with decode() overridden.
+ *
+ * Enrique Tomas for Tangible Music Lab, Kunstuniversität Linz
+ * enrique.tomas@ufg.at
+ */
+
+#include <Taco.h>
+
+//init Taco: (led pin, hardware reset Pin)
+Taco taco(2, 15);
+
+//MPU6050 at 0x68: 14 bytes from register 0x3B sent to /imu/raw 100 times per second
+TacoI2CSensor imu(0x68, 0x3B, 14, "/imu/raw", 100);
+
+//BMP280 raw pressure and temperature (20 bit values), 10 times per second
+class Bmp280 : public TacoI2CSensor {
+  public:
+    Bmp280() : TacoI2CSensor(0x76, 0xF7, 6, "/bmp/raw", 10) {
+      addInitRegister(0xF4, 0x27);    //normal mode, x1 oversampling
+    }
+    int decode(const uint8_t* data, int length, float* values) {
+      values[0] = (long)((data[0] << 12) | (data[1] << 4) | (data[2] >> 4));  //pressure
+      values[1] = (long)((data[3] << 12) | (data[4] << 4) | (data[5] >> 4));  //temperature
+      return 2;
+    }
+};
+Bmp280 bmp;
+
+void setup()
+{
+  Serial.begin(115200);
+
+  taco.begin(4444);         //connect as access point and transmit to all connected devices using this port
+
+  imu.addInitRegister(0x6B, 0);   //wake up
+  taco.addSensor(imu);
+  taco.addSensor(bmp);
+}
+
+void loop(){
+
+  taco.update();        //update board, sends the values of the sensors
+
+  //the last values can also be used here
+  //float ax = imu.value(0);
+}
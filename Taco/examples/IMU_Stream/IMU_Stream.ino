@@ -0,0 +1,42 @@
+/*
+ * Stream an MPU-6050/6500/9250 IMU at 500 samples per second with its
+ * orientation. The samples wait in the FIFO of the sensor and are read in
+ * bursts in the background, the orientation is calculated on the other core
+ * and update() sends them in packets of 20 samples (25 packets per second).
+ *
+ * Every /imu/blob message has a blob with the index of its first sample, the
+ * number of samples, the rate and 10 int16 per sample: accel x y z, gyro x y z
+ * and the quaternion w x y z multiplied by 16384 (see TacoImu in Taco.h).
+ * Gaps in the indexes are the samples lost, on the board or on the network.
+ * Use TACO_IMU_BUNDLE to receive bundles of /imu messages of floats instead.
+ *
+ * Enrique Tomas for Tangible Music Lab, Kunstuniversität Linz
+ * enrique.tomas@ufg.at
+ */
+
+#include <Taco.h>
+
+//init Taco: (led pin, hardware reset Pin)
+Taco taco(2, 15);
+
+//IMU at 0x68, 500 samples per second, sent to /imu/blob
+TacoImu imu(0x68, 500, "/imu");
+
+void setup()
+{
+  Serial.begin(115200);
+
+  taco.begin(4444);         //connect as access point and transmit to all connected devices using this port
+
+  imu.setFusion(true, 0.1);
+  imu.setPacking(TACO_IMU_BLOB, 20);
+  taco.addImu(imu);
+}
+
+void loop(){
+
+  taco.update();        //update board, sends the IMU packets
+
+  //the orientation can also be used here
+  //float w = imu.quaternion(0);
+}
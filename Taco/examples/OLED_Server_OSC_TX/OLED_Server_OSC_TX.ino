@@ -42,7 +42,9 @@ void setup()
 
   //WEBSERVER
   server.on("/", handleRoot);  //handleRoot is a function dealing with the actions on the server via browser
-  taco.beginServer(server);
+  taco.beginServer(server, true);    //it serves the clients in its own task, no need of server.handleClient()
+                               //In access point mode connect to 192.168.0.1
+                               //In Wifi Mode the board can be at 192.168.0.129, but it depends on your network settings
 
   
 }
@@ -51,11 +53,6 @@ void loop(){
   
   taco.update();        //update board
 
-  //handle wifi server clients connected and configuring via browser
-  //In access point mode connect to 192.168.0.1
-  //In Wifi Mode the board can be at 192.168.0.129, but it depends on your network settings
-  server.handleClient();
-  
   //send one value
   taco.send(msg_test, analogRead(35) / 4095.0);
   
@@ -0,0 +1,69 @@
+/*
+ * Receive OSC messages from the hosts connected to the board.
+ * taco.update() reads all pending messages and bundles and calls the
+ * functions registered with taco.route().
+ *
+ * Try it sending /actuator/led 1 or /actuator/motor 0.5 to the board (port 4444).
+ *
+ * Enrique Tomas for Tangible Music Lab, Kunstuniversität Linz
+ * enrique.tomas@ufg.at
+ */
+
+#include <Taco.h>
+
+//name of this board
+const char *board_name = "taquito";  //give it a different name :)
+
+//init Taco: (led pin, hardware reset Pin, access point name)
+Taco taco(2, 15, board_name);
+
+//pins driven by the hosts
+const int led_pin = 4;
+const int motor_pin = 5;
+
+//OSC messages
+OSCMessage msg_test("/osc/test");
+
+void setup()
+{
+  Serial.begin(115200);     //if you want to receive updates in your serial console
+
+  pinMode(led_pin, OUTPUT);
+  ledcSetup(0, 5000, 8);      //pwm channel 0, 5 kHz, 8 bits
+  ledcAttachPin(motor_pin, 0);
+
+  //ROUTES: functions called when a message arrives
+  taco.route("/actuator/led", onLed);
+  taco.route("/actuator/*", onAnyActuator);   //a star matches any segment
+
+  //NETWORK
+  WiFi.onEvent(WiFiEvent);  //First register for wifi events
+  taco.begin(4444);         //connect as access point, transmit and receive using this port
+}
+
+void loop(){
+
+  taco.update();        //update board and dispatch received messages
+
+  //send one value
+  taco.send(msg_test, analogRead(35) / 4095.0);
+}
+
+
+void onLed(TacoOSCMessage& msg){
+  digitalWrite(led_pin, msg.getInt(0) ? HIGH : LOW);
+}
+
+void onAnyActuator(TacoOSCMessage& msg){
+  Serial.printf("%s from %s\n", msg.address(), msg.remoteIP().toString().c_str());
+
+  if(strcmp(msg.address(), "/actuator/motor") == 0){
+    ledcWrite(0, msg.getFloat(0) * 255);
+  }
+}
+
+
+//Receive event from the network. We manage it with taco.
+void WiFiEvent(WiFiEvent_t event) {
+  taco.manageWiFiEvent(event);
+}
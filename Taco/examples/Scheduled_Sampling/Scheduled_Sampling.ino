@@ -0,0 +1,76 @@
+/*
+ * Sampling as a job of the scheduler of Taco.
+ *
+ * The pins are read and sent by a stream job at 1 kHz, so update() runs the
+ * display, the web server work and the wifi reconnection only in the time
+ * left between two frames. Twice a second it prints a job: runs, deadlines
+ * missed, budgets overrun, times a background job had to wait and the mean
+ * and longest run in us. The same is served at http://192.168.0.1/api/stats
+ *
+ * Enrique Tomas for Tangible Music Lab, Kunstuniversität Linz
+ * enrique.tomas@ufg.at
+ */
+
+#include <Taco.h>
+
+//init Taco: (led pin, hardware reset Pin)
+Taco taco(2, 15, "taco_jobs");
+
+//HTML server
+WebServer server(80);
+
+int analog_pins[] = {32, 33, 34, 35};
+OSCMessage msg("/jobs/pins");
+float values[4];
+
+//the stream job: a frame of the pins
+void sample(){
+  if(taco.readPins()){
+    for(int i = 0; i < 4; i++) values[i] = taco.analogValue(i) / 4095.0;
+    taco.send(msg, values, 4);
+  }
+}
+
+//a background job: only when there is time for it. A line at a time, it
+//fits in the buffer of the uart and printing never waits
+int reported = 0;
+
+void report(){
+  const TacoJob* j = taco.job(reported);
+  reported = (reported + 1) % taco.jobCount();
+  if(j == NULL) return;
+  Serial.printf("%-8s runs %u misses %u overruns %u deferred %u mean %u max %u us\n",
+                j->name, j->runs, j->misses, j->overruns, j->deferred, j->meanTime, j->maxTime);
+}
+
+void setup()
+{
+  Serial.begin(115200);
+
+  WiFi.onEvent(WiFiEvent);
+  taco.begin(4444);
+
+  //the job keeps the time: readPins() reads every time it is called
+  taco.def_analog_pins(analog_pins, 4);
+
+  server.on("/", handleRoot);
+  taco.beginServer(server, true);    //served in its own task, no need of server.handleClient()
+
+  //1 kHz taking 300 us at most, and a line of the report twice a second.
+  //Budgets of background jobs have to be below the 1000 us of a frame
+  taco.addJob("sample", sample, 1000, TACO_JOB_STREAM, 300);
+  taco.addJob("report", report, 2, TACO_JOB_BACKGROUND, 300);
+}
+
+void loop(){
+  taco.update();        //everything else is a job
+}
+
+//Receive event from the network. We manage it with taco.
+void WiFiEvent(WiFiEvent_t event) {
+  taco.manageWiFiEvent(event);
+}
+
+void handleRoot() {
+  taco.handleRoot(server);
+}
@@ -0,0 +1,54 @@
+/*
+ * Transmit OSC data through the USB cable instead of wifi, for rehearsals
+ * or venues where the wifi is unusable.
+ *
+ * Packets are SLIP encoded (OSC 1.1), like most OSC software expects for
+ * serial ports. The receiver has to open the port at the same baud rate.
+ * OSC messages sent by the computer through the port reach taco.route()
+ * functions too.
+ *
+ * Enrique Tomas for Tangible Music Lab, Kunstuniversität Linz
+ * enrique.tomas@ufg.at
+ */
+
+#include <Taco.h>
+
+//init Taco: (led pin, hardware reset Pin)
+Taco taco(2, 15);
+
+//OSC messages
+OSCMessage msg_test("/osc/test");
+OSCMessage msg_test2("/osc/test2");
+
+void setup()
+{
+  Serial.begin(115200);
+
+  //NETWORK: still useful to configure the board or to switch back to wifi
+  WiFi.onEvent(WiFiEvent);
+  taco.begin(4444);
+
+  //from now on OSC goes through the USB cable, at 2 Mbaud
+  taco.beginSerialTransport(Serial, 2000000);
+
+  //switch at runtime with taco.setTransport(TACO_TRANSPORT_UDP) or
+  //sending /taco/config/transport "udp" to the board
+}
+
+void loop(){
+
+  taco.update();        //update board
+
+  //send one value
+  taco.send(msg_test, analogRead(35) / 4095.0);
+
+  //send an array of values
+  float a[] = {35.0, 34.0, 33.0};
+  taco.send(msg_test2, a, 3);
+}
+
+
+//Receive event from the network. We manage it with taco.
+void WiFiEvent(WiFiEvent_t event) {
+  taco.manageWiFiEvent(event);
+}
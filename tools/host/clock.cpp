@@ -0,0 +1,27 @@
+// Driver of TacoClock for tools/taco_sync_test.py. Reads lines of
+//   s t1 t2 t3 t4     sample() of a round trip
+//   q local           prints toServer(local)
+//   r                 reset()
+// and prints for every q the server time, the drift and the error.
+
+#include <stdio.h>
+#include <inttypes.h>
+#include "TacoClock.h"
+
+int main(){
+  TacoClock clock;
+  char line[256];
+  while(fgets(line, sizeof(line), stdin)){
+    int64_t t[4];
+    if(line[0] == 's' && sscanf(line + 1, "%" SCNd64 " %" SCNd64 " %" SCNd64 " %" SCNd64, &t[0], &t[1], &t[2], &t[3]) == 4){
+      clock.sample(t[0], t[1], t[2], t[3]);
+    }
+    else if(line[0] == 'q' && sscanf(line + 1, "%" SCNd64, &t[0]) == 1){
+      printf("%" PRId64 " %d %.3f %u\n", clock.toServer(t[0]), clock.isSynced(), clock.drift(), (unsigned)clock.error());
+    }
+    else if(line[0] == 'r'){
+      clock.reset();
+    }
+  }
+  return 0;
+}
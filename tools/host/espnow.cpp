@@ -0,0 +1,53 @@
+// Driver of TacoEspNowFrame and TacoEspNowQueue for tools/taco_espnow_test.py:
+// a node and a gateway joined by a loopback instead of the radio. Reads lines of
+//   n <hex>           the node writes a packet in a frame and sends it to the
+//                     gateway, prints ok, overflow or full
+//   g                 the gateway takes the next frame, prints it in hex
+//   h                 prints again the last frame the gateway took
+// and prints one line for each, - when there is nothing.
+
+#include <stdio.h>
+#include <iostream>
+#include <string>
+#include "TacoEspNow.h"
+
+static std::string hex(const uint8_t* data, int length){
+  static const char digits[] = "0123456789abcdef";
+  std::string s;
+  for(int i = 0; i < length; i++){
+    s += digits[data[i] >> 4];
+    s += digits[data[i] & 15];
+  }
+  return s;
+}
+
+static TacoEspNowFrame node;
+static TacoEspNowQueue gateway;
+
+int main(){
+  std::string line;
+  const uint8_t* frame = NULL;
+  int length = 0;
+  while(std::getline(std::cin, line)){
+    if(line.empty()) continue;
+    std::string out;
+
+    if(line[0] == 'n'){
+      node.begin();
+      for(size_t i = 2; i + 1 < line.size(); i += 2){
+        node.write((uint8_t)std::stoi(line.substr(i, 2), NULL, 16));
+      }
+      if(node.isOverflow()) out = "overflow";
+      else out = gateway.push(node.data(), node.length()) ? "ok" : "full";
+    }
+    else if(line[0] == 'g'){
+      length = gateway.receive(frame);
+      out = hex(frame, length);
+    }
+    else if(line[0] == 'h'){
+      out = hex(frame, length);
+    }
+    printf("%s\n", out.empty() ? "-" : out.c_str());
+  }
+  return 0;
+}
@@ -0,0 +1,78 @@
+// Driver of TacoImuRing and TacoMadgwick for tools/taco_imu_test.py. The
+// arguments are the rate (Hz) and the beta of the fusion. Reads lines of
+//   s ax ay az gx gy gz    the board reads a raw sample: fused and into the ring
+//   k n                    the FIFO of the board overflowed, n samples lost
+//   b n                    update() of the board: prints the blobs of up to n
+//                          samples in hex, - if there is none
+//   l                      prints the samples the board lost
+//   f ax ay az gx gy gz    a receiver fuses a raw sample: prints w x y z
+// Raw values as the MPU sends them: +-8 g and +-2000 degrees/s.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include "TacoImuSamples.h"
+
+#define GYRO_SCALE 16.4               //LSB per degree/s, as MPU_GYRO_SCALE
+
+static std::string hex(const uint8_t* data, int length){
+  static const char digits[] = "0123456789abcdef";
+  std::string s;
+  for(int i = 0; i < length; i++){
+    s += digits[data[i] >> 4];
+    s += digits[data[i] & 15];
+  }
+  return s;
+}
+
+static void fuse(TacoMadgwick& madgwick, const int* raw, float rate){
+  const float rad = 3.14159265358979f / 180.0f / GYRO_SCALE;
+  madgwick.update(raw[3] * rad, raw[4] * rad, raw[5] * rad, raw[0], raw[1], raw[2], 1.0 / rate);
+}
+
+static TacoImuRing ring;
+
+int main(int argc, char** argv){
+  float rate = argc > 1 ? atof(argv[1]) : 200;
+  TacoMadgwick board, receiver;
+  board.beta = receiver.beta = argc > 2 ? atof(argv[2]) : 0.1;
+
+  char line[256];
+  while(fgets(line, sizeof(line), stdin)){
+    int v[6];
+    if((line[0] == 's' || line[0] == 'f') && sscanf(line + 1, "%d %d %d %d %d %d", &v[0], &v[1], &v[2], &v[3], &v[4], &v[5]) == 6){
+      if(line[0] == 's'){
+        int16_t raw[6];
+        for(int i = 0; i < 6; i++) raw[i] = v[i];
+        fuse(board, v, rate);
+        ring.push(raw, board.q);
+      } else {
+        fuse(receiver, v, rate);
+        printf("%f %f %f %f\n", receiver.q[0], receiver.q[1], receiver.q[2], receiver.q[3]);
+      }
+    }
+    else if(line[0] == 'k'){
+      ring.skip(atoi(line + 1));
+    }
+    else if(line[0] == 'b'){
+      int n = atoi(line + 1);
+      std::string out;
+      while(ring.available() >= n){
+        uint8_t blob[8 + 20];
+        int k = ring.blobHeader(blob, n, (uint16_t)rate);
+        std::string b = hex(blob, 8);
+        for(int i = 0; i < k; i++){
+          ring.blobSample(i, blob + 8);
+          b += hex(blob + 8, 20);
+        }
+        ring.pop(k);
+        out += (out.empty() ? "" : " ") + b;
+      }
+      printf("%s\n", out.empty() ? "-" : out.c_str());
+    }
+    else if(line[0] == 'l'){
+      printf("%lu\n", ring.lost);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,68 @@
+// Driver of TacoSlipEncoder and TacoSlipDecoder for tools/taco_slip_test.py.
+// Reads lines of
+//   e <hex>           encodes a packet into the ring, prints ok or dropped
+//   w                 takes all the bytes of the ring, prints them in hex
+//   d <hex>           decodes the bytes, prints the packets completed in hex
+//   n                 prints the packets dropped by the encoder
+// and prints one line for each, - when there is nothing.
+
+#include <stdio.h>
+#include <iostream>
+#include <string>
+#include "TacoSlip.h"
+
+static std::string hex(const uint8_t* data, int length){
+  static const char digits[] = "0123456789abcdef";
+  std::string s;
+  for(int i = 0; i < length; i++){
+    s += digits[data[i] >> 4];
+    s += digits[data[i] & 15];
+  }
+  return s;
+}
+
+static std::string bytes(const std::string& hex){
+  std::string s;
+  for(size_t i = 0; i + 1 < hex.size(); i += 2){
+    s += (char)std::stoi(hex.substr(i, 2), NULL, 16);
+  }
+  return s;
+}
+
+static TacoSlipEncoder encoder;
+static TacoSlipDecoder decoder;
+
+int main(){
+  std::string line;
+  while(std::getline(std::cin, line)){
+    if(line.empty()) continue;
+    std::string arg = line.size() > 2 ? bytes(line.substr(2)) : "";
+    std::string out;
+
+    if(line[0] == 'e'){
+      encoder.beginFrame();
+      for(size_t i = 0; i < arg.size(); i++) encoder.write((uint8_t)arg[i]);
+      out = encoder.endFrame() ? "ok" : "dropped";
+    }
+    else if(line[0] == 'w'){
+      const uint8_t* data;
+      uint32_t n;
+      while((n = encoder.pending(data)) > 0){   //in two pieces when it wraps
+        out += hex(data, n);
+        encoder.consume(n);
+      }
+    }
+    else if(line[0] == 'd'){
+      for(size_t i = 0; i < arg.size(); i++){
+        const uint8_t* packet;
+        int length = decoder.decode((uint8_t)arg[i], packet);
+        if(length > 0) out += (out.empty() ? "" : " ") + hex(packet, length);
+      }
+    }
+    else if(line[0] == 'n'){
+      out = std::to_string(encoder.dropped);
+    }
+    printf("%s\n", out.empty() ? "-" : out.c_str());
+  }
+  return 0;
+}
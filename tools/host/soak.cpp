@@ -0,0 +1,215 @@
+// Soak of the frame path of Taco for tools/taco_alloc_test.py, built with
+// -DTACO_ALLOC_STATS=1. The arguments are the frames to send and "leak", to
+// allocate in send once every 1000 frames. Every frame is read from the pins,
+// encoded as send() does with one of the three frame headers, written to the
+// SLIP and the ESP-NOW transports, decoded and forwarded as a gateway does,
+// with an IMU sample fused and sent in blobs and the clock synced. Prints
+//   control <name> <allocs> <frees> ...   the counts of every subsystem made
+//                                         by a known piece of code
+//   counts <when> <allocs> <frees> ...    after 1000 frames and at the end
+//   frames <n> bytes <n> dropped <n>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+#include "TacoAlloc.h"
+#include "TacoPacket.h"
+#include "TacoSlip.h"
+#include "TacoEspNow.h"
+#include "TacoImuSamples.h"
+#include "TacoClock.h"
+
+#define WARM_UP 1000
+
+static TacoPacket txPacket;
+static TacoPacket imuPacket;
+static TacoBundle espNowBundle;
+static TacoSlipEncoder slip;
+static TacoSlipDecoder slipRx;
+static TacoEspNowFrame node;
+static TacoEspNowQueue gateway;
+static TacoImuRing imu;
+static TacoMadgwick madgwick;
+static TacoClock syncClock;
+static unsigned long bytes = 0;
+static int* volatile kept;        //so the compiler keeps the allocations of the controls
+
+static void writeBE32(uint8_t* p, uint32_t v){
+  p[0] = v >> 24;
+  p[1] = v >> 16;
+  p[2] = v >> 8;
+  p[3] = v;
+}
+
+static void allocate(int n){
+  for(int i = 0; i < n; i++){
+    kept = new int(i);
+    delete kept;
+  }
+}
+
+static void print(const char* what, const char* name, const uint32_t* allocs, const uint32_t* frees,
+                  const uint32_t* allocs0 = NULL, const uint32_t* frees0 = NULL){
+  printf("%s %s", what, name);
+  for(int i = 0; i < TACO_SUB_COUNT; i++){
+    printf(" %u %u", allocs[i] - (allocs0 ? allocs0[i] : 0), frees[i] - (frees0 ? frees0[i] : 0));
+  }
+  printf("\n");
+}
+
+//the counts made by f
+template <typename F> static void control(const char* name, F f){
+  uint32_t a0[TACO_SUB_COUNT], f0[TACO_SUB_COUNT], a1[TACO_SUB_COUNT], f1[TACO_SUB_COUNT];
+  TacoAlloc::counts(a0, f0);
+  f();
+  TacoAlloc::counts(a1, f1);
+  print("control", name, a1, f1, a0, f0);
+}
+
+//what the transports and the gateway do with a packet in pieces
+static void transmit(const uint8_t* const* parts, const int* lengths, int nParts, bool serial){
+  if(serial){
+    slip.beginFrame();
+    for(int p = 0; p < nParts; p++){
+      for(int i = 0; i < lengths[p]; i++) slip.write(parts[p][i]);
+    }
+    slip.endFrame();
+
+    //the writer task and the other end of the cable
+    const uint8_t* data;
+    uint32_t n;
+    while((n = slip.pending(data)) > 0){
+      TacoAllocScope scope(TACO_SUB_OSC);
+      for(uint32_t i = 0; i < n; i++){
+        const uint8_t* packet;
+        int length = slipRx.decode(data[i], packet);
+        bytes += length;
+      }
+      slip.consume(n);
+    }
+  } else {
+    node.begin();
+    for(int p = 0; p < nParts; p++){
+      for(int i = 0; i < lengths[p]; i++) node.write(parts[p][i]);
+    }
+    if(!node.isOverflow()) gateway.push(node.data(), node.length());
+
+    const uint8_t* frame;
+    int length;
+    espNowBundle.begin(1);
+    while((length = gateway.receive(frame)) > 0){
+      if(!espNowBundle.add(frame, length)) break;
+    }
+    bytes += espNowBundle.length();
+  }
+}
+
+//Taco::sendFrame(), for a header: 0 none, 1 args, 2 bundle
+static void sendFrame(int header, uint32_t seq, uint64_t now, bool serial){
+  if(header == 1){
+    if(!txPacket.insertTypeTags("ih")) return;
+    txPacket.addInt32(seq);
+    txPacket.addInt64(now);
+  }
+  if(txPacket.overflow()) return;
+
+  if(header == 2){
+    uint8_t head[48];
+    TacoBundle::header(head, now);
+    writeBE32(head + 16, 20);
+    memcpy(head + 20, "/taco/frame\0,i\0\0", 16);
+    writeBE32(head + 36, seq);
+    writeBE32(head + 40, txPacket.length());
+    const uint8_t* parts[2] = {head, txPacket.data()};
+    int lengths[2] = {44, txPacket.length()};
+    transmit(parts, lengths, 2, serial);
+    return;
+  }
+  const uint8_t* data = txPacket.data();
+  int length = txPacket.length();
+  transmit(&data, &length, 1, serial);
+}
+
+int main(int argc, char** argv){
+  long frames = argc > 1 ? atol(argv[1]) : 1000000;
+  bool leak = argc > 2 && strcmp(argv[2], "leak") == 0;
+  TacoAlloc::setTask(TACO_SUB_OTHER);   //this is the loop
+
+  control("scope", []{
+    TacoAllocScope scope(TACO_SUB_OSC);
+    allocate(3);
+  });
+  control("nested", []{
+    TacoAllocScope scope(TACO_SUB_SEND);
+    {
+      TacoAllocScope inner(TACO_SUB_CONFIG);
+      allocate(2);
+    }
+    allocate(1);
+  });
+  std::thread* web = NULL;
+  control("thread", [&web]{
+    web = new std::thread([]{
+      TacoAlloc::setTask(TACO_SUB_WEB);
+      allocate(5);
+    });
+    web->join();
+  });
+  delete web;
+
+  uint32_t allocs[TACO_SUB_COUNT], frees[TACO_SUB_COUNT];
+  for(long f = 0; f < frames; f++){
+    if(f == WARM_UP){
+      TacoAlloc::counts(allocs, frees);
+      print("counts", "warm", allocs, frees);
+    }
+    uint64_t now = 1000000 + f * 1000;
+
+    float values[8];
+    {
+      TacoAllocScope scope(TACO_SUB_PINS);
+      for(int i = 0; i < 8; i++) values[i] = (f * (i + 1)) % 4096 / 4095.0f;
+    }
+    {
+      TacoAllocScope scope(TACO_SUB_SEND);
+      txPacket.clear();
+      txPacket.addFloats("/taco/pins", values, 8);
+      sendFrame(f % 3, (uint32_t)f, now, f % 2 == 0);
+      if(leak && f % 1000 == 0) kept = new int(0);
+    }
+    {
+      TacoAllocScope scope(TACO_SUB_SENSORS);
+      int16_t raw[6] = {0, (int16_t)(f % 200), 4096, (int16_t)(f % 50 - 25), 0, 0};
+      madgwick.update(raw[3] * 0.001f, raw[4] * 0.001f, raw[5] * 0.001f, raw[0], raw[1], raw[2], 0.002f);
+      imu.push(raw, madgwick.q);
+      while(imu.available() >= 10){
+        uint8_t be[20];
+        imuPacket.clear();
+        imuPacket.addString("/imu/blob");
+        imuPacket.addString(",b");
+        int n = imu.blobHeader(be, 10, 500);
+        imuPacket.addInt32(8 + n * 20);
+        imuPacket.write(be, 8);
+        for(int i = 0; i < n; i++){
+          imu.blobSample(i, be);
+          imuPacket.write(be, 20);
+        }
+        imuPacket.pad();
+        imu.pop(n);
+        const uint8_t* data = imuPacket.data();
+        int length = imuPacket.length();
+        transmit(&data, &length, 1, true);
+      }
+    }
+    if(f % 100 == 0){
+      TacoAllocScope scope(TACO_SUB_OSC);
+      syncClock.sample(now, now + 5000000 + 200, now + 5000000 + 250, now + 400);
+    }
+  }
+  TacoAlloc::counts(allocs, frees);
+  print("counts", "end", allocs, frees);
+  printf("frames %ld bytes %lu dropped %lu\n", frames, bytes, slip.dropped);
+  return 0;
+}
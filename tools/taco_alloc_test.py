@@ -0,0 +1,94 @@
+#!/usr/bin/env python3
+"""
+Soak of the frame path of Taco on this computer, with the allocations of
+every subsystem counted (TACO_ALLOC_STATS, Taco/TacoAlloc.cpp).
+
+    python3 tools/taco_alloc_test.py [--frames 5000000]
+
+It builds with -DTACO_ALLOC_STATS=1 the counting of operator new and delete,
+TacoPacket, TacoBundle, the SLIP and ESP-NOW framing, the IMU ring and fusion
+and TacoClock with tools/host/soak.cpp (it needs g++). That sends millions
+of frames as send() does, with every frame header, through both transports,
+and the IMU blobs and the clock sync besides. It checks:
+
+  * allocations are counted for the TacoAllocScope of the loop, also nested,
+    and for the subsystem of a thread (a task on the board)
+  * the counts of every subsystem do not move after the first 1000 frames
+  * a leak of one allocation every 1000 frames in send is seen
+
+The Taco class itself (sendMessage() with an OSCMessage, sendParts() to
+WiFiUDP) needs the Arduino core and the OSC library, so on the board
+tools/taco_soak.py watches the same counts through /api/stats.
+"""
+
+import argparse
+import os
+import sys
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from taco_host import build, run
+
+SUBSYSTEMS = ["other", "pins", "send", "osc", "config", "sensors", "web", "live", "discovery"]
+SOURCES = ["TacoAlloc.cpp", "TacoPacket.cpp", "TacoSlip.cpp", "TacoEspNow.cpp", "TacoImuSamples.cpp", "TacoClock.cpp"]
+
+
+def soak(program, frames, leak=False):
+    """{(what, name): {subsystem: (allocs, frees)}} and the totals of the run"""
+    out = run(program, "", str(frames), *(["leak"] if leak else []))
+    counts = {}
+    totals = {}
+    for line in out.splitlines():
+        words = line.split()
+        if words[0] in ("control", "counts"):
+            values = [int(v) for v in words[2:]]
+            counts[(words[0], words[1])] = {s: (values[2 * i], values[2 * i + 1]) for i, s in enumerate(SUBSYSTEMS)}
+        elif words[0] == "frames":
+            totals = {words[i]: int(words[i + 1]) for i in range(0, len(words), 2)}
+    return counts, totals
+
+
+def moved(counts):
+    """the subsystems whose counts are not zero"""
+    return {s: c for s, c in counts.items() if c != (0, 0)}
+
+
+def growth(counts):
+    end, warm = counts[("counts", "end")], counts[("counts", "warm")]
+    return moved({s: (end[s][0] - warm[s][0], end[s][1] - warm[s][1]) for s in SUBSYSTEMS})
+
+
+def check(name, ok, detail):
+    print("%-4s %-48s %s" % ("ok" if ok else "FAIL", name, detail))
+    return ok
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Host soak of the allocations of the frame path")
+    parser.add_argument("--frames", type=int, default=5000000, help="frames to send")
+    options = parser.parse_args()
+
+    program = build("soak.cpp", *SOURCES, flags=["-DTACO_ALLOC_STATS=1"])
+    counts, totals = soak(program, options.frames)
+    results = []
+
+    scope = moved(counts[("control", "scope")])
+    results.append(check("counted for the scope of the loop", scope == {"osc": (3, 3)}, str(scope)))
+    nested = moved(counts[("control", "nested")])
+    results.append(check("nested scopes", nested == {"config": (2, 2), "send": (1, 1)}, str(nested)))
+    thread = counts[("control", "thread")]
+    results.append(check("counted for the task of a thread", thread["web"][0] == 5, "web %d allocs" % thread["web"][0]))
+
+    grown = growth(counts)
+    results.append(check("flat over %d frames" % options.frames, not grown and totals.get("dropped") == 0,
+                         "%.0f MB sent, %s" % (totals.get("bytes", 0) / 1e6, grown or "no allocs")))
+
+    frames = 100000
+    counts, _ = soak(program, frames, leak=True)
+    grown = growth(counts)
+    expected = (frames - 1000) // 1000
+    results.append(check("a leak in send is seen", grown == {"send": (expected, 0)}, str(grown)))
+    return 0 if all(results) else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
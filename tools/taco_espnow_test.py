@@ -0,0 +1,86 @@
+#!/usr/bin/env python3
+"""
+Checks of the ESP-NOW frames of a node and the queue of a gateway
+(Taco/TacoEspNow.cpp).
+
+    python3 tools/taco_espnow_test.py
+
+It builds TacoEspNow.cpp with tools/host/espnow.cpp for this computer (it
+needs g++), a node and a gateway joined by a loopback, and checks:
+
+  * frames up to 250 bytes arrive whole and in order, bigger ones are not sent
+  * with the loop not forwarding, the queue keeps TACO_ESPNOW_QUEUE frames
+    and drops the next ones
+  * the frame the gateway is forwarding is not overwritten by new frames,
+    its slot is freed by the next receive()
+  * the queue wraps around
+"""
+
+import os
+import random
+import sys
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from taco_host import build, run
+
+QUEUE = 16              # TACO_ESPNOW_QUEUE
+FRAME_SIZE = 250        # TACO_ESPNOW_FRAME_SIZE
+
+
+def loopback(program, commands):
+    """One output line of the driver for every command"""
+    text = "".join(c[0] + (" " + c[1].hex() if len(c) > 1 else "") + "\n" for c in commands)
+    return run(program, text).splitlines()
+
+
+def check(name, ok, detail):
+    print("%-4s %-48s %s" % ("ok" if ok else "FAIL", name, detail))
+    return ok
+
+
+def main():
+    program = build("espnow.cpp", "TacoEspNow.cpp")
+    rng = random.Random(1)
+    results = []
+
+    frames = [os.urandom(n) for n in (1, 12, 100, FRAME_SIZE - 1, FRAME_SIZE)]
+    out = loopback(program, [c for f in frames for c in (("n", f), ("g",))] + [("n", bytes(FRAME_SIZE + 1)), ("g",)])
+    received = [bytes.fromhex(l) for l in out[1:len(frames) * 2:2]]
+    results.append(check("frames up to 250 bytes arrive whole", out[0:len(frames) * 2:2] == ["ok"] * len(frames) and
+                         received == frames, "%d frames" % len(received)))
+    results.append(check("bigger ones are not sent", out[-2:] == ["overflow", "-"], " ".join(out[-2:])))
+
+    #nobody forwards: the queue fills
+    frames = [bytes([i]) * 20 for i in range(QUEUE + 4)]
+    out = loopback(program, [("n", f) for f in frames] + [("g",)] * (QUEUE + 1))
+    status = out[:len(frames)]
+    received = [bytes.fromhex(l) for l in out[len(frames):] if l != "-"]
+    results.append(check("full queue drops the new frames", status == ["ok"] * QUEUE + ["full"] * 4 and
+                         received == frames[:QUEUE], "%d kept, %d dropped" % (status.count("ok"), status.count("full"))))
+
+    #a frame being forwarded keeps its slot until the next receive()
+    frames = [bytes([i]) * 30 for i in range(QUEUE + 2)]
+    commands = [("n", f) for f in frames[:QUEUE]] + [("g",), ("n", frames[QUEUE]), ("h",), ("g",), ("n", frames[QUEUE + 1])]
+    out = loopback(program, commands)
+    results.append(check("frame being forwarded is not overwritten",
+                         out[QUEUE:] == [frames[0].hex(), "full", frames[0].hex(), frames[1].hex(), "ok"],
+                         " ".join(l[:4] for l in out[QUEUE:])))
+
+    #many times around the queue, a few frames at a time
+    commands = []
+    sent = []
+    for _ in range(200):
+        for _ in range(rng.randrange(1, QUEUE)):
+            f = os.urandom(rng.randrange(1, FRAME_SIZE + 1))
+            commands.append(("n", f))
+            sent.append(f)
+        commands += [("g",)] * QUEUE
+    out = loopback(program, commands)
+    received = [bytes.fromhex(l) for l, c in zip(out, commands) if c[0] == "g" and l != "-"]
+    results.append(check("queue wraps around", received == sent, "%d frames" % len(received)))
+
+    return 0 if all(results) else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,513 @@
+#!/usr/bin/env python3
+"""
+Update and configure many Taco boards at once.
+
+Find the boards on the network (the _osc._udp services of mDNS with the text
+records of a Taco, other OSC software is left alone), or give them with --hosts:
+
+    python3 tools/taco_fleet.py discover
+    python3 tools/taco_fleet.py config settings.json
+    python3 tools/taco_fleet.py ota firmware.bin --jobs 8
+    python3 tools/taco_fleet.py ota firmware.bin --hosts 192.168.0.10 192.168.0.11
+
+config posts a JSON object to /api/config of every board (see beginServer()),
+ota uploads a firmware to /update with its SHA-256, waits for the board to
+come back and for the trial of the new firmware to end, checks that the board
+runs it (a firmware that is not healthy is rolled back) and prints the status
+of every board. Failed boards are retried
+(--retries). The state of a campaign is kept in a file (--state), so running
+the same command again skips the boards that already got that firmware or
+configuration and only retries the rest.
+
+fake-board runs a stand-in of the board server on this computer, to try the
+tool without boards:
+
+    python3 tools/taco_fleet.py fake-board --port 8080 &
+    python3 tools/taco_fleet.py ota firmware.bin --hosts 127.0.0.1:8080
+
+tools/taco_fleet_test.py runs the tool against it.
+"""
+
+import argparse
+import base64
+import concurrent.futures
+import hashlib
+import http.client
+import http.server
+import json
+import os
+import socket
+import struct
+import sys
+import threading
+import time
+
+
+MDNS_GROUP = ("224.0.0.251", 5353)
+
+
+# ---------------------------------------------------------------------------
+# discovery
+
+def mdns_query(names):
+    """An mDNS query packet asking for every (name, type)"""
+    packet = struct.pack(">HHHHHH", 0, 0, len(names), 0, 0, 0)
+    for name, qtype in names:
+        for label in name.strip(".").split("."):
+            packet += bytes([len(label)]) + label.encode()
+        packet += b"\x00" + struct.pack(">HH", qtype, 1)
+    return packet
+
+
+def read_name(data, pos):
+    """A DNS name at pos, following compression pointers. Returns (name, next pos)"""
+    labels = []
+    end = None
+    for _ in range(64):
+        length = data[pos]
+        if length & 0xC0 == 0xC0:
+            if end is None:
+                end = pos + 2
+            pos = ((length & 0x3F) << 8) | data[pos + 1]
+            continue
+        pos += 1
+        if length == 0:
+            break
+        labels.append(data[pos:pos + length].decode(errors="replace"))
+        pos += length
+    return ".".join(labels), (end if end is not None else pos)
+
+
+def parse_records(data):
+    """All the resource records of a DNS packet, as (name, type, rdata offset, rdata)"""
+    _, _, qd, an, ns, ar = struct.unpack(">HHHHHH", data[:12])
+    pos = 12
+    for _ in range(qd):
+        _, pos = read_name(data, pos)
+        pos += 4
+    records = []
+    for _ in range(an + ns + ar):
+        name, pos = read_name(data, pos)
+        rtype, _, _, length = struct.unpack(">HHIH", data[pos:pos + 10])
+        pos += 10
+        records.append((name, rtype, pos, data[pos:pos + length]))
+        pos += length
+    return records
+
+
+def read_txt(rdata):
+    """The key=value strings of a TXT record, as a dict"""
+    keys = {}
+    pos = 0
+    while pos < len(rdata):
+        length = rdata[pos]
+        key, _, value = rdata[pos + 1:pos + 1 + length].decode(errors="replace").partition("=")
+        keys[key] = value
+        pos += 1 + length
+    return keys
+
+
+class Responses:
+    """What the _osc._udp services answered. A Taco is told from other OSC
+    software by the subscribe key of its text records, as Taco::discover() does"""
+
+    def __init__(self):
+        self.services = {}      # instance: {"txt": {...}, "target": host, "ip": sender}
+        self.addresses = {}     # host: ip
+
+    def add(self, data, sender):
+        for rname, rtype, pos, rdata in parse_records(data):
+            if rtype == 12 and rname == "_osc._udp.local":
+                self.services.setdefault(read_name(data, pos)[0], {}).setdefault("ip", sender)
+            elif rtype == 16 and rname.endswith("._osc._udp.local"):
+                self.services.setdefault(rname, {"ip": sender})["txt"] = read_txt(rdata)
+            elif rtype == 33 and rname.endswith("._osc._udp.local"):
+                self.services.setdefault(rname, {"ip": sender})["target"] = read_name(data, pos + 6)[0]
+            elif rtype == 1 and len(rdata) == 4:
+                self.addresses[rname] = socket.inet_ntoa(rdata)
+
+    def unknown(self):
+        """Instances whose text records did not come yet"""
+        return [name for name, service in self.services.items() if "txt" not in service]
+
+    def boards(self):
+        """{ip: board name} of the services that are Tacos"""
+        found = {}
+        for name, service in self.services.items():
+            if "subscribe" not in service.get("txt", {}):
+                continue
+            ip = self.addresses.get(service.get("target"), service["ip"])
+            found[ip] = name.split(".")[0]
+        return found
+
+
+def discover(timeout=2.0):
+    """Boards offering an _osc._udp service with the text records of a Taco.
+    Returns {ip: board name}"""
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM, socket.IPPROTO_UDP)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    sock.setsockopt(socket.IPPROTO_IP, socket.IP_MULTICAST_TTL, 255)
+    sock.bind(("", 0))
+    sock.settimeout(0.2)
+
+    responses = Responses()
+    end = time.time() + timeout
+    next_query = 0
+    while time.time() < end:
+        if time.time() >= next_query:
+            # the text records of the services that did not send them yet
+            names = [("_osc._udp.local", 12)] + [(name, 16) for name in responses.unknown()]
+            sock.sendto(mdns_query(names), MDNS_GROUP)
+            next_query = time.time() + 0.5
+        try:
+            data, (ip, _) = sock.recvfrom(9000)
+        except socket.timeout:
+            continue
+        try:
+            responses.add(data, ip)
+        except (IndexError, struct.error):
+            continue
+    return responses.boards()
+
+
+# ---------------------------------------------------------------------------
+# pushing to the boards
+
+class Progress:
+    """Status line of every board, printed when it changes"""
+
+    def __init__(self, quiet=False):
+        self.lock = threading.Lock()
+        self.status = {}
+        self.quiet = quiet
+
+    def set(self, host, status):
+        with self.lock:
+            if self.status.get(host) == status:
+                return
+            self.status[host] = status
+            if not self.quiet:
+                print("%-22s %s" % (host, status), flush=True)
+
+    def report(self):
+        print()
+        print("%-22s %s" % ("board", "status"))
+        for host in sorted(self.status):
+            print("%-22s %s" % (host, self.status[host]))
+
+
+class UploadBody:
+    """multipart/form-data body read from the file as it is sent"""
+
+    def __init__(self, path, boundary, progress, host):
+        self.head = ("--%s\r\nContent-Disposition: form-data; name=\"update\"; filename=\"%s\"\r\n"
+                     "Content-Type: application/octet-stream\r\n\r\n" % (boundary, os.path.basename(path))).encode()
+        self.tail = ("\r\n--%s--\r\n" % boundary).encode()
+        self.size = os.path.getsize(path)
+        self.file = open(path, "rb")
+        self.sent = 0
+        self.progress = progress
+        self.host = host
+        self.length = len(self.head) + self.size + len(self.tail)
+
+    def read(self, n=8192):
+        if self.head:
+            chunk, self.head = self.head, b""
+            return chunk
+        chunk = self.file.read(n)
+        if chunk:
+            self.sent += len(chunk)
+            self.progress.set(self.host, "uploading %3d%%" % (100 * self.sent // max(self.size, 1) // 10 * 10))
+            return chunk
+        chunk, self.tail = self.tail, b""
+        return chunk
+
+    def close(self):
+        self.file.close()
+
+
+def split_host(host):
+    if ":" in host:
+        name, port = host.rsplit(":", 1)
+        return name, int(port)
+    return host, 80
+
+
+def request(host, method, path, body=None, headers=None, timeout=30):
+    name, port = split_host(host)
+    conn = http.client.HTTPConnection(name, port, timeout=timeout)
+    try:
+        conn.request(method, path, body=body, headers=headers or {})
+        reply = conn.getresponse()
+        return reply.status, reply.read().decode(errors="replace")
+    finally:
+        conn.close()
+
+
+def basic_auth(user, password):
+    return "Basic " + base64.b64encode(("%s:%s" % (user, password)).encode()).decode()
+
+
+def wait_back(host, timeout):
+    """Wait for the board to answer again after a reboot"""
+    time.sleep(2)
+    end = time.time() + timeout
+    while time.time() < end:
+        try:
+            status, _ = request(host, "GET", "/api/config", timeout=3)
+            if status == 200:
+                return True
+        except OSError:
+            pass
+        time.sleep(1)
+    return False
+
+
+def wait_trial(host, timeout):
+    """Wait for the firmware of the board to be confirmed or rolled back.
+    Returns the "firmware" of /api/config, {} if the board does not give it"""
+    end = time.time() + timeout
+    firmware = {}
+    while True:
+        try:
+            status, text = request(host, "GET", "/api/config", timeout=10)
+            if status == 200:
+                firmware = json.loads(text).get("firmware", {})
+                if not firmware.get("trial"):
+                    return firmware
+        except (OSError, ValueError, http.client.HTTPException):
+            pass    # rebooting into the previous firmware
+        if time.time() >= end:
+            return firmware
+        time.sleep(1)
+
+
+def push_ota(host, path, sha256, args, progress):
+    boundary = "tacofleet%d" % int(time.time() * 1000)
+    body = UploadBody(path, boundary, progress, host)
+    try:
+        status, text = request(host, "POST", "/update?sha256=" + sha256, body=body, headers={
+            "Content-Type": "multipart/form-data; boundary=" + boundary,
+            "Content-Length": str(body.length),
+            "Authorization": basic_auth(args.user, args.password),
+        }, timeout=args.timeout)
+    finally:
+        body.close()
+    if status != 200:
+        raise RuntimeError("HTTP %d %s" % (status, text.strip()))
+    progress.set(host, "rebooting")
+    if args.no_wait:
+        return "uploaded"
+    if not wait_back(host, args.timeout):
+        raise RuntimeError("did not come back")
+
+    # the new firmware is on trial until it is healthy (TACO_OTA_HEALTH_TIME)
+    progress.set(host, "on trial")
+    firmware = wait_trial(host, args.trial_time)
+    if firmware.get("trial"):
+        raise RuntimeError("still on trial after %d s" % args.trial_time)
+    if firmware.get("sha256") != sha256:
+        raise RuntimeError("rolled back, it runs %s" % (firmware.get("sha256") or "an unknown firmware")[:16])
+    return "updated"
+
+
+def push_config(host, path, sha256, args, progress):
+    with open(path, "rb") as f:
+        data = f.read()
+    progress.set(host, "configuring")
+    status, text = request(host, "POST", "/api/config", body=data,
+                           headers={"Content-Type": "application/json"}, timeout=args.timeout)
+    if status != 200:
+        raise RuntimeError("HTTP %d %s" % (status, text.strip()))
+    return "configured"
+
+
+class Campaign:
+    """What every board already got, kept in a file between runs"""
+
+    def __init__(self, path):
+        self.path = path
+        self.lock = threading.Lock()
+        self.done = {}
+        if path and os.path.exists(path):
+            with open(path) as f:
+                self.done = json.load(f)
+
+    def has(self, host, key):
+        return key in self.done.get(host, [])
+
+    def add(self, host, key):
+        with self.lock:
+            self.done.setdefault(host, []).append(key)
+            if self.path:
+                with open(self.path + ".tmp", "w") as f:
+                    json.dump(self.done, f, indent=1)
+                os.replace(self.path + ".tmp", self.path)
+
+
+def run(action, path, hosts, args):
+    with open(path, "rb") as f:
+        sha256 = hashlib.sha256(f.read()).hexdigest()
+    key = "%s:%s" % (action.__name__, sha256)
+    campaign = Campaign(args.state)
+    progress = Progress(args.quiet)
+
+    def one(host):
+        if campaign.has(host, key):
+            progress.set(host, "already done")
+            return True
+        for attempt in range(args.retries + 1):
+            try:
+                progress.set(host, "starting" if attempt == 0 else "retry %d" % attempt)
+                progress.set(host, action(host, path, sha256, args, progress))
+                campaign.add(host, key)
+                return True
+            except (OSError, RuntimeError, http.client.HTTPException) as e:
+                progress.set(host, "failed: %s" % e)
+                time.sleep(min(2 ** attempt, 10))
+        return False
+
+    with concurrent.futures.ThreadPoolExecutor(max_workers=args.jobs) as pool:
+        results = list(pool.map(one, hosts))
+    progress.report()
+    print("%d of %d boards ok" % (sum(results), len(results)))
+    return 0 if all(results) else 1
+
+
+# ---------------------------------------------------------------------------
+# a stand-in of the board server
+
+class FakeBoard(http.server.BaseHTTPRequestHandler):
+    config = {"network": {"mode": "ap", "name": "fake"}, "port": 4444, "sample_rate": 0,
+              "firmware": {"sha256": hashlib.sha256(b"").hexdigest(), "trial": False}}
+    firmware = None
+    fail_next = 0       # answer 500 to so many requests, to try the retries
+    health_time = 1.0   # seconds a new firmware is on trial
+    unhealthy = False   # the new firmwares are rolled back
+    trial = None        # (time of the reboot, SHA-256 of the image, previous SHA-256)
+
+    @classmethod
+    def end_trial(cls):
+        if cls.trial is None or time.time() - cls.trial[0] < cls.health_time:
+            return
+        _, sha, previous = cls.trial
+        cls.trial = None
+        cls.config["firmware"] = {"sha256": previous if cls.unhealthy else sha, "trial": False}
+
+    def reply(self, status, body, kind="application/json"):
+        data = body.encode()
+        self.send_response(status)
+        self.send_header("Content-Type", kind)
+        self.send_header("Content-Length", str(len(data)))
+        self.end_headers()
+        self.wfile.write(data)
+
+    def do_GET(self):
+        if self.path == "/api/config":
+            FakeBoard.end_trial()
+            self.reply(200, json.dumps(FakeBoard.config))
+        else:
+            self.reply(404, "not found", "text/plain")
+
+    def do_POST(self):
+        length = int(self.headers.get("Content-Length", 0))
+        if FakeBoard.fail_next > 0:
+            FakeBoard.fail_next -= 1
+            self.rfile.read(length)
+            self.reply(500, "fake failure", "text/plain")
+            return
+
+        if self.path == "/api/config":
+            try:
+                posted = json.loads(self.rfile.read(length))
+                posted.pop("firmware", None)
+                FakeBoard.config.update(posted)
+            except ValueError:
+                self.reply(400, '{"ok":false,"error":"bad json"}')
+                return
+            self.reply(200, '{"ok":true}')
+
+        elif self.path.startswith("/update"):
+            expected = self.path.partition("sha256=")[2]
+            body = self.rfile.read(length)
+            if self.headers.get("Authorization") != basic_auth("admin", "admin"):
+                self.reply(401, "UNAUTHORIZED", "text/plain")
+                return
+            boundary = self.headers.get_content_type() == "multipart/form-data" and \
+                self.headers.get_param("boundary")
+            if not boundary:
+                self.reply(400, "BAD ARGS", "text/plain")
+                return
+            start = body.index(b"\r\n\r\n") + 4
+            end = body.rindex(b"\r\n--" + boundary.encode())
+            image = body[start:end]
+            if expected and hashlib.sha256(image).hexdigest() != expected.lower():
+                self.reply(500, "SHA-256 does not match", "text/plain")
+                return
+            FakeBoard.firmware = image
+            sha = hashlib.sha256(image).hexdigest()
+            FakeBoard.trial = (time.time(), sha, FakeBoard.config["firmware"]["sha256"])
+            FakeBoard.config["firmware"] = {"sha256": sha, "trial": True}
+            self.reply(200, "OK, rebooting\r\n", "text/plain")
+        else:
+            self.reply(404, "not found", "text/plain")
+
+    def log_message(self, *args):
+        pass
+
+
+def fake_board(port, fail=0, unhealthy=False):
+    FakeBoard.fail_next = fail
+    FakeBoard.unhealthy = unhealthy
+    server = http.server.ThreadingHTTPServer(("", port), FakeBoard)
+    return server
+
+
+# ---------------------------------------------------------------------------
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("command", choices=["discover", "config", "ota", "fake-board"])
+    parser.add_argument("file", nargs="?", help="JSON settings or firmware .bin")
+    parser.add_argument("--hosts", nargs="+", help="boards (ip or ip:port) instead of mDNS discovery")
+    parser.add_argument("--jobs", type=int, default=4, help="boards at once")
+    parser.add_argument("--retries", type=int, default=2, help="retries of a board that failed")
+    parser.add_argument("--timeout", type=float, default=60, help="seconds per transfer and reboot")
+    parser.add_argument("--state", default=".taco_fleet.json", help="file keeping what every board got")
+    parser.add_argument("--no-wait", action="store_true", help="do not wait for the boards to reboot")
+    parser.add_argument("--trial-time", type=float, default=150,
+                        help="seconds a new firmware can be on trial (TACO_OTA_TRIAL_TIME, 120 s)")
+    parser.add_argument("--user", default="admin", help="user of /update (setOtaCredentials())")
+    parser.add_argument("--password", default="admin", help="password of /update")
+    parser.add_argument("--quiet", action="store_true", help="only the final report")
+    parser.add_argument("--port", type=int, default=8080, help="port of fake-board")
+    parser.add_argument("--fail", type=int, default=0, help="fake-board fails so many requests first")
+    parser.add_argument("--unhealthy", action="store_true", help="fake-board rolls back every new firmware")
+    args = parser.parse_args()
+
+    if args.command == "fake-board":
+        print("fake board at port %d" % args.port)
+        fake_board(args.port, args.fail, args.unhealthy).serve_forever()
+        return 0
+
+    hosts = args.hosts
+    if not hosts:
+        boards = discover()
+        if args.command == "discover" or not boards:
+            for ip, name in sorted(boards.items()):
+                print("%-16s %s" % (ip, name))
+            if not boards:
+                print("no boards found", file=sys.stderr)
+            return 0 if boards else 1
+        hosts = sorted(boards)
+    elif args.command == "discover":
+        parser.error("discover does not take --hosts")
+
+    if not args.file:
+        parser.error("%s needs a file" % args.command)
+    action = push_ota if args.command == "ota" else push_config
+    return run(action, args.file, hosts, args)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,137 @@
+#!/usr/bin/env python3
+"""
+Checks of tools/taco_fleet.py against its stand-in of the board server.
+
+    python3 tools/taco_fleet_test.py
+
+It starts the fake board of taco_fleet.py on a free port of this computer and
+pushes to it:
+
+  * a firmware that stays: the board reports its SHA-256 once the trial ends
+  * a firmware that is rolled back: the board answers again, but with the
+    previous firmware, so the push fails
+  * a wrong password: /update answers 401 and nothing is written
+  * a configuration, after a failed request that the retries get over
+
+and it feeds the mDNS discovery the answers of a Taco and of other OSC software.
+"""
+
+import argparse
+import hashlib
+import io
+import os
+import socket
+import struct
+import sys
+import tempfile
+import threading
+import time
+from contextlib import redirect_stdout
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import taco_fleet
+from taco_fleet import FakeBoard
+
+
+def options(**changes):
+    """The options of taco_fleet.py, for the stand-in"""
+    args = argparse.Namespace(jobs=1, retries=0, timeout=10, state=None, no_wait=False,
+                              trial_time=5, user="admin", password="admin", quiet=True)
+    for key, value in changes.items():
+        setattr(args, key, value)
+    return args
+
+
+def reset(unhealthy=False, fail=0):
+    FakeBoard.config["firmware"] = {"sha256": hashlib.sha256(b"old").hexdigest(), "trial": False}
+    FakeBoard.firmware = None
+    FakeBoard.trial = None
+    FakeBoard.unhealthy = unhealthy
+    FakeBoard.fail_next = fail
+
+
+def push(action, path, host, args):
+    """Exit code of a campaign, and what it printed"""
+    out = io.StringIO()
+    with redirect_stdout(out):
+        code = taco_fleet.run(action, path, [host], args)
+    return code, out.getvalue()
+
+
+def mdns_answer(instance, host, ip, txt):
+    """An mDNS answer with the PTR, SRV, TXT and A records of an _osc._udp service"""
+    def name(text):
+        return b"".join(bytes([len(l)]) + l.encode() for l in text.split(".")) + b"\0"
+
+    def record(rname, rtype, rdata):
+        return name(rname) + struct.pack(">HHIH", rtype, 0x8001, 120, len(rdata)) + rdata
+
+    service = instance + "._osc._udp.local"
+    strings = b"".join(bytes([len(t)]) + t.encode() for t in txt)
+    records = [record("_osc._udp.local", 12, name(service)),
+               record(service, 33, struct.pack(">HHH", 0, 0, 4444) + name(host)),
+               record(service, 16, strings),
+               record(host, 1, socket.inet_aton(ip))]
+    return struct.pack(">HHHHHH", 0, 0x8400, 0, len(records), 0, 0) + b"".join(records)
+
+
+def discovery_checks():
+    responses = taco_fleet.Responses()
+    responses.add(mdns_answer("taco-a1b2c3", "taco-a1b2c3.local", "192.168.0.10",
+                              ["name=taco", "rate=100", "subscribe=/taco/config/subscribe"]), "192.168.0.10")
+    responses.add(mdns_answer("laptop", "laptop.local", "192.168.0.20", ["version=1"]), "192.168.0.20")
+    boards = responses.boards()
+    return [check("discovery keeps only the Tacos", boards == {"192.168.0.10": "taco-a1b2c3"}, str(boards))]
+
+
+def check(name, ok, detail):
+    print("%-4s %-44s %s" % ("ok" if ok else "FAIL", name, detail))
+    return ok
+
+
+def main():
+    FakeBoard.health_time = 1.0
+    server = taco_fleet.fake_board(0)
+    host = "127.0.0.1:%d" % server.server_address[1]
+    threading.Thread(target=server.serve_forever, daemon=True).start()
+
+    results = discovery_checks()
+    with tempfile.TemporaryDirectory() as folder:
+        image = os.path.join(folder, "firmware.bin")
+        with open(image, "wb") as f:
+            f.write(os.urandom(100000))
+        sha = hashlib.sha256(open(image, "rb").read()).hexdigest()
+        settings = os.path.join(folder, "settings.json")
+        with open(settings, "w") as f:
+            f.write('{"sample_rate": 200}')
+
+        reset()
+        start = time.time()
+        code, out = push(taco_fleet.push_ota, image, host, options())
+        running = FakeBoard.config["firmware"]
+        results.append(check("firmware confirmed", code == 0 and running["sha256"] == sha,
+                             "exit %d after %.1f s" % (code, time.time() - start)))
+        results.append(check("waited for the end of the trial", time.time() - start >= FakeBoard.health_time,
+                             "trial of %.1f s" % FakeBoard.health_time))
+
+        reset(unhealthy=True)
+        code, out = push(taco_fleet.push_ota, image, host, options())
+        results.append(check("firmware rolled back", code == 1 and "rolled back" in out,
+                             "exit %d" % code))
+
+        reset()
+        code, out = push(taco_fleet.push_ota, image, host, options(password="wrong"))
+        results.append(check("wrong password", code == 1 and "401" in out and FakeBoard.firmware is None,
+                             "exit %d" % code))
+
+        reset(fail=1)
+        code, out = push(taco_fleet.push_config, settings, host, options(retries=1))
+        results.append(check("configuration, after a retry", code == 0 and FakeBoard.config["sample_rate"] == 200,
+                             "exit %d" % code))
+
+    server.shutdown()
+    return 0 if all(results) else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
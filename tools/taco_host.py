@@ -0,0 +1,41 @@
+#!/usr/bin/env python3
+"""
+Builds the parts of Taco that need nothing of Arduino (TacoClock.cpp, ...)
+with a driver of tools/host/ into a program of this computer, for the checks.
+
+    from taco_host import build, run
+    program = build("clock.cpp", "TacoClock.cpp")
+    out = run(program, "s 1 2 3 4\\nq 10\\n")
+
+It needs g++ (or the compiler in CXX).
+"""
+
+import os
+import subprocess
+import sys
+import tempfile
+
+TOOLS = os.path.dirname(os.path.abspath(__file__))
+LIBRARY = os.path.join(os.path.dirname(TOOLS), "Taco")
+FOLDER = tempfile.mkdtemp(prefix="taco_host_")
+
+
+def build(driver, *sources, flags=()):
+    """Compiles tools/host/<driver> with the sources of Taco/, returns the program"""
+    program = os.path.join(FOLDER, os.path.splitext(driver)[0])
+    command = [os.environ.get("CXX", "g++"), "-std=gnu++11", "-O2", "-Wall", "-I", LIBRARY]
+    command += list(flags) + [os.path.join(TOOLS, "host", driver)]
+    command += [os.path.join(LIBRARY, s) for s in sources] + ["-o", program]
+    result = subprocess.run(command, stdout=subprocess.PIPE, stderr=subprocess.STDOUT, universal_newlines=True)
+    if result.returncode != 0:
+        sys.exit("could not build %s:\n%s" % (driver, result.stdout))
+    return program
+
+
+def run(program, text="", *args):
+    """Output of the program with text as its input"""
+    result = subprocess.run([program] + list(args), input=text, stdout=subprocess.PIPE,
+                            universal_newlines=True)
+    if result.returncode != 0:
+        sys.exit("%s exited with %d" % (os.path.basename(program), result.returncode))
+    return result.stdout
@@ -0,0 +1,204 @@
+#!/usr/bin/env python3
+"""
+Replay of the /blob messages of a TacoImu (TACO_IMU_BLOB), to check the
+fusion and the count of lost samples (Taco/TacoImuSamples.cpp).
+
+    python3 tools/taco_imu_test.py [--capture FILE]
+
+It builds TacoImuSamples.cpp with tools/host/imu.cpp for this computer (it
+needs g++). The blobs are decoded from a capture of tools/taco_monitor.py
+--record: uint32 index of the first sample, uint16 samples << 16 | uint16
+rate, then 10 int16 per sample (accel, gyro, quaternion * 16384). The raw
+accel and gyro go through the fusion again, on a receiver that starts from
+no rotation, and it checks that it converges to the quaternions of the board
+(the rotation during a gap is not measured, so the RECOVER seconds after
+every gap are not compared). It prints the samples lost: the gaps of the
+indexes.
+
+Without --capture the capture is made here, as a board would send it: a
+sensor rolling 30 +- 25 degrees, its samples fused and sent through the ring
+of the board while update() is late once and the FIFO overflows once, and 3
+packets lost on the network. Then it also checks both fusions against the
+real orientation, that every sample has its index, also in the blobs cut by
+a gap, and that the gaps are the samples the board counted as lost plus the
+ones of the lost packets. --save FILE keeps that capture.
+"""
+
+import argparse
+import math
+import os
+import struct
+import sys
+import tempfile
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from taco_host import build, run
+from taco_monitor import record, capture
+
+ACCEL_SCALE = 4096.0    # MPU_ACCEL_SCALE, LSB per g
+GYRO_SCALE = 16.4       # MPU_GYRO_SCALE, LSB per degree/s
+SETTLE = 5.0            # seconds the fusions have to converge
+RECOVER = 2.0           # seconds after a gap (the rotation in it is not measured)
+
+
+def roll(t):
+    """the orientation of the made up capture: degrees around x"""
+    return 30 + 25 * math.sin(2 * math.pi * 0.25 * t)
+
+
+def true_gravity(t):
+    phi = math.radians(roll(t))
+    return (0, math.sin(phi), math.cos(phi))
+
+
+def roll_rate(t):
+    return 25 * 2 * math.pi * 0.25 * math.cos(2 * math.pi * 0.25 * t)
+
+
+def gravity(q):
+    """gravity seen by the sensor with the orientation q (w x y z)"""
+    w, x, y, z = q
+    return (2 * (x * z - w * y), 2 * (w * x + y * z), w * w - x * x - y * y + z * z)
+
+
+def angle(a, b):
+    """degrees between two directions"""
+    dot = sum(i * j for i, j in zip(a, b))
+    norm = math.sqrt(sum(i * i for i in a) * sum(j * j for j in b))
+    return math.degrees(math.acos(max(-1.0, min(1.0, dot / norm))))
+
+
+def osc_blob(address, blob):
+    def string(s):
+        return s + b"\0" * (4 - len(s) % 4)
+    return string(address) + string(b",b") + struct.pack(">i", len(blob)) + blob + b"\0" * (-len(blob) % 4)
+
+
+def make_capture(path, rate, beta, seconds=30, per_packet=20):
+    """A board streaming a rolling sensor. Returns the samples it lost and
+    the ones of the packets lost on the network"""
+    commands = []
+    late = (8.0, 8.5)               # update() does not run
+    overflow = int(12.0 * rate)     # the FIFO overflows at this sample
+    fifo = 1024 // 12
+    i = 0
+    while i < seconds * rate:
+        if i == overflow:
+            commands.append("k %d" % fifo)
+            i += fifo
+            continue
+        t = i / rate
+        raw = [int(round(a * ACCEL_SCALE)) for a in true_gravity(t)] + [int(round(roll_rate(t) * GYRO_SCALE)), 0, 0]
+        commands.append("s %d %d %d %d %d %d" % tuple(raw))
+        if i % 5 == 4 and not late[0] <= t < late[1]:      #every 10 ms at 500 Hz
+            commands.append("b %d" % per_packet)
+        i += 1
+    commands.append("l")
+
+    program = build("imu.cpp", "TacoImuSamples.cpp")
+    out = run(program, "\n".join(commands) + "\n", str(rate), str(beta)).splitlines()
+    board_lost = int(out[-1])
+    blobs = [bytes.fromhex(b) for line in out[:-1] if line != "-" for b in line.split()]
+
+    network_lost = 0
+    with open(path, "wb") as f:
+        for n, blob in enumerate(blobs):
+            if n in (100, 101, 300):
+                network_lost += struct.unpack_from(">I", blob, 4)[0] >> 16
+                continue
+            first = struct.unpack_from(">I", blob)[0]
+            record(f, osc_blob(b"/imu/blob", blob), int(first * 1e6 / rate))
+    return board_lost, network_lost
+
+
+def blobs(path):
+    """(index, rate, samples) of the /blob messages of a capture, by index.
+    A sample is 6 raw int16 and the quaternion"""
+    found = {}
+    for _, data in capture(path):
+        end = data.find(b"\0")
+        if end < 0 or not data[:end].endswith(b"/blob") or data[(end + 4) & ~3:(end + 4 & ~3) + 3] != b",b\0":
+            continue
+        pos = ((end + 4) & ~3) + 4
+        size, index, header = struct.unpack_from(">iII", data, pos)
+        n, rate = header >> 16, header & 0xFFFF
+        samples = []
+        for i in range(n):
+            v = struct.unpack_from(">10h", data, pos + 12 + 20 * i)
+            samples.append((v[:6], [q / 16384.0 for q in v[6:]]))
+        found[index] = (rate, samples)
+    return [(index,) + found[index] for index in sorted(found)]
+
+
+def check(name, ok, detail):
+    print("%-4s %-48s %s" % ("ok" if ok else "FAIL", name, detail))
+    return ok
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Replay of the blobs of a TacoImu")
+    parser.add_argument("--capture", help="capture of taco_monitor.py --record, made up if not given")
+    parser.add_argument("--save", help="file to keep the made up capture in")
+    parser.add_argument("--beta", type=float, default=0.1, help="beta of the fusion (TacoImu::setFusion)")
+    options = parser.parse_args()
+
+    rate = 500
+    folder = tempfile.TemporaryDirectory()
+    path = options.capture or options.save or os.path.join(folder.name, "imu.capture")
+    if not options.capture:
+        board_lost, network_lost = make_capture(path, rate, options.beta)
+
+    found = blobs(path)
+    if not found:
+        return 0 if check("blobs in the capture", False, "none") else 1
+    rate = found[0][1]
+    first = found[0][0]
+
+    #the samples in order, with the gaps between them
+    gaps = 0
+    after_gaps = []
+    expected = first
+    received = []
+    for index, _, samples in found:
+        if index > expected:
+            gaps += index - expected
+            after_gaps.append(index)
+        for i, sample in enumerate(samples):
+            received.append((index + i, sample))
+        expected = max(expected, index + len(samples))
+
+    program = build("imu.cpp", "TacoImuSamples.cpp")
+    out = run(program, "".join("f %d %d %d %d %d %d\n" % tuple(raw) for _, (raw, _) in received),
+              str(rate), str(options.beta)).splitlines()
+    replayed = [[float(v) for v in line.split()] for line in out]
+
+    results = []
+    def settled(index):
+        return (index - first) / rate >= SETTLE and not any(0 <= index - g < RECOVER * rate for g in after_gaps)
+
+    settled = [(index, q, r) for (index, (_, q)), r in zip(received, replayed) if settled(index)]
+    worst = max(angle(gravity(q), gravity(r)) for _, q, r in settled) if settled else 180
+    results.append(check("replayed fusion converges to the board", worst < 1.0,
+                         "%.2f degrees at most after %g s" % (worst, SETTLE)))
+
+    if options.capture:
+        print("     %d samples received, %d lost (%.2f%%)" % (len(received), gaps, 100.0 * gaps / (len(received) + gaps)))
+        return 0 if all(results) else 1
+
+    truth = [true_gravity(i / rate) for i, _, _ in settled]
+    worst = max(angle(gravity(q), g) for (_, q, _), g in zip(settled, truth))
+    results.append(check("board fusion converges", worst < 1.0, "%.2f degrees at most after %g s" % (worst, SETTLE)))
+    worst = max(angle(gravity(r), g) for (_, _, r), g in zip(settled, truth))
+    results.append(check("replayed fusion converges", worst < 1.0, "%.2f degrees at most after %g s" % (worst, SETTLE)))
+    start = angle(gravity(received[0][1][1]), true_gravity(0))
+    results.append(check("the fusion started away from the orientation", start > 20, "%.1f degrees" % start))
+    misplaced = sum(1 for index, (raw, _) in received
+                    if list(raw[:3]) != [int(round(a * ACCEL_SCALE)) for a in true_gravity(index / rate)])
+    results.append(check("every sample has its index", misplaced == 0, "%d misplaced" % misplaced))
+    results.append(check("gaps are the samples lost", gaps == board_lost + network_lost and board_lost > 0,
+                         "%d = %d on the board + %d on the network" % (gaps, board_lost, network_lost)))
+    return 0 if all(results) else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
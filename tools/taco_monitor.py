@@ -0,0 +1,224 @@
+#!/usr/bin/env python3
+"""
+Loss, reordering and jitter of the frames sent by a Taco board.
+
+Enable the frame header on the board, with taco.setFrameHeader() or with
+/taco/config/header "args" (or "bundle"), and listen on the port Taco sends to:
+
+    python3 tools/taco_monitor.py --port 4444
+
+With --echo it also answers the /taco/echo messages of the congestion control
+of the board (taco.setRateControl()), so it can measure the round trip.
+
+Every second it prints, for every board and OSC address, the frames received,
+the frames lost and out of order, and the jitter of the arrival times against
+the timestamps of the board (RFC 3550 style).
+
+The sequence numbers are counted per OSC address on the board, before the
+subscriptions choose what every host gets. A subscription with a decimation of
+n gets 1 of every n numbers: pass --decimation n, or every gap counts as loss.
+Messages held back by the max rate of a subscription also count as lost.
+
+With --record FILE it also saves every datagram received, to replay them
+later (tools/taco_imu_test.py --capture FILE replays the blobs of an IMU).
+
+It can also be used as a library:
+
+    monitor = FrameMonitor(max(options.decimation, 1))
+    monitor.feed(key, seq, board_time_us, arrival_time_us)
+    print(monitor.stats(key))
+"""
+
+import argparse
+import socket
+import struct
+import time
+
+
+class StreamStats:
+    """Counters of a single stream of frames"""
+
+    def __init__(self, step=1):
+        self.step = step            # decimation of the subscription
+        self.received = 0
+        self.lost = 0
+        self.reordered = 0
+        self.duplicated = 0
+        self.jitter = 0.0           # microseconds
+        self.expected = None        # next sequence number
+        self.last_transit = None
+
+    def feed(self, seq, board_us, arrival_us):
+        self.received += 1
+
+        if self.expected is None or seq == self.expected:
+            self.expected = seq + self.step
+        elif seq > self.expected:
+            self.lost += (seq - self.expected) // self.step
+            self.expected = seq + self.step
+        else:
+            # it was counted as lost when the next ones arrived
+            if self.lost > 0:
+                self.lost -= 1
+                self.reordered += 1
+            else:
+                self.duplicated += 1
+
+        # interarrival jitter, as RTP does
+        if board_us is not None:
+            transit = arrival_us - board_us
+            if self.last_transit is not None:
+                d = abs(transit - self.last_transit)
+                self.jitter += (d - self.jitter) / 16.0
+            self.last_transit = transit
+
+
+class FrameMonitor:
+    """Stats of many streams, one per key (board and OSC address)"""
+
+    def __init__(self, step=1):
+        self.step = step
+        self.streams = {}
+
+    def feed(self, key, seq, board_us, arrival_us):
+        stream = self.streams.setdefault(key, StreamStats(self.step))
+        stream.feed(seq, board_us, arrival_us)
+
+    def stats(self, key):
+        return self.streams.get(key)
+
+
+# ----------------------------------------------------------------------------
+# OSC decoding, only what the frame headers need
+
+def _string(data, pos):
+    end = data.index(b"\0", pos)
+    return data[pos:end].decode("utf-8", "replace"), (end + 4) & ~3
+
+
+def _message(data):
+    """address, type tags and the arguments we need (i, h, f, t)"""
+    address, pos = _string(data, 0)
+    tags, pos = _string(data, pos)
+    args = []
+    for tag in tags[1:]:
+        if tag in "if":
+            args.append(struct.unpack_from(">i" if tag == "i" else ">f", data, pos)[0])
+            pos += 4
+        elif tag in "ht":
+            args.append(struct.unpack_from(">q", data, pos)[0])
+            pos += 8
+        elif tag == "s":
+            value, pos = _string(data, pos)
+            args.append(value)
+        elif tag == "b":
+            size = struct.unpack_from(">i", data, pos)[0]
+            args.append(data[pos + 4:pos + 4 + size])
+            pos += 4 + ((size + 3) & ~3)
+        else:
+            args.append(None)
+    return address, tags[1:], args
+
+
+def frames(data):
+    """(address, seq, board time in us) of the frames of a datagram. The frames
+    a slow destination missed come again together in a bundle (timetag 1), one
+    element per frame: a bundle with its /taco/frame, or a message with its
+    ih trailer"""
+    if data.startswith(b"#bundle\0"):
+        seconds, fraction = struct.unpack_from(">II", data, 8)
+        board_us = seconds * 1000000 + (fraction * 1000000 >> 32)
+        pos = 16
+        seq = None
+        while pos + 4 <= len(data):
+            size = struct.unpack_from(">i", data, pos)[0]
+            element = data[pos + 4:pos + 4 + size]
+            pos += 4 + size
+            if element.startswith(b"#bundle\0"):
+                yield from frames(element)
+                continue
+            address, tags, args = _message(element)
+            if address == "/taco/frame" and tags.startswith("i"):
+                seq = args[0] & 0xFFFFFFFF
+            elif seq is not None:
+                yield address, seq, board_us
+            elif tags.endswith("ih"):
+                yield address, args[-2] & 0xFFFFFFFF, args[-1]
+        return
+
+    address, tags, args = _message(data)
+    if tags.endswith("ih"):
+        yield address, args[-2] & 0xFFFFFFFF, args[-1]
+
+
+# ----------------------------------------------------------------------------
+# captures of --record: per datagram, uint32 length and uint64 arrival time in
+# us (big endian), then the datagram
+
+def record(f, data, arrival_us):
+    f.write(struct.pack(">IQ", len(data), arrival_us) + data)
+
+
+def capture(path):
+    """(arrival time in us, datagram) of every datagram of a capture"""
+    with open(path, "rb") as f:
+        content = f.read()
+    pos = 0
+    while pos + 12 <= len(content):
+        length, arrival = struct.unpack_from(">IQ", content, pos)
+        yield arrival, content[pos + 12:pos + 12 + length]
+        pos += 12 + length
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Loss, reordering and jitter of Taco frames")
+    parser.add_argument("--port", type=int, default=4444, help="udp port Taco sends to")
+    parser.add_argument("--group", help="multicast group to join")
+    parser.add_argument("--interval", type=float, default=1.0, help="seconds between reports")
+    parser.add_argument("--echo", action="store_true", help="answer /taco/echo for the congestion control")
+    parser.add_argument("--decimation", type=int, default=1, help="decimation of our subscription, 1 of every n")
+    parser.add_argument("--record", help="file to save every datagram in")
+    options = parser.parse_args()
+    saved = open(options.record, "wb") if options.record else None
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    sock.bind(("", options.port))
+    if options.group:
+        mreq = struct.pack("4s4s", socket.inet_aton(options.group), socket.inet_aton("0.0.0.0"))
+        sock.setsockopt(socket.IPPROTO_IP, socket.IP_ADD_MEMBERSHIP, mreq)
+    sock.settimeout(0.1)
+
+    monitor = FrameMonitor(max(options.decimation, 1))
+    next_report = time.monotonic() + options.interval
+    while True:
+        try:
+            data, sender = sock.recvfrom(2048)
+            ip = sender[0]
+            arrival = time.monotonic_ns() // 1000
+            if saved:
+                record(saved, data, arrival)
+            if data.startswith(b"/taco/echo\0"):
+                if options.echo:
+                    sock.sendto(data, sender)
+                continue
+            for address, seq, board_us in frames(data):
+                monitor.feed((ip, address), seq, board_us, arrival)
+        except socket.timeout:
+            pass
+        except (ValueError, IndexError, struct.error):
+            pass    # not a Taco frame
+
+        if time.monotonic() >= next_report:
+            next_report += options.interval
+            if saved:
+                saved.flush()
+            for (ip, address), s in sorted(monitor.streams.items()):
+                total = s.received + s.lost
+                loss = 100.0 * s.lost / total if total else 0.0
+                print("%-15s %-24s received %8d  lost %6d (%5.2f%%)  reordered %5d  jitter %8.1f us"
+                      % (ip, address, s.received, s.lost, loss, s.reordered, s.jitter))
+
+
+if __name__ == "__main__":
+    main()
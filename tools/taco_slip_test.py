@@ -0,0 +1,119 @@
+#!/usr/bin/env python3
+"""
+Checks of the SLIP framing of the serial transport (Taco/TacoSlip.cpp).
+
+    python3 tools/taco_slip_test.py
+
+It builds TacoSlip.cpp with tools/host/slip.cpp for this computer (it needs
+g++) and checks:
+
+  * packets full of END and ESC bytes are encoded as RFC 1055 says, with an
+    END at both ends, and decoded back, also a few bytes at a time
+  * noise, a lone ESC, empty packets and packets bigger than TACO_SLIP_PACKET_SIZE
+    between packets are dropped and the next packet is still decoded
+  * when nobody empties the ring, packets are dropped whole and counted,
+    and the ring takes packets again once it is written
+  * a packet bigger than TACO_SLIP_FRAME_SIZE encoded is dropped
+"""
+
+import os
+import random
+import sys
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from taco_host import build, run
+
+END, ESC, ESC_END, ESC_ESC = 0xC0, 0xDB, 0xDC, 0xDD
+RING_SIZE = 8192        # TACO_SLIP_RING_SIZE
+FRAME_SIZE = 2048       # TACO_SLIP_FRAME_SIZE
+PACKET_SIZE = 1024      # TACO_SLIP_PACKET_SIZE
+
+
+def slip(packet):
+    """RFC 1055, with an END before the packet too as OSC 1.1 asks"""
+    out = bytearray([END])
+    for b in packet:
+        out += bytes([ESC, ESC_END]) if b == END else bytes([ESC, ESC_ESC]) if b == ESC else bytes([b])
+    return bytes(out + bytes([END]))
+
+
+def slip_run(program, commands):
+    """One output line of the driver for every command"""
+    text = "".join(c[0] + (" " + c[1].hex() if len(c) > 1 else "") + "\n" for c in commands)
+    return run(program, text).splitlines()
+
+
+def packets(line):
+    return [] if line == "-" else [bytes.fromhex(p) for p in line.split()]
+
+
+def check(name, ok, detail):
+    print("%-4s %-48s %s" % ("ok" if ok else "FAIL", name, detail))
+    return ok
+
+
+def main():
+    program = build("slip.cpp", "TacoSlip.cpp")
+    rng = random.Random(1)
+    results = []
+
+    #round trip of packets with a lot of END and ESC
+    sent = [bytes(rng.choice([END, ESC, ESC_END, ESC_ESC, rng.randrange(256)]) for _ in range(rng.randrange(1, 300)))
+            for _ in range(40)]
+    out = slip_run(program, [("e", p) for p in sent] + [("w",)])
+    stream = bytes.fromhex(out[-1])
+    results.append(check("encoded as RFC 1055", out[:-1] == ["ok"] * len(sent) and
+                         stream == b"".join(slip(p) for p in sent), "%d bytes of %d packets" % (len(stream), len(sent))))
+
+    pieces = []
+    i = 0
+    while i < len(stream):
+        n = rng.randrange(1, 20)
+        pieces.append(stream[i:i + n])
+        i += n
+    out = slip_run(program, [("d", piece) for piece in pieces])
+    received = [p for line in out for p in packets(line)]
+    results.append(check("decoded back, a few bytes at a time", received == sent,
+                         "%d of %d packets" % (len(received), len(sent))))
+
+    #noise between packets: only the good ones come out
+    good = [b"/a\0\0,i\0\0\0\0\0\1", bytes([ESC_END, END, ESC, 1, 2])]
+    noise = (bytes([END, END, END]) + slip(b"x" * (PACKET_SIZE + 1)) + slip(good[0]) +
+             bytes([END]) + slip(bytes(PACKET_SIZE * 2)) + bytes([ESC]) + slip(good[1]))
+    out = slip_run(program, [("d", noise)])
+    received = packets(out[0])
+    results.append(check("noise and too big packets dropped", received == good,
+                         "%d packets decoded" % len(received)))
+
+    #ring full: nobody writes it to the uart
+    packet = bytes(range(100))
+    frame = len(slip(packet))
+    fits = RING_SIZE // frame
+    out = slip_run(program, [("e", packet)] * (fits + 10) + [("n",), ("w",), ("e", packet), ("n",)])
+    accepted = out[:fits + 10].count("ok")
+    written = len(bytes.fromhex(out[fits + 11]))
+    results.append(check("ring full: whole packets dropped", accepted == fits and out[fits + 10] == "10" and
+                         written == fits * frame, "%d of %d packets, %d dropped" % (accepted, fits + 10, int(out[fits + 10]))))
+    results.append(check("ring takes packets again once written", out[fits + 12] == "ok" and out[fits + 13] == "10",
+                         out[fits + 12]))
+
+    #wrapping around the end of the ring
+    commands = []
+    expected = b""
+    for i in range(3 * RING_SIZE // 1000):
+        p = bytes([i % 256]) * (700 + i)
+        commands += [("e", p), ("w",)]
+        expected += slip(p)
+    out = slip_run(program, commands)
+    stream = b"".join(bytes.fromhex(l) for l in out[1::2])
+    results.append(check("ring wraps around", stream == expected, "%d bytes" % len(stream)))
+
+    #a packet that does not fit in the frame once encoded
+    out = slip_run(program, [("e", bytes([END]) * (FRAME_SIZE // 2)), ("n",), ("w",)])
+    results.append(check("frame too big dropped", out == ["dropped", "1", "-"], " ".join(out)))
+
+    return 0 if all(results) else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,130 @@
+#!/usr/bin/env python3
+"""
+Does the memory of a Taco board stay flat over a long run?
+
+It reads /api/stats of a running board every few seconds for as long as asked
+(hours, or days for an installation) and fails if the memory keeps going:
+
+    python3 tools/taco_soak.py --board 192.168.0.1 --hours 12
+
+After a warm-up (the first allocations of the web server, the mDNS task...)
+it checks, between the warm-up and the end of the run:
+
+  * the free heap and the largest free block did not drop by more than
+    --heap-tolerance bytes
+  * the stack of no task got closer than --stack-margin bytes to its end
+  * with a firmware built with -DTACO_ALLOC_STATS=1, the objects alive in every
+    subsystem (operator new minus delete) did not grow by more than
+    --alloc-tolerance, and no subsystem allocated more than --new-per-frame
+    times per frame sent (a heap that churns fragments even if nothing leaks)
+
+Every sample goes to --log as a line of JSON, to plot it later. The exit code
+is 0 if the memory stayed flat, 1 if not, 2 if the board stopped answering.
+"""
+
+import argparse
+import json
+import sys
+import time
+import urllib.request
+
+
+def read_stats(board, timeout):
+    with urllib.request.urlopen("http://%s/api/stats" % board, timeout=timeout) as reply:
+        return json.loads(reply.read().decode("utf-8"))
+
+
+def alive(stats):
+    """objects alive in every subsystem, or None if they are not counted"""
+    allocs = stats.get("allocs")
+    if not allocs:
+        return None
+    return {name: a["new"] - a["delete"] for name, a in allocs.items()}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--board", required=True, help="IP address of the board")
+    parser.add_argument("--hours", type=float, default=1, help="length of the run")
+    parser.add_argument("--interval", type=float, default=10, help="seconds between two samples")
+    parser.add_argument("--warmup", type=float, default=60, help="seconds before the reference sample")
+    parser.add_argument("--heap-tolerance", type=int, default=2048, help="bytes the heap can lose")
+    parser.add_argument("--alloc-tolerance", type=int, default=16, help="objects a subsystem can gain")
+    parser.add_argument("--new-per-frame", type=float, default=0.01, help="allocations per frame a subsystem can make")
+    parser.add_argument("--stack-margin", type=int, default=256, help="bytes every stack must keep free")
+    parser.add_argument("--log", help="file to write the samples to, one JSON per line")
+    args = parser.parse_args()
+
+    log = open(args.log, "a") if args.log else None
+    start = time.time()
+    end = start + args.hours * 3600
+    reference = None
+    last = None
+    failures = 0
+
+    while time.time() < end:
+        try:
+            stats = read_stats(args.board, 10)
+            failures = 0
+        except (OSError, ValueError) as e:
+            failures += 1
+            print("no answer: %s" % e, file=sys.stderr)
+            if failures >= 5:
+                print("FAIL: the board stopped answering")
+                return 2
+            time.sleep(args.interval)
+            continue
+
+        stats["time"] = time.time() - start
+        if log:
+            log.write(json.dumps(stats) + "\n")
+            log.flush()
+
+        heap = stats["heap"]
+        print("%7.0f s  free %7d  largest %7d  lowest %7d  blocks %4d  frames %d" % (
+            stats["time"], heap["free"], heap["largest_block"], heap["min_free"], heap["free_blocks"], stats["frames"]))
+
+        if reference is None and stats["time"] >= args.warmup:
+            reference = stats
+        last = stats
+        time.sleep(args.interval)
+
+    if reference is None or last is reference:
+        print("FAIL: the run was shorter than the warm-up")
+        return 1
+
+    problems = []
+    frames = max(last["frames"] - reference["frames"], 1)
+
+    for key in ("free", "largest_block"):
+        lost = reference["heap"][key] - last["heap"][key]
+        if lost > args.heap_tolerance:
+            problems.append("%s lost %d bytes" % (key, lost))
+
+    for task, free in last["stack_free"].items():
+        if free < args.stack_margin:
+            problems.append("stack of %s has %d bytes left" % (task, free))
+
+    before, after = alive(reference), alive(last)
+    if before is None or after is None:
+        print("allocations are not counted, build the firmware with -DTACO_ALLOC_STATS=1")
+    else:
+        print("%-10s %10s %10s %14s" % ("subsystem", "alive", "growth", "new per frame"))
+        for name in after:
+            growth = after[name] - before.get(name, 0)
+            news = last["allocs"][name]["new"] - reference["allocs"][name]["new"]
+            print("%-10s %10d %+10d %14.3f" % (name, after[name], growth, news / frames))
+            if growth > args.alloc_tolerance:
+                problems.append("%s keeps %d more objects" % (name, growth))
+            if news / frames > args.new_per_frame:
+                problems.append("%s allocates %.3f times per frame" % (name, news / frames))
+
+    for p in problems:
+        print("FAIL: " + p)
+    if not problems:
+        print("OK: the memory stayed flat over %d frames" % frames)
+    return 1 if problems else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
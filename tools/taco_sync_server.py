@@ -0,0 +1,94 @@
+#!/usr/bin/env python3
+"""
+Time server for the clock sync of Taco boards (taco.beginSync()).
+
+It answers every /taco/sync/req h (t1, time of the board) with
+/taco/sync/reply h h h (t1, t2 request received, t3 reply sent), the times of
+this computer in microseconds since 1970. Boards synced with it send frame
+timestamps and bundle timetags in the time of this computer.
+
+    python3 tools/taco_sync_server.py --port 5555
+
+and in the board:
+
+    taco.beginSync(IPAddress(192, 168, 0, 2), 5555);
+
+To see how the sync behaves on a bad network, the replies can be delayed:
+--delay adds a fixed delay to the way back (an asymmetric path, the worst case
+for the offset: it is off by half the delay) and --jitter a random one to both
+ways (the filter of the board should ignore it). tools/taco_sync_test.py
+checks both against a copy of the estimator of the board.
+"""
+
+import argparse
+import heapq
+import random
+import socket
+import struct
+import time
+
+
+def now_us():
+    return time.time_ns() // 1000
+
+
+def osc_string(s):
+    data = s.encode() + b"\0"
+    return data + b"\0" * (-len(data) % 4)
+
+
+def parse_request(data):
+    """t1 of a /taco/sync/req h message, or None"""
+    address = osc_string("/taco/sync/req")
+    if not data.startswith(address + osc_string(",h")):
+        return None
+    return struct.unpack_from(">q", data, len(address) + 4)[0]
+
+
+def reply(t1, t2, t3):
+    return osc_string("/taco/sync/reply") + osc_string(",hhh") + struct.pack(">qqq", t1, t2, t3)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Time server for Taco boards")
+    parser.add_argument("--port", type=int, default=5555, help="udp port to listen to")
+    parser.add_argument("--delay", type=float, default=0.0, help="ms added to the replies only")
+    parser.add_argument("--jitter", type=float, default=0.0, help="max random ms added to both ways")
+    parser.add_argument("--verbose", action="store_true", help="print every request")
+    options = parser.parse_args()
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.bind(("", options.port))
+    sock.settimeout(0.001)
+
+    pending = []        # (time to process, kind, data, address): simulated network
+    while True:
+        try:
+            data, address = sock.recvfrom(512)
+            # the request arrives later (jitter of the way in)
+            arrival = time.monotonic() + random.uniform(0, options.jitter) / 1000.0
+            heapq.heappush(pending, (arrival, 0, data, address))
+        except socket.timeout:
+            pass
+
+        while pending and pending[0][0] <= time.monotonic():
+            _, kind, data, address = heapq.heappop(pending)
+            if kind == 0:
+                t1 = parse_request(data)
+                if t1 is None:
+                    continue
+                t2 = now_us()
+                t3 = now_us()
+                # the reply is stamped now and leaves later: the delay belongs to the
+                # way back (asymmetric delay and jitter), not to the processing time t3 - t2
+                wait = (options.delay + random.uniform(0, options.jitter)) / 1000.0
+                heapq.heappush(pending, (time.monotonic() + wait, 1, (t1, t2, t3), address))
+            else:
+                t1, t2, t3 = data
+                sock.sendto(reply(t1, t2, t3), address)
+                if options.verbose:
+                    print("%s:%d t1 %d t2 %d" % (address[0], address[1], t1, t2))
+
+
+if __name__ == "__main__":
+    main()
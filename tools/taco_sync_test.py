@@ -0,0 +1,170 @@
+#!/usr/bin/env python3
+"""
+Checks of the clock sync of Taco (TacoClock and tools/taco_sync_server.py).
+
+    python3 tools/taco_sync_test.py
+
+It builds Taco/TacoClock.cpp, the clock the boards run, with tools/host/clock.cpp
+for this computer (it needs g++) and checks it on a simulated network with
+delays injected:
+
+  * drift of 50 ppm and 0.3 to 2.3 ms of random delay each way: the error
+    between requests has to stay under 0.5 ms
+  * the same with a path slower on the way back: the offset is off by half
+    the difference, what --delay of the sync server is meant to show
+  * the server clock jumping 1 s: the sync starts again and follows it
+
+Then it runs tools/taco_sync_server.py with --delay on this computer and
+syncs to it through the loopback, so the delay the server injects has to show
+as an asymmetric path.
+"""
+
+import os
+import random
+import socket
+import struct
+import subprocess
+import sys
+import time
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from taco_host import build, run
+
+
+class Clock:
+    """TacoClock of Taco/TacoClock.cpp, built for this computer. The round
+    trips are queued and given to it with the queries in one run"""
+
+    program = None
+
+    def __init__(self):
+        if Clock.program is None:
+            Clock.program = build("clock.cpp", "TacoClock.cpp")
+        self.lines = []
+        self.samples = 0
+
+    def sample(self, t1, t2, t3, t4):
+        self.lines.append("s %d %d %d %d" % (t1, t2, t3, t4))
+        self.samples += 1
+
+    def query(self, local):
+        self.lines.append("q %d" % local)
+
+    def results(self):
+        """(server time, synced, drift, error) of every query, in order"""
+        out = run(Clock.program, "\n".join(self.lines) + "\n")
+        return [(int(r[0]), r[1] == "1", float(r[2]), int(r[3])) for r in (l.split() for l in out.splitlines())]
+
+
+def simulate(drift_ppm, way_in, way_back, seconds=600, interval=1.0, jump_at=None, seed=1):
+    """Syncs TacoClock on a simulated network. way_in and way_back give the
+    delays in us. Returns the errors (us) at the middle of every interval"""
+    rng = random.Random(seed)
+    start_offset = 1234567890      # server time - local time at boot
+    expected = []
+    clock = Clock()
+
+    def server(local):
+        t = local + start_offset + local * drift_ppm * 1e-6
+        if jump_at is not None and local >= jump_at * 1e6:
+            t += 1000000
+        return int(t)
+
+    local = 1000000
+    while local < seconds * 1e6:
+        t1 = local
+        arrive = t1 + way_in(rng)
+        t2 = server(arrive)
+        t3 = t2 + 50                               # processing
+        t4 = arrive + 50 + way_back(rng)
+        clock.sample(t1, t2, t3, t4)
+
+        middle = t4 + int(interval * 5e5)
+        clock.query(middle)
+        expected.append(server(middle))
+        local += int(interval * 1e6)
+    return [r[0] - e for r, e in zip(clock.results(), expected)]
+
+
+def check(name, ok, detail):
+    print("%-4s %-48s %s" % ("ok" if ok else "FAIL", name, detail))
+    return ok
+
+
+def simulated_checks():
+    results = []
+    def jitter(rng):
+        return rng.uniform(300, 2300)
+
+    errors = simulate(50, jitter, jitter)[30:]
+    worst = max(abs(e) for e in errors)
+    results.append(check("50 ppm, 0.3-2.3 ms each way", worst < 500, "max error %d us" % worst))
+
+    errors = simulate(50, jitter, lambda rng: jitter(rng) + 4000)[30:]
+    mean = sum(errors) / len(errors)
+    results.append(check("4 ms slower way back", abs(mean + 2000) < 500,
+                         "mean error %d us (half the asymmetry: -2000)" % mean))
+
+    errors = simulate(50, jitter, jitter, jump_at=300)
+    after = errors[330:]
+    worst = max(abs(e) for e in after)
+    results.append(check("server clock jumps 1 s", worst < 500, "max error %d us after it" % worst))
+    return results
+
+
+def server_check(delay_ms=20.0):
+    """Syncs to a real tools/taco_sync_server.py --delay through the loopback"""
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.bind(("127.0.0.1", 0))
+    port = sock.getsockname()[1]
+    sock.close()
+
+    script = os.path.join(os.path.dirname(os.path.abspath(__file__)), "taco_sync_server.py")
+    server = subprocess.Popen([sys.executable, script, "--port", str(port), "--delay", str(delay_ms)])
+    try:
+        time.sleep(0.5)
+        sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        sock.settimeout(1.0)
+        local_offset = -5000000          # the "board" runs 5 s behind this computer
+        clock = Clock()
+
+        def local_us():
+            return time.time_ns() // 1000 + local_offset
+
+        address = b"/taco/sync/req\0\0"
+        reply_address = b"/taco/sync/reply\0\0\0\0"
+        for _ in range(24):
+            t1 = local_us()
+            sock.sendto(address + b",h\0\0" + struct.pack(">q", t1), ("127.0.0.1", port))
+            try:
+                data = sock.recv(512)
+            except socket.timeout:
+                continue
+            t4 = local_us()
+            if not data.startswith(reply_address):
+                continue
+            r1, t2, t3 = struct.unpack_from(">qqq", data, len(reply_address) + 8)
+            if r1 == t1:
+                clock.sample(t1, t2, t3, t4)
+            time.sleep(0.05)
+    finally:
+        server.kill()
+        server.wait()
+
+    if clock.samples == 0:
+        return [check("sync server --delay %g ms" % delay_ms, False, "no replies")]
+    now = local_us()
+    clock.query(now)
+    error = (clock.results()[-1][0] - now - (-local_offset)) / 1000.0
+    expected = -delay_ms / 2
+    return [check("sync server --delay %g ms" % delay_ms, abs(error - expected) < 2.0,
+                  "offset error %.2f ms (half the delay: %.2f)" % (error, expected))]
+
+
+def main():
+    results = simulated_checks() + server_check()
+    return 0 if all(results) else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
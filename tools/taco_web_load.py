@@ -0,0 +1,115 @@
+#!/usr/bin/env python3
+"""
+Does the web server of a Taco board slow down its OSC stream?
+
+It counts the packets the board sends to this host for a while, then hammers
+the configuration page with several clients at once (some of them slow, like
+a phone on a weak link) while it keeps counting, and compares both rates:
+
+    python3 tools/taco_web_load.py --board 192.168.0.1 --port 4444
+
+The board has to send to this host (it is a client of the access point, or
+add it with /taco/config/host/add s) and the server has to be started in its
+task with taco.beginServer(server, true). It prints the packets per second
+before and during the load, the requests served and the time they took. With
+the server in its task the rates should be the same.
+"""
+
+import argparse
+import socket
+import threading
+import time
+import urllib.request
+
+
+class PacketCounter(threading.Thread):
+    """Counts the UDP packets arriving at a port"""
+
+    def __init__(self, port):
+        super().__init__(daemon=True)
+        self.sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.sock.bind(("", port))
+        self.sock.settimeout(0.2)
+        self.count = 0
+        self.running = True
+
+    def run(self):
+        while self.running:
+            try:
+                self.sock.recv(65536)
+                self.count += 1
+            except socket.timeout:
+                pass
+
+    def rate(self, seconds):
+        start = self.count
+        time.sleep(seconds)
+        return (self.count - start) / seconds
+
+
+class Hammer(threading.Thread):
+    """Asks for the page again and again, slowly if asked to"""
+
+    def __init__(self, url, slow):
+        super().__init__(daemon=True)
+        self.url = url
+        self.slow = slow
+        self.served = 0
+        self.failed = 0
+        self.times = []
+        self.running = True
+
+    def run(self):
+        while self.running:
+            start = time.time()
+            try:
+                with urllib.request.urlopen(self.url, timeout=10) as reply:
+                    while True:
+                        chunk = reply.read(64 if self.slow else 65536)
+                        if not chunk:
+                            break
+                        if self.slow:
+                            time.sleep(0.05)
+                self.served += 1
+                self.times.append(time.time() - start)
+            except OSError:
+                self.failed += 1
+                time.sleep(0.1)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--board", required=True, help="IP address of the board")
+    parser.add_argument("--port", type=int, default=4444, help="UDP port Taco sends to")
+    parser.add_argument("--clients", type=int, default=8, help="clients asking for the page at once")
+    parser.add_argument("--slow", type=int, default=2, help="how many of them read slowly")
+    parser.add_argument("--seconds", type=float, default=10, help="length of every measure")
+    args = parser.parse_args()
+
+    counter = PacketCounter(args.port)
+    counter.start()
+
+    idle = counter.rate(args.seconds)
+    print("idle:      %8.1f packets/s" % idle)
+
+    url = "http://%s/" % args.board
+    hammers = [Hammer(url, i < args.slow) for i in range(args.clients)]
+    for h in hammers:
+        h.start()
+    loaded = counter.rate(args.seconds)
+    for h in hammers:
+        h.running = False
+
+    served = sum(h.served for h in hammers)
+    failed = sum(h.failed for h in hammers)
+    times = sorted(t for h in hammers for t in h.times)
+    print("loaded:    %8.1f packets/s" % loaded)
+    print("requests:  %d served, %d failed" % (served, failed))
+    if times:
+        print("page time: %.0f ms median, %.0f ms max" % (1000 * times[len(times) // 2], 1000 * times[-1]))
+    if idle > 0:
+        print("change:    %+.1f %%" % (100 * (loaded - idle) / idle))
+
+
+if __name__ == "__main__":
+    main()